@@ -0,0 +1,855 @@
+// sparta-mon microbenchmarks.
+//
+//   sparta-bench --fmt         text formatting (header, TASKS rows) and
+//                              graph autoscaling over a full-width window
+//   sparta-bench --root DIR    collectors, thread drill-down, sort, filter,
+//                              render, metrics export, shm publication,
+//                              agent wire frames, anomaly triggers and
+//                              time to the first frame
+//                              against a bench/mkproc fixture at DIR
+//   sparta-bench --socks N     socket view over N loopback connections
+//   sparta-bench --fleet N     fleet loop against N simulated agents on
+//                              loopback
+//
+// Built and run by `make bench`. Each result is printed as one JSON object
+// per line so runs can be diffed or collected across commits; for the
+// --root benches one op is one tick:
+//   {"bench":"header_steady","ns_per_op":12.3,"iters":1000000}
+//   {"bench":"collect.procs","tasks":1000,"nics":16,"disks":16,"ns_per_op":...}
+#define SPARTA_MON_NO_MAIN
+#include "../sparta_mon.c"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define BENCH_SECONDS 0.25
+#define BENCH_ROWS 40
+
+static volatile unsigned long long g_sink;
+
+static double bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Extra JSON fields ("key":value,...) added to every result.
+static char g_ctx[256];
+
+static void report(const char *name, double ns, long long iters) {
+  printf("{\"bench\":\"%s\",%s\"ns_per_op\":%.1f,\"iters\":%lld}\n",
+         name, g_ctx, ns / (double)iters, iters);
+  fflush(stdout);
+}
+
+// Run `body` in doubling batches until BENCH_SECONDS have elapsed.
+#define BENCH(name, body) do {                                  \
+    long long iters_ = 0, batch_ = 1;                           \
+    double t0_ = bench_now_ns(), el_ = 0;                       \
+    while (el_ < BENCH_SECONDS * 1e9) {                         \
+      for (long long i_ = 0; i_ < batch_; i_++) {               \
+        long long it = iters_ + i_; (void)it;                   \
+        body;                                                   \
+      }                                                         \
+      iters_ += batch_;                                         \
+      batch_ *= 2;                                              \
+      el_ = bench_now_ns() - t0_;                               \
+    }                                                           \
+    report(name, el_, iters_);                                  \
+  } while (0)
+
+// ---------------------------
+// printf-based reference (the pre-TextBuf render path)
+// ---------------------------
+static void ref_fmt_bytes(unsigned long long b, char *out, size_t n) {
+  const char *u = "B";
+  double v = (double)b;
+  if (v >= 1024) { v/=1024; u="KB"; }
+  if (v >= 1024) { v/=1024; u="MB"; }
+  if (v >= 1024) { v/=1024; u="GB"; }
+  snprintf(out, n, "%.1f%s", v, u);
+}
+
+static void ref_header(const Sample *s, char *line2, size_t n) {
+  char thrStr[128] = "PWR n/a";
+  if (s->have_thr) throttled_summary(s->thrFlags, thrStr, sizeof(thrStr));
+
+  char fsLine[128] = "FS / n/a";
+  if (s->have_fs) {
+    char uB[32], tB[32];
+    ref_fmt_bytes(s->fsUsedB, uB, sizeof(uB));
+    ref_fmt_bytes(s->fsTotB, tB, sizeof(tB));
+    snprintf(fsLine, sizeof(fsLine), "FS / %.1f%% (%s/%s) INO %.1f%%",
+             s->fsPct, uB, tB, s->inodePct);
+  }
+  snprintf(line2, n,
+    "CPU %.1f%% MEM %.1f%% LOAD %.2f %.2f %.2f TEMP %s  %s  %s  IF %s DK %s",
+    s->cpu_pct, s->mem_pct, s->l1, s->l5, s->l15,
+    s->have_tc ? "" : "n/a", fsLine, thrStr,
+    s->have_iface ? s->iface : "n/a", s->have_disk ? s->disk : "n/a");
+  if (s->have_tc) {
+    snprintf(line2, n,
+      "CPU %.1f%% MEM %.1f%% LOAD %.2f %.2f %.2f TEMP %.1fC  %s  %s  IF %s DK %s",
+      s->cpu_pct, s->mem_pct, s->l1, s->l5, s->l15, s->tc, fsLine, thrStr,
+      s->have_iface ? s->iface : "n/a", s->have_disk ? s->disk : "n/a");
+  }
+}
+
+static void ref_task_row(const ProcTrack *p, int commW, char *row, size_t n) {
+  char rssStr[32];
+  ref_fmt_bytes(p->rss_bytes, rssStr, sizeof(rssStr));
+  snprintf(row, n, "%-6d %4.1f %4.1f %-7s %c %.*s",
+           p->pid, p->cpu_avg, p->cpu_cur, rssStr, p->state, commW, p->comm);
+}
+
+// ---------------------------
+// Fixtures
+// ---------------------------
+static void sample_fixture(Sample *s, long long it) {
+  memset(s, 0, sizeof(*s));
+  s->cpu_pct = 12.34 + (double)(it % 50);
+  s->mem_pct = 41.7 + (double)(it % 7) * 0.1;
+  s->l1 = 0.52 + (double)(it % 9) * 0.01; s->l5 = 0.61; s->l15 = 0.70;
+  s->have_tc = 1; s->tc = 48.3 + (double)(it % 5) * 0.1;
+  s->have_fs = 1; s->fsPct = 68.3; s->inodePct = 3.3;
+  s->fsUsedB = 172ULL << 30; s->fsTotB = 252ULL << 30;
+  s->have_thr = 1; s->thrFlags = 0x50000;
+  s->have_iface = 1; s->have_disk = 1;
+  snprintf(s->iface, sizeof(s->iface), "eth0");
+  snprintf(s->disk, sizeof(s->disk), "mmcblk0");
+}
+
+static void tasks_fixture(ProcTrack *rows, int n, long long it) {
+  for (int i=0; i<n; i++) {
+    ProcTrack *p = &rows[i];
+    p->pid = 1000 + i * 37;
+    snprintf(p->comm, sizeof(p->comm), "worker-%d", i);
+    p->state = (i % 3) ? 'S' : 'R';
+    p->cpu_avg = 95.0 / (double)(i + 1) + (double)(it % 3) * 0.1;
+    p->cpu_cur = (double)((it + i) % 100) * 0.5;
+    p->rss_bytes = (unsigned long long)(i + 1) * 3400000ULL + (unsigned long long)(it % 4) * 4096ULL;
+  }
+}
+
+// ---------------------------
+// Benchmarks
+// ---------------------------
+static void bench_header(void) {
+  Sample s[16];
+  for (int i=0; i<16; i++) sample_fixture(&s[i], i);
+  char line[512];
+
+  BENCH("header_snprintf", {
+    ref_header(&s[it & 15], line, sizeof(line));
+    g_sink += (unsigned char)line[4];
+  });
+
+  static HeaderText h;
+  BENCH("header_changed", {
+    header_format(&h, &s[it & 15]);
+    g_sink += (unsigned long long)h.len;
+  });
+
+  BENCH("header_steady", {
+    header_format(&h, &s[0]);
+    g_sink += (unsigned long long)h.len;
+  });
+}
+
+static void bench_tasks(void) {
+  static ProcTrack frames[4][BENCH_ROWS];
+  for (int f=0; f<4; f++) tasks_fixture(frames[f], BENCH_ROWS, f);
+  int commW = 60;
+  char row[256];
+
+  BENCH("tasks_snprintf", {
+    const ProcTrack *rows = frames[it & 3];
+    for (int r=0; r<BENCH_ROWS; r++) ref_task_row(&rows[r], commW, row, sizeof(row));
+    g_sink += (unsigned char)row[0];
+  });
+
+  static TaskRowKey keys[BENCH_ROWS];
+  BENCH("tasks_changed", {
+    const ProcTrack *rows = frames[it & 3];
+    for (int r=0; r<BENCH_ROWS; r++) {
+      TextBuf b;
+      tb_init(&b, row, sizeof(row));
+      g_sink += (unsigned long long)task_row_update(&keys[r], &rows[r], 0, commW, 0, &b);
+    }
+  });
+
+  BENCH("tasks_steady", {
+    for (int r=0; r<BENCH_ROWS; r++) {
+      TextBuf b;
+      tb_init(&b, row, sizeof(row));
+      g_sink += (unsigned long long)task_row_update(&keys[r], &frames[0][r], 0, commW, 0, &b);
+    }
+  });
+}
+
+// Autoscale over HIST_MAX samples, the widest window a terminal can show.
+// hist.range.ref walks the ring one hist_get_lastN at a time.
+static void bench_scale(void) {
+  static Hist a, b;
+  for (int i=0; i<HIST_MAX + 100; i++) {
+    hist_push(&a, (double)((i * 7919) % 1000) / 10.0);
+    hist_push(&b, (double)((i * 104729) % 1000) / 10.0);
+  }
+  BENCH("hist.range.ref", {
+    double hi = 0;
+    for (int i=0; i<HIST_MAX; i++) hi = MAX(hi, hist_get_lastN(&a, HIST_MAX, i));
+    g_sink += (unsigned long long)hi;
+  });
+  float lo, hi;
+  BENCH("hist.range", {
+    hist_range(&a, HIST_MAX - (int)(it & 7), &lo, &hi);
+    g_sink += (unsigned long long)hi;
+  });
+  BENCH("graph.scale", g_sink += (unsigned long long)graph_scale(&a, &b, HIST_MAX, 1.0));
+}
+
+// ---------------------------
+// Collectors, sort and render against a fixture
+// ---------------------------
+// Point the collector at the last NIC and disk in the fixture so the readers
+// have to scan past every other device, as they would on a busy box.
+static void pick_last_devices(Collector *c, int *nics, int *disks) {
+  char line[512];
+  *nics = *disks = 0;
+  FILE *f = proc_fopen("net/dev");
+  if (f) {
+    while (fgets(line, sizeof(line), f)) {
+      char *p = line;
+      while (*p == ' ') p++;
+      char *colon = strchr(p, ':');
+      if (!colon) continue;
+      *colon = '\0';
+      if (strcmp(p, "lo") == 0) continue;
+      snprintf(c->iface, sizeof(c->iface), "%.63s", p);
+      c->have_iface = 1;
+      (*nics)++;
+    }
+    fclose(f);
+  }
+  f = proc_fopen("diskstats");
+  if (f) {
+    while (fgets(line, sizeof(line), f)) {
+      unsigned int major=0, minor=0;
+      char name[64];
+      if (sscanf(line, "%u %u %63s", &major, &minor, name) != 3) continue;
+      if (disk_score(name) <= 0) continue;
+      snprintf(c->disk, sizeof(c->disk), "%s", name);
+      c->have_disk = 1;
+      (*disks)++;
+    }
+    fclose(f);
+  }
+}
+
+static unsigned long long g_lcg = 12345;
+static double noise(double scale) {
+  g_lcg = g_lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (double)(g_lcg >> 40) / (double)(1ULL << 24) * scale;
+}
+
+// ncurses writes to the output fd directly, so the null terminal is a memfd
+// whose size is the number of bytes a real tty would have received.
+static unsigned long long tty_bytes(FILE *out) {
+  struct stat st;
+  fflush(out);
+  if (fstat(fileno(out), &st) != 0) return 0;
+  return (unsigned long long)st.st_size;
+}
+
+static void bench_render(Collector *c, Sample *base) {
+  int fd = memfd_create("sparta-bench-tty", 0);
+  FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+  FILE *in = fopen("/dev/null", "r");
+  setenv("LINES", "50", 1);
+  setenv("COLUMNS", "200", 1);
+  SCREEN *scr = out && in ? newterm("xterm-256color", out, in) : NULL;
+  if (!scr) {
+    fprintf(stderr, "sparta-bench: no terminfo for xterm-256color, skipping render\n");
+    if (out) fclose(out);
+    if (in) fclose(in);
+    return;
+  }
+  set_term(scr);
+
+  static UI ui;
+  static HistSet h;
+  ui_start(&ui);
+  ui_layout(&ui);
+
+  // Fill the plots so every column is live, as in steady state.
+  for (int i=0; i<HIST_MAX; i++) {
+    Sample s = *base;
+    s.cpu_pct = 20.0 + noise(60.0);
+    s.disk_r_mbs = noise(40.0);
+    s.net_rx_mbs = noise(10.0);
+    histset_push(&h, &s);
+  }
+  ui_draw(&ui, base, &h, &c->pt);
+
+  int mode = g_sweep;
+  for (int sweep=0; sweep<2; sweep++) {
+    g_sweep = sweep;
+    unsigned long long b0 = tty_bytes(out);
+    long long frames = 0;
+    BENCH(sweep ? "render.sweep" : "render.scroll", {
+      Sample s = *base;
+      s.cpu_pct = 20.0 + noise(60.0);
+      s.mem_pct = 41.0 + noise(2.0);
+      s.disk_r_mbs = noise(40.0);
+      s.disk_w_mbs = noise(40.0);
+      s.net_rx_mbs = noise(10.0);
+      s.net_tx_mbs = noise(10.0);
+      histset_push(&h, &s);
+      ui_draw(&ui, &s, &h, &c->pt);
+      frames++;
+    });
+    printf("{\"bench\":\"%s.bytes\",%s\"bytes_per_frame\":%.1f}\n",
+           sweep ? "render.sweep" : "render.scroll", g_ctx,
+           (double)(tty_bytes(out) - b0) / (double)MAX(1, frames));
+  }
+  g_sweep = mode;
+
+  ui_free(&ui);
+  endwin();
+  delscreen(scr);
+  fclose(out);
+  fclose(in);
+}
+
+// Time to the first frame with real rates: start-up, a baseline tick,
+// BOOT_MS, the first tick and its ui_draw. boot.first_frame brings the
+// terminal up while the baseline runs, as main does; .serial after it.
+// Best of BOOT_RUNS. Before the bootstrap this took a whole --interval.
+#define BOOT_RUNS 5
+
+static double boot_once(int threaded) {
+  static Collector c;
+  static UI ui;
+  static HistSet h;
+  memset(&ui, 0, sizeof(ui));
+  memset(&h, 0, sizeof(h));
+  int fd = memfd_create("sparta-bench-tty", 0);
+  FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+  FILE *in = fopen("/dev/null", "r");
+  setenv("LINES", "50", 1);
+  setenv("COLUMNS", "200", 1);
+
+  double t0 = bench_now_ns();
+  Boot b;
+  if (threaded) {
+    boot_start(&b, &c, 0);
+  } else {
+    memset(&b, 0, sizeof(b));
+    b.c = &c;
+    boot_main(&b);
+  }
+  SCREEN *scr = out && in ? newterm("xterm-256color", out, in) : NULL;
+  double ms = -1.0;
+  if (scr) {
+    set_term(scr);
+    ui_start(&ui);
+    ui_layout(&ui);
+  }
+  double tp = boot_finish(&b);
+  if (scr) {
+    Sample s = {0};
+    collector_tick(&c, &s, now_s() - tp);
+    histset_push(&h, &s);
+    ui_draw(&ui, &s, &h, &c.pt);
+    ms = (bench_now_ns() - t0) / 1e6;
+    ui_free(&ui);
+    endwin();
+    delscreen(scr);
+  }
+  collector_free(&c);
+  if (out) fclose(out);
+  if (in) fclose(in);
+  return ms;
+}
+
+static void bench_boot(void) {
+  for (int threaded=1; threaded>=0; threaded--) {
+    double best = -1.0;
+    for (int r=0; r<BOOT_RUNS; r++) {
+      double ms = boot_once(threaded);
+      if (ms >= 0 && (best < 0 || ms < best)) best = ms;
+    }
+    if (best < 0) {
+      fprintf(stderr, "sparta-bench: no terminfo for xterm-256color, skipping boot\n");
+      return;
+    }
+    printf("{\"bench\":\"%s\",%s\"ms\":%.1f,\"boot_ms\":%d}\n",
+           threaded ? "boot.first_frame" : "boot.first_frame.serial", g_ctx, best, BOOT_MS);
+    fflush(stdout);
+  }
+}
+
+// What the sampler pays per tick to feed the exporter, and what one scrape
+// costs the exporter thread. No socket: publish only needs fd >= 0.
+static void bench_metrics(Collector *c, Sample *s) {
+  static Exporter x;
+  x.fd = 0;
+  x.top = METRICS_TOP_DEFAULT;
+  x.cap = 64 * 1024;
+  x.buf = malloc((size_t)x.cap);
+  pthread_mutex_init(&x.mu, NULL);
+
+  BENCH("metrics.publish", metrics_publish(&x, c, s));
+  x.snap = x.pub;
+  int len = 0;
+  BENCH("metrics.render", len = metrics_body(&x, 1));
+  printf("{\"bench\":\"metrics.render.bytes\",%s\"bytes_per_scrape\":%d}\n", g_ctx, len);
+  free(x.buf);
+}
+
+// One collector tick published to shared memory, and one viewer picking it
+// up: what each extra viewer costs instead of its own collector_tick().
+static void bench_shm(Collector *c, Sample *s) {
+  char name[64];
+  snprintf(name, sizeof(name), "/sparta-bench-%d", (int)getpid());
+  static ShmPub pub;
+  static ShmView view;
+  if (!shm_create(&pub, name)) return;
+  shm_publish(&pub, c, s, 500);
+  if (!shm_attach(&view, name)) { shm_destroy(&pub); return; }
+
+  static HistSet h;
+  Sample vs;
+  BENCH("shm.publish", shm_publish(&pub, c, s, 500));
+  BENCH("shm.read", {
+    shm_publish(&pub, c, s, 500);
+    g_sink += (unsigned long long)shm_read(&view, &vs, &h);
+  });
+  shm_detach(&view);
+  shm_destroy(&pub);
+}
+
+// Agent frames after the initial sync: a few rates and task rows move each
+// tick, as on an idle-to-busy box. Reports the steady wire size per tick.
+static void wire_tick(Sample *s, HistSet *h, ProcTable *pt, long long it) {
+  s->cpu_pct = 20.0 + noise(10.0);
+  s->mem_pct = 41.0 + noise(0.2);
+  s->disk_w_mbs = noise(2.0);
+  s->net_rx_mbs = noise(0.5);
+  s->up += 0.5;
+  for (int k=0; k<5; k++) {
+    ProcTrack *p = &pt->a[(it * 7 + k * 13) % MIN(pt->n, WIRE_TASKS)];
+    p->cpu_cur = noise(30.0);
+    p->cpu_avg = (1.0 - EWMA_ALPHA) * p->cpu_avg + EWMA_ALPHA * p->cpu_cur;
+  }
+  qsort(pt->a, (size_t)MIN(pt->n, WIRE_TASKS), sizeof(ProcTrack), cmp_proc_avg);
+  histset_push(h, s);
+}
+
+static void bench_wire(Collector *c, Sample *base) {
+  static HistSet h;
+  static WireState enc, dec;
+  Sample s = *base;
+  ProcTable pt = { .a = malloc(sizeof(ProcTrack) * (size_t)MAX(1, c->pt.n)), .n = c->pt.n, .cap = c->pt.n };
+  memcpy(pt.a, c->pt.a, sizeof(ProcTrack) * (size_t)c->pt.n);
+  for (int i=0; i<HIST_MAX; i++) wire_tick(&s, &h, &pt, i);
+
+  WireBuf b = {0};
+  wire_frame(&b, &enc, &s, &h, &pt);
+  printf("{\"bench\":\"wire.sync.bytes\",%s\"bytes\":%d}\n", g_ctx, b.len);
+
+  long long frames = 0, bytes = 0;
+  BENCH("wire.encode", {
+    wire_tick(&s, &h, &pt, it);
+    b.len = 0;
+    wire_frame(&b, &enc, &s, &h, &pt);
+    bytes += b.len;
+    frames++;
+  });
+  printf("{\"bench\":\"wire.frame.bytes\",%s\"bytes_per_frame\":%.1f}\n",
+         g_ctx, (double)bytes / (double)MAX(1, frames));
+
+  // Decode a recorded run of 256 steady frames, cycling.
+  int at[257];
+  b.len = 0;
+  for (int i=0; i<256; i++) {
+    at[i] = b.len;
+    wire_tick(&s, &h, &pt, i);
+    wire_frame(&b, &enc, &s, &h, &pt);
+  }
+  at[256] = b.len;
+  static HistSet hv;
+  BENCH("wire.decode", {
+    int i = (int)(it & 255);
+    WireRd r;
+    r.p = b.p + at[i];
+    r.end = b.p + at[i+1];
+    r.bad = 0;
+    rd_varint(&r);
+    r.p++;
+    g_sink += (unsigned long long)wire_apply_frame(&dec, &r, &hv);
+  });
+  free(b.p);
+  free(pt.a);
+}
+
+// Trigger checks every tick, and a recording tick (whole task table) to
+// /dev/null.
+static void bench_watch(Collector *c, Sample *s) {
+  static Watch w;
+  static HistSet h;
+  setenv("TRIGGERS", "cpu:z4,disk_w:z4,net_rx:z4,temp>85", 1);
+  watch_init(&w);
+  unsetenv("TRIGGERS");
+  for (int i=0; i<WATCH_PRE; i++) histset_push(&h, s);
+  BENCH("watch.idle", g_sink += (unsigned long long)watch_tick(&w, s, &h, &c->pt));
+
+  w.f = fopen("/dev/null", "w");
+  w.cap = 65536;
+  w.buf = malloc((size_t)w.cap);
+  w.until = 1e18;
+  BENCH("watch.record", g_sink += (unsigned long long)watch_tick(&w, s, &h, &c->pt));
+  watch_free(&w);
+}
+
+// TASKS filter. A new filter first reads every task's command line, owner
+// and cgroup; after that a pass (an edit, or a scan with no new tasks) only
+// hits the per-PID cache. sort.filter is collect_sort with about one task
+// in 17 matching, on the same perturbed copies as "sort".
+static void bench_filter(Collector *c, ProcTrack **tmpl, ProcTrack *save) {
+  static Filter f;
+  static const char *const pats[] = { "postgres|docker", "postgres|dockerd" };
+  int n = c->pt.n;
+  BENCH("filter.cold", {
+    filter_free(&f);
+    f.local = 1;
+    f.len = snprintf(f.text, sizeof(f.text), "%s", pats[0]);
+    filter_set(&f);
+    filter_begin(&f);
+    for (int i=0; i<n; i++) g_sink += (unsigned)filter_match(&f, &c->pt.a[i]);
+  });
+  BENCH("filter.cached", {
+    filter_begin(&f);
+    for (int i=0; i<n; i++) g_sink += (unsigned)filter_match(&f, &c->pt.a[i]);
+  });
+  BENCH("filter.edit", {
+    f.len = snprintf(f.text, sizeof(f.text), "%s", pats[it & 1]);
+    filter_set(&f);
+    filter_begin(&f);
+    for (int i=0; i<n; i++) g_sink += (unsigned)filter_match(&f, &c->pt.a[i]);
+  });
+
+  f.len = snprintf(f.text, sizeof(f.text), "^postgres");
+  filter_set(&f);
+  memcpy(save, c->pt.a, sizeof(ProcTrack) * (size_t)n);
+  c->filter = &f;
+  BENCH("sort.filter", {
+    memcpy(c->pt.a, tmpl[it & 3], sizeof(ProcTrack) * (size_t)n);
+    collect_sort(c);
+  });
+  c->filter = NULL;
+  memcpy(c->pt.a, save, sizeof(ProcTrack) * (size_t)n);
+  c->pt.stale = 1;
+  filter_free(&f);
+}
+
+// Thread drill-down on the fixture's PID 1, which mkproc gives as many
+// threads as the fixture has tasks.
+static void bench_threads(void) {
+  static Threads thr;
+  threads_toggle(&thr, 1);
+  threads_scan(&thr, 0.5);
+  Expanded *e = threads_find(&thr, 1);
+  if (!e || e->th.n == 0) { threads_free(&thr); return; }
+  char ctx[sizeof(g_ctx)];
+  memcpy(ctx, g_ctx, sizeof(ctx));
+  snprintf(g_ctx, sizeof(g_ctx), "\"threads\":%d,", e->th.n);
+  BENCH("collect.threads", threads_scan(&thr, 0.5));
+  memcpy(g_ctx, ctx, sizeof(ctx));
+  threads_free(&thr);
+}
+
+// One --fast read of the fixture's /proc/stat. The sampler thread runs at
+// its slowest period alongside; at --fast 5 the cost per second is 200x this.
+static void bench_fast(void) {
+  static Fast F;
+  if (!fast_start(&F, FAST_MAX_MS)) return;
+  BENCH("fast.sample", fast_sample(&F));
+  fast_stop(&F);
+}
+
+static void bench_ticks(const char *root) {
+  char env[600];
+  snprintf(env, sizeof(env), "%s/proc", root);
+  setenv("PROC_ROOT", env, 1);
+  snprintf(env, sizeof(env), "%s/sys", root);
+  setenv("SYS_ROOT", env, 1);
+  paths_init();
+
+  static Collector c;
+  int nics, disks;
+  collector_init(&c);
+  pick_last_devices(&c, &nics, &disks);
+
+  Sample s = {0};
+  collector_tick(&c, &s, 0.5);
+  snprintf(g_ctx, sizeof(g_ctx), "\"tasks\":%d,\"nics\":%d,\"disks\":%d,",
+           c.pt.n, nics, disks);
+
+  BENCH("collect.cpu",    collect_cpu(&c, &s));
+  BENCH("collect.load",   collect_load(&s));
+  BENCH("collect.mem",    collect_mem(&c, &s, 0.5));
+  BENCH("collect.uptime", collect_uptime(&s));
+  BENCH("collect.temp",   collect_temp(&c, &s));
+  BENCH("collect.perf",   collect_perf(&c, &s, 0.5));  // live counters, one group read per CPU
+  BENCH("collect.disk",   collect_disk(&c, &s, 0.5));
+  BENCH("collect.net",    collect_net(&c, &s, 0.5));
+  BENCH("collect.fs",     collect_fs(&c, &s));  // one statvfs round on the worker
+  BENCH("mounts.parse",   mounts_parse(&c.mnt)); // only when mountinfo changes
+  BENCH("collect.thr",    collect_thr(&s));
+  BENCH("collect.procs",  collect_procs(&c, 0.5));
+
+  // Sort a freshly perturbed copy each time; re-sorting sorted data would
+  // flatter qsort.
+  int n = c.pt.n;
+  ProcTrack *tmpl[4], *work = malloc(sizeof(ProcTrack) * (size_t)MAX(1, n));
+  for (int k=0; k<4; k++) {
+    tmpl[k] = malloc(sizeof(ProcTrack) * (size_t)MAX(1, n));
+    memcpy(tmpl[k], c.pt.a, sizeof(ProcTrack) * (size_t)n);
+    for (int i=0; i<n; i++) {
+      tmpl[k][i].cpu_avg = (i % 7 == 0) ? noise(100.0) : 0.0;
+      tmpl[k][i].cpu_cur = noise(5.0);
+    }
+  }
+  BENCH("sort", {
+    memcpy(work, tmpl[it & 3], sizeof(ProcTrack) * (size_t)n);
+    qsort(work, (size_t)n, sizeof(ProcTrack), cmp_proc_avg);
+  });
+  bench_filter(&c, tmpl, work);
+  for (int k=0; k<4; k++) free(tmpl[k]);
+  free(work);
+
+  BENCH("tick.collect", collector_tick(&c, &s, 0.5));
+  bench_fast();
+  bench_threads();
+  bench_metrics(&c, &s);
+  bench_shm(&c, &s);
+  bench_wire(&c, &s);
+  bench_watch(&c, &s);
+
+  bench_render(&c, &s);
+  collector_free(&c);
+  bench_boot();
+  g_ctx[0] = '\0';
+}
+
+// Socket view over `n` loopback TCP connections held by this process.
+// socks.cold starts from an empty inode -> PID index every op; socks.scan
+// is the steady state; socks.churn replaces one connection per op, so each
+// scan meets a new inode and re-reads just this PID's fds.
+static int sock_pair(int lfd, const struct sockaddr_in *sa, int *a, int *b) {
+  *a = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (*a < 0 || connect(*a, (const struct sockaddr*)sa, sizeof(*sa)) != 0) return 0;
+  *b = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+  return *b >= 0;
+}
+
+static void bench_socks(int n) {
+  struct rlimit rl;
+  getrlimit(RLIMIT_NOFILE, &rl);
+  if (rl.rlim_cur < (rlim_t)(2 * n + 64)) {
+    rl.rlim_cur = MIN(rl.rlim_max, (rlim_t)(2 * n + 64));
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  int lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in sa = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  socklen_t sl = sizeof(sa);
+  if (lfd < 0 || bind(lfd, (struct sockaddr*)&sa, sizeof(sa)) != 0 || listen(lfd, 128) != 0 ||
+      getsockname(lfd, (struct sockaddr*)&sa, &sl) != 0) {
+    fprintf(stderr, "bench: loopback listener: %s\n", strerror(errno));
+    exit(1);
+  }
+  int *fd = malloc(sizeof(int) * 2 * (size_t)n);
+  for (int i=0; i<n; i++) {
+    if (!sock_pair(lfd, &sa, &fd[2*i], &fd[2*i+1])) {
+      fprintf(stderr, "bench: %d loopback connections: %s\n", n, strerror(errno));
+      exit(1);
+    }
+    if (i % 8 == 0 && write(fd[2*i], "x", 1) < 0) {}
+  }
+  snprintf(g_ctx, sizeof(g_ctx), "\"socks\":%d,", 2 * n);
+
+  static Socks S;
+  socks_init(&S);
+  S.on = 1;
+  BENCH("socks.cold", { socks_free(&S); socks_scan(&S, NULL); });
+  BENCH("socks.scan", socks_scan(&S, NULL));
+  BENCH("socks.churn", {
+    int k = (int)(it % (long long)n);
+    close(fd[2*k]); close(fd[2*k+1]);
+    if (!sock_pair(lfd, &sa, &fd[2*k], &fd[2*k+1])) exit(1);
+    socks_scan(&S, NULL);
+  });
+  if (S.unowned) fprintf(stderr, "bench: %d sockets without an owner\n", S.unowned);
+  socks_free(&S);
+  for (int i=0; i<2*n; i++) close(fd[i]);
+  close(lfd);
+  free(fd);
+  g_ctx[0] = '\0';
+}
+
+// Loopback fleet: a forked simulator plays `n` agents on one listening
+// socket (every accepted connection is a peer with its own WireState and
+// host name) ticking every FLEET_SIM_MS, and this process runs the fleet
+// loop against them, sorting and formatting the grid four times a second
+// like the UI does. Reported CPU is this process only.
+#define FLEET_SIM_MS 100
+#define FLEET_SECONDS 2.0
+
+typedef struct {
+  int fd;
+  WireBuf out;
+  WireState st;
+} SimPeer;
+
+static void fleet_sim(int lfd, int n) {
+  static HistSet h;
+  static ProcTrack rows[WIRE_TASKS];
+  ProcTable pt = { .a = rows, .n = WIRE_TASKS, .cap = WIRE_TASKS };
+  SimPeer *peers = calloc((size_t)n, sizeof(SimPeer));
+  int np = 0;
+  Sample s;
+  sample_fixture(&s, 0);
+  tasks_fixture(rows, WIRE_TASKS, 0);
+  for (int i=0; i<HIST_MAX / 8; i++) wire_tick(&s, &h, &pt, i);
+
+  for (long long it=0;; it++) {
+    int fd;
+    while (np < n && (fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+      SimPeer *p = &peers[np];
+      p->fd = fd;
+      char host[32];
+      snprintf(host, sizeof(host), "sim%03d", np++);
+      wire_hello(&p->out, host, FLEET_SIM_MS);
+      if (np < n) continue;
+    }
+    wire_tick(&s, &h, &pt, it);
+    for (int i=0; i<np; i++) {
+      SimPeer *p = &peers[i];
+      Sample ps = s;
+      ps.cpu_pct = s.cpu_pct + (double)(i % 10) * 7.3;
+      ps.busy_disk_mbs = noise(40.0);
+      ps.busy_nic_mbs = noise(12.0);
+      snprintf(ps.busy_disk, sizeof(ps.busy_disk), "sd%c", 'a' + i % 4);
+      snprintf(ps.busy_nic, sizeof(ps.busy_nic), "eth%d", i % 2);
+      wire_frame(&p->out, &p->st, &ps, &h, &pt);
+      if (!send_all(p->fd, (const char *)p->out.p, p->out.len)) _exit(0);
+      p->out.len = 0;
+    }
+    usleep(FLEET_SIM_MS * 1000);
+  }
+}
+
+static void bench_fleet(int n) {
+  int lfd = tcp_listen("127.0.0.1:0");
+  struct sockaddr_in sa;
+  socklen_t sl = sizeof(sa);
+  if (lfd < 0 || listen(lfd, n) != 0 || getsockname(lfd, (struct sockaddr *)&sa, &sl) != 0) {
+    perror("bench: fleet listen");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid == 0) fleet_sim(lfd, n);
+  close(lfd);
+
+  int port = ntohs(sa.sin_port);
+  size_t cap = (size_t)n * 24 + 1;
+  char *list = malloc(cap);
+  size_t len = 0;
+  for (int i=0; i<n; i++) len += (size_t)snprintf(list + len, cap - len, "127.0.0.1:%d,", port);
+  static Fleet f;
+  if (!fleet_init(&f, list)) exit(1);
+  free(list);
+
+  // Wait for every host's first frame, then measure a steady stretch.
+  double t0 = now_s();
+  for (int up = 0; up < n && now_s() - t0 < 10.0;) {
+    fleet_poll(&f, 20);
+    up = 0;
+    for (int i=0; i<n; i++) up += f.hosts[i].seen;
+  }
+
+  struct rusage r0, r1;
+  getrusage(RUSAGE_SELF, &r0);
+  double w0 = now_s(), t_draw = 0;
+  long long frames = 0, draws = 0;
+  char line[512];
+  while (now_s() - w0 < FLEET_SECONDS) {
+    frames += fleet_poll(&f, 20);
+    if (now_s() - t_draw >= 0.25) {
+      t_draw = now_s();
+      fleet_sort(&f);
+      for (int i=0; i<n; i++) {
+        TextBuf b;
+        tb_init(&b, line, sizeof(line));
+        fleet_row(&f.hosts[f.order[i]], &b);
+        g_sink += (unsigned long long)b.len;
+      }
+      draws++;
+    }
+  }
+  double wall = now_s() - w0;
+  getrusage(RUSAGE_SELF, &r1);
+  double cpu = (double)(r1.ru_utime.tv_sec - r0.ru_utime.tv_sec + r1.ru_stime.tv_sec - r0.ru_stime.tv_sec)
+             + (double)(r1.ru_utime.tv_usec - r0.ru_utime.tv_usec + r1.ru_stime.tv_usec - r0.ru_stime.tv_usec) / 1e6;
+
+  int up = 0;
+  long long mem = 0;
+  for (int i=0; i<n; i++) {
+    up += f.hosts[i].c.up;
+    mem += (long long)sizeof(FleetHost) + f.hosts[i].c.in_cap;
+  }
+  printf("{\"bench\":\"fleet\",\"hosts\":%d,\"up\":%d,\"tick_ms\":%d,\"frames_per_s\":%.0f,"
+         "\"cpu_pct\":%.2f,\"ns_per_frame\":%.0f,\"draws\":%lld,\"bytes_per_host\":%lld}\n",
+         n, up, FLEET_SIM_MS, (double)frames / wall, 100.0 * cpu / wall,
+         1e9 * cpu / (double)MAX(1, frames), draws, mem / n);
+  fflush(stdout);
+
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+  fleet_free(&f);
+}
+
+int main(int argc, char **argv) {
+  int ran = 0;
+  for (int i=1; i<argc; i++) {
+    if (strcmp(argv[i], "--fmt") == 0) {
+      bench_header();
+      bench_tasks();
+      bench_scale();
+      ran = 1;
+    } else if (strcmp(argv[i], "--root") == 0 && i+1 < argc) {
+      bench_ticks(argv[++i]);
+      ran = 1;
+    } else if (strcmp(argv[i], "--socks") == 0 && i+1 < argc) {
+      int n = atoi(argv[++i]);
+      bench_socks(MAX(1, n));
+      ran = 1;
+    } else if (strcmp(argv[i], "--fleet") == 0 && i+1 < argc) {
+      int n = atoi(argv[++i]);
+      bench_fleet(MAX(1, n));
+      ran = 1;
+    } else {
+      fprintf(stderr, "usage: %s [--fmt] [--root FIXTURE_DIR] [--socks CONNS] [--fleet HOSTS]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!ran) {
+    bench_header();
+    bench_tasks();
+    bench_scale();
+  }
+  return 0;
+}
@@ -0,0 +1,333 @@
+// Synthetic /proc + /sys fixture generator for `make bench`.
+//
+//   mkproc DIR [--pids N] [--nics N] [--disks N] [--cpus N] [--threads N]
+//              [--mounts N]
+//
+// Writes DIR/proc and DIR/sys laid out like the live trees, with just the
+// files sparta-mon reads, so the collectors can be run against any number
+// of PIDs, NICs and disks via PROC_ROOT=DIR/proc SYS_ROOT=DIR/sys. PID 1
+// gets --threads threads under /proc/1/task for the TASKS drill-down.
+// proc/self/mountinfo lists --mounts filesystems at DIR/mnt/N, which exist,
+// so statvfs on them answers, among pseudo filesystems and bind mounts.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static char g_dir[512];
+
+static void die(const char *what, const char *path) {
+  fprintf(stderr, "mkproc: %s %s: %s\n", what, path, strerror(errno));
+  exit(1);
+}
+
+static void mkdirs(const char *path) {
+  char tmp[1024];
+  snprintf(tmp, sizeof(tmp), "%s", path);
+  for (char *p = tmp + 1; *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    if (mkdir(tmp, 0755) != 0 && errno != EEXIST) die("mkdir", tmp);
+    *p = '/';
+  }
+  if (mkdir(tmp, 0755) != 0 && errno != EEXIST) die("mkdir", tmp);
+}
+
+static FILE *create(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static FILE *create(const char *fmt, ...) {
+  char rel[512], path[1024];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(rel, sizeof(rel), fmt, ap);
+  va_end(ap);
+  snprintf(path, sizeof(path), "%s/%s", g_dir, rel);
+
+  char *slash = strrchr(path, '/');
+  *slash = '\0';
+  mkdirs(path);
+  *slash = '/';
+
+  FILE *f = fopen(path, "w");
+  if (!f) die("create", path);
+  return f;
+}
+
+// Small deterministic PRNG so fixtures are identical across runs.
+static unsigned long long g_rng = 0x9e3779b97f4a7c15ULL;
+static unsigned long long rnd(unsigned long long n) {
+  g_rng ^= g_rng << 13; g_rng ^= g_rng >> 7; g_rng ^= g_rng << 17;
+  return n ? g_rng % n : g_rng;
+}
+
+static const char *const COMMS[] = {
+  "systemd", "kworker/0:1-events", "sshd", "bash", "python3", "java",
+  "nginx: worker process", "postgres", "containerd-shim", "node", "Xorg",
+  "pipewire", "rsyslogd", "cron", "(sd-pam)", "ksoftirqd/0", "dockerd",
+};
+
+static void gen_stat(int cpus) {
+  FILE *f = create("proc/stat");
+  unsigned long long t[8] = {0};
+  for (int c=0; c<cpus; c++) {
+    unsigned long long v[8];
+    for (int i=0; i<8; i++) v[i] = rnd(5000000) + (i == 3 ? 50000000 : 0);
+    for (int i=0; i<8; i++) t[i] += v[i];
+  }
+  fprintf(f, "cpu  %llu %llu %llu %llu %llu %llu %llu %llu 0 0\n",
+          t[0], t[1], t[2], t[3], t[4], t[5], t[6], t[7]);
+  for (int c=0; c<cpus; c++) {
+    fprintf(f, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu 0 0\n", c,
+            t[0]/cpus, t[1]/cpus, t[2]/cpus, t[3]/cpus,
+            t[4]/cpus, t[5]/cpus, t[6]/cpus, t[7]/cpus);
+  }
+  fprintf(f, "intr 123456789 0 0 0\nctxt 987654321\nbtime 1700000000\n"
+             "processes 4242424\nprocs_running 3\nprocs_blocked 0\n"
+             "softirq 1234567 0 0 0 0 0 0 0 0 0 0\n");
+  fclose(f);
+}
+
+static void gen_misc(int pids) {
+  FILE *f = create("proc/loadavg");
+  fprintf(f, "0.52 0.61 0.70 3/%d 424242\n", pids);
+  fclose(f);
+
+  f = create("proc/uptime");
+  fprintf(f, "123456.78 234567.89\n");
+  fclose(f);
+
+  f = create("proc/meminfo");
+  fprintf(f,
+    "MemTotal:        8049356 kB\nMemFree:          912344 kB\n"
+    "MemAvailable:    5123456 kB\nBuffers:          234560 kB\n"
+    "Cached:          3456780 kB\nSwapCached:         1024 kB\n"
+    "Active:          3012340 kB\nInactive:        2345670 kB\n"
+    "Active(anon):    1534560 kB\nInactive(anon):   123450 kB\n"
+    "Active(file):    1477780 kB\nInactive(file):  2222220 kB\n"
+    "Unevictable:          32 kB\nMlocked:              32 kB\n"
+    "SwapTotal:       2097148 kB\nSwapFree:        2000000 kB\n"
+    "Dirty:               256 kB\nWriteback:             0 kB\n"
+    "AnonPages:       1623450 kB\nMapped:           456780 kB\n"
+    "Shmem:            45678 kB\nKReclaimable:     234567 kB\n"
+    "Slab:             345678 kB\nSReclaimable:     234567 kB\n"
+    "SUnreclaim:       111111 kB\nKernelStack:       12345 kB\n"
+    "PageTables:        34567 kB\nCommitLimit:     6121824 kB\n"
+    "Committed_AS:    4567890 kB\nVmallocTotal:   34359738367 kB\n"
+    "VmallocUsed:       45678 kB\nHugePages_Total:       0\n"
+    "HugePages_Free:        0\nHugepagesize:       2048 kB\n");
+  fclose(f);
+
+  f = create("proc/vmstat");
+  fprintf(f,
+    "nr_free_pages 228086\nnr_inactive_anon 30862\nnr_active_anon 383640\n"
+    "nr_dirty 64\nnr_writeback 0\npgpgin 123456789\npgpgout 234567890\n"
+    "pswpin 1234\npswpout 5678\npgalloc_normal 987654321\npgfault 876543210\n"
+    "pgmajfault 45678\npgrefill 123456\npgsteal_kswapd 234567\n"
+    "pgsteal_direct 3456\npgsteal_khugepaged 12\npgscan_kswapd 345678\n"
+    "pgscan_direct 4567\npgscan_khugepaged 23\npgscan_direct_throttle 0\n"
+    "oom_kill 2\nthp_fault_alloc 1234\n");
+  fclose(f);
+
+}
+
+// A two-socket server's sensors: three thermal zones (two of one type) and
+// thermal_hwmon's re-export of them, two nvme drives that both label their
+// sensor Composite, and a coretemp device per package whose core labels
+// repeat across packages. cpufreq for every CPU.
+static void gen_sensors(int cpus) {
+  static const char *const zones[] = { "cpu-thermal", "acpitz", "acpitz" };
+  for (int i=0; i<3; i++) {
+    FILE *f = create("sys/class/thermal/thermal_zone%d/type", i);
+    fprintf(f, "%s\n", zones[i]);
+    fclose(f);
+    f = create("sys/class/thermal/thermal_zone%d/temp", i);
+    fprintf(f, "%d\n", 48312 - i * 10000);
+    fclose(f);
+  }
+
+  int hw = 0;
+  static const char *const alias[] = { "cpu_thermal", "acpitz" };
+  for (int a=0; a<2; a++, hw++) {
+    FILE *f = create("sys/class/hwmon/hwmon%d/name", hw);
+    fprintf(f, "%s\n", alias[a]);
+    fclose(f);
+    f = create("sys/class/hwmon/hwmon%d/temp1_input", hw);
+    fprintf(f, "%d\n", 48312 - a * 10000);
+    fclose(f);
+  }
+  for (int d=0; d<2; d++, hw++) {
+    FILE *f = create("sys/class/hwmon/hwmon%d/name", hw);
+    fprintf(f, "nvme\n");
+    fclose(f);
+    f = create("sys/class/hwmon/hwmon%d/temp1_label", hw);
+    fprintf(f, "Composite\n");
+    fclose(f);
+    f = create("sys/class/hwmon/hwmon%d/temp1_input", hw);
+    fprintf(f, "%d\n", 41850 + d * 3000);
+    fclose(f);
+  }
+  int cores = cpus / 2 < 1 ? 1 : cpus / 2 > 32 ? 32 : cpus / 2;
+  for (int pkg=0; pkg<2; pkg++, hw++) {
+    FILE *f = create("sys/class/hwmon/hwmon%d/name", hw);
+    fprintf(f, "coretemp\n");
+    fclose(f);
+    for (int k=1; k<=cores + 1; k++) {
+      f = create("sys/class/hwmon/hwmon%d/temp%d_label", hw, k);
+      if (k == 1) fprintf(f, "Package id %d\n", pkg);
+      else fprintf(f, "Core %d\n", k - 2);
+      fclose(f);
+      f = create("sys/class/hwmon/hwmon%d/temp%d_input", hw, k);
+      fprintf(f, "%llu\n", 45000 + rnd(20000));
+      fclose(f);
+    }
+  }
+
+  for (int c=0; c<cpus; c++) {
+    FILE *f = create("sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", c);
+    fprintf(f, "%llu\n", 600000 + rnd(1800000));
+    fclose(f);
+    f = create("sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", c);
+    fprintf(f, "2400000\n");
+    fclose(f);
+  }
+}
+
+static void gen_net(int nics) {
+  FILE *f = create("proc/net/dev");
+  fprintf(f,
+    "Inter-|   Receive                                                |  Transmit\n"
+    " face |bytes    packets errs drop fifo frame compressed multicast|"
+    "bytes    packets errs drop fifo colls carrier compressed\n");
+  fprintf(f, "    lo: 123456789 123456 0 0 0 0 0 0 123456789 123456 0 0 0 0 0 0\n");
+  for (int i=0; i<nics; i++) {
+    fprintf(f, "%6s%d: %llu %llu %llu %llu 0 0 0 %llu %llu %llu %llu %llu 0 0 0 0\n",
+            i < 4 ? "eth" : "veth", i,
+            rnd(1ULL << 40), rnd(1ULL << 30), rnd(100), rnd(1000), rnd(10000),
+            rnd(1ULL << 40), rnd(1ULL << 30), rnd(100), rnd(1000));
+  }
+  fclose(f);
+}
+
+static void gen_disks(int disks) {
+  FILE *f = create("proc/diskstats");
+  for (int i=0; i<8; i++) {
+    fprintf(f, "   7       %d loop%d 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n", i, i);
+  }
+  for (int i=0; i<disks; i++) {
+    char name[24];
+    const char *psep = "";
+    if (i < 26) snprintf(name, sizeof(name), "sd%c", 'a' + i);
+    else { snprintf(name, sizeof(name), "nvme%dn1", i - 26); psep = "p"; }
+    for (int part=0; part<=2; part++) {
+      char full[40];
+      if (part == 0) snprintf(full, sizeof(full), "%s", name);
+      else snprintf(full, sizeof(full), "%s%s%d", name, psep, part);
+      fprintf(f, "   8     %3d %s %llu %llu %llu %llu %llu %llu %llu %llu 0 %llu %llu 0 0 0 0 0 0\n",
+              i * 16 + part, full,
+              rnd(1000000), rnd(10000), rnd(100000000), rnd(1000000),
+              rnd(1000000), rnd(10000), rnd(100000000), rnd(1000000),
+              rnd(1000000), rnd(1000000));
+    }
+  }
+  fclose(f);
+}
+
+static void gen_pids(int pids) {
+  for (int i=0; i<pids; i++) {
+    int pid = 1 + i * 3;
+    const char *comm = COMMS[rnd(sizeof(COMMS) / sizeof(COMMS[0]))];
+    char state = "SSSSSRDI"[rnd(8)];
+    unsigned long long ut = rnd(1000000), st = rnd(100000);
+    unsigned long long vsz = 4096ULL * (1000 + rnd(500000));
+    unsigned long long rss = 1 + rnd(100000);
+
+    FILE *f = create("proc/%d/stat", pid);
+    fprintf(f,
+      "%d (%s) %c 1 %d %d 0 -1 4194560 %llu 0 %llu 0 %llu %llu 0 0 20 0 %llu 0 "
+      "%llu %llu %llu 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 %d 0 0 0 0 0 "
+      "0 0 0 0 0 0 0 0\n",
+      pid, comm, state, pid, pid, rnd(100000), rnd(1000), ut, st,
+      1 + rnd(64), rnd(10000000), vsz, rss, i % 4);
+    fclose(f);
+
+    f = create("proc/%d/statm", pid);
+    fprintf(f, "%llu %llu %llu 100 0 %llu 0\n", vsz / 4096, rss, rss / 4, rss / 2);
+    fclose(f);
+
+    // What the TASKS filter reads besides stat; kernel threads have no argv.
+    f = create("proc/%d/cmdline", pid);
+    if (state != 'I') fprintf(f, "/usr/bin/%s%c--config%c/etc/%d.conf%c", comm, 0, 0, pid, 0);
+    fclose(f);
+
+    f = create("proc/%d/cgroup", pid);
+    fprintf(f, "0::/system.slice/%s.service\n", comm);
+    fclose(f);
+  }
+}
+
+static void gen_threads(int threads) {
+  for (int i=0; i<threads; i++) {
+    int tid = i == 0 ? 1 : 1000000 + i;
+    FILE *f = create("proc/1/task/%d/stat", tid);
+    fprintf(f,
+      "%d (%s) %c 1 1 1 0 -1 4194560 0 0 0 0 %llu %llu 0 0 20 0 %d 0 "
+      "100 0 0 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 %d 0 0 0 0 0 "
+      "0 0 0 0 0 0 0 0\n",
+      tid, i == 0 ? "java" : "worker", "SSSSR"[rnd(5)], rnd(100000), rnd(10000),
+      threads, i % 4);
+    fclose(f);
+  }
+}
+
+static void gen_mounts(int n) {
+  char root[PATH_MAX];
+  if (!realpath(g_dir, root)) die("realpath", g_dir);
+  FILE *f = create("proc/self/mountinfo");
+  fprintf(f, "1 0 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw\n");
+  int id = 2;
+  for (int k=0; k<n; k++) {
+    char rel[64];
+    snprintf(rel, sizeof(rel), "mnt/%d", k);
+    char path[PATH_MAX + 64];
+    snprintf(path, sizeof(path), "%s/%s", g_dir, rel);
+    mkdirs(path);
+    fprintf(f, "%d 1 0:%d / %s/%s rw,relatime shared:%d - %s /dev/vd%d rw\n",
+            id, 100 + k, root, rel, id, k % 2 ? "xfs" : "ext4", k);
+    id++;
+    if (k % 4 == 0) fprintf(f, "%d 1 0:%d / %s/%s/bind rw - ext4 /dev/vd%d rw\n", id++, 100 + k, root, rel, k);
+    if (k % 4 == 1) fprintf(f, "%d 1 0:%d / /sys/fs/cgroup/%d rw - cgroup2 cgroup2 rw\n", id++, 5000 + k, k);
+  }
+  fclose(f);
+}
+
+int main(int argc, char **argv) {
+  int pids = 1000, nics = 16, disks = 16, cpus = 4, threads = 0, mounts = 0;
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s DIR [--pids N] [--nics N] [--disks N] [--cpus N] [--threads N] [--mounts N]\n", argv[0]);
+    return 2;
+  }
+  snprintf(g_dir, sizeof(g_dir), "%s", argv[1]);
+  for (int i=2; i+1<argc; i+=2) {
+    int v = atoi(argv[i+1]);
+    if (strcmp(argv[i], "--pids") == 0) pids = v;
+    else if (strcmp(argv[i], "--nics") == 0) nics = v;
+    else if (strcmp(argv[i], "--disks") == 0) disks = v;
+    else if (strcmp(argv[i], "--cpus") == 0) cpus = (v > 0) ? v : 1;
+    else if (strcmp(argv[i], "--threads") == 0) threads = v;
+    else if (strcmp(argv[i], "--mounts") == 0) mounts = v;
+    else { fprintf(stderr, "mkproc: unknown option %s\n", argv[i]); return 2; }
+  }
+
+  gen_stat(cpus);
+  gen_misc(pids);
+  gen_sensors(cpus);
+  gen_net(nics);
+  gen_disks(disks);
+  gen_pids(pids);
+  gen_threads(threads);
+  gen_mounts(mounts);
+  return 0;
+}
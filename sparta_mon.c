@@ -4,12 +4,42 @@
 #include <dirent.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdio.h>
 #include <signal.h>
 #include <sys/statvfs.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <regex.h>
+#include <pwd.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #ifndef MIN
 #define MIN(a,b) ((a)<(b)?(a):(b))
@@ -24,14 +54,19 @@
 #define MIN_DELAY_MS 100
 #define MAX_DELAY_MS 2000
 
+// float is plenty for percentages and MB/s, and halves what every ring,
+// shm frame and fleet host carries. Rings start on a cache line so window
+// scans stream whole lines.
 typedef struct {
-  double v[HIST_MAX];
+  float v[HIST_MAX] __attribute__((aligned(64)));
   int head;
   int len;
+  unsigned long long seq; // total samples ever pushed
 } Hist;
 
 static void hist_push(Hist *h, double x) {
-  h->v[h->head] = x;
+  h->v[h->head] = (float)x;
+  h->seq++;
   h->head = (h->head + 1) % HIST_MAX;
   if (h->len < HIST_MAX) h->len++;
 }
@@ -48,6 +83,61 @@ static double hist_get_lastN(const Hist *h, int count, int i) {
   return h->v[idx];
 }
 
+// Min and max of n >= 1 contiguous values, eight lanes at a time (two
+// pairs of accumulators, so the min/max latency overlaps) where the target
+// has them.
+static void hist_run_range(const float *v, int n, float *lo, float *hi) {
+  int i = 0;
+  float mn = v[0], mx = v[0];
+#if defined(__SSE__) || defined(__ARM_NEON)
+  if (n >= 16) {
+    float t[4];
+#if defined(__SSE__)
+    __m128 a0 = _mm_loadu_ps(v), a1 = _mm_loadu_ps(v + 4), b0 = a0, b1 = a1;
+    for (i = 8; i + 8 <= n; i += 8) {
+      __m128 x0 = _mm_loadu_ps(v + i), x1 = _mm_loadu_ps(v + i + 4);
+      a0 = _mm_min_ps(a0, x0); a1 = _mm_min_ps(a1, x1);
+      b0 = _mm_max_ps(b0, x0); b1 = _mm_max_ps(b1, x1);
+    }
+    _mm_storeu_ps(t, _mm_min_ps(a0, a1));
+    mn = MIN(MIN(t[0], t[1]), MIN(t[2], t[3]));
+    _mm_storeu_ps(t, _mm_max_ps(b0, b1));
+#else
+    float32x4_t a0 = vld1q_f32(v), a1 = vld1q_f32(v + 4), b0 = a0, b1 = a1;
+    for (i = 8; i + 8 <= n; i += 8) {
+      float32x4_t x0 = vld1q_f32(v + i), x1 = vld1q_f32(v + i + 4);
+      a0 = vminq_f32(a0, x0); a1 = vminq_f32(a1, x1);
+      b0 = vmaxq_f32(b0, x0); b1 = vmaxq_f32(b1, x1);
+    }
+    vst1q_f32(t, vminq_f32(a0, a1));
+    mn = MIN(MIN(t[0], t[1]), MIN(t[2], t[3]));
+    vst1q_f32(t, vmaxq_f32(b0, b1));
+#endif
+    mx = MAX(MAX(t[0], t[1]), MAX(t[2], t[3]));
+  }
+#endif
+  for (; i < n; i++) { mn = MIN(mn, v[i]); mx = MAX(mx, v[i]); }
+  *lo = mn;
+  *hi = mx;
+}
+
+// Min and max of the newest `count` values: at most two runs of the ring.
+// Returns 0 while it is empty.
+static int hist_range(const Hist *h, int count, float *lo, float *hi) {
+  count = MIN(count, h->len);
+  if (count <= 0) return 0;
+  int start = (h->head - count + HIST_MAX) % HIST_MAX;
+  int first = MIN(count, HIST_MAX - start);
+  hist_run_range(h->v + start, first, lo, hi);
+  if (count > first) {
+    float l2, h2;
+    hist_run_range(h->v, count - first, &l2, &h2);
+    *lo = MIN(*lo, l2);
+    *hi = MAX(*hi, h2);
+  }
+  return 1;
+}
+
 static double now_s(void) {
   struct timespec ts;
   clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -57,8 +147,39 @@ static double now_s(void) {
 // ---------------------------
 // /proc readers
 // ---------------------------
+// PROC_ROOT and SYS_ROOT point every reader at another tree (e.g. a
+// synthetic fixture from bench/mkproc) instead of the live /proc and /sys.
+static char g_proc_root[256] = "/proc";
+static char g_sys_root[256] = "/sys";
+
+static void set_root(char *dst, size_t n, const char *env) {
+  const char *v = getenv(env);
+  if (!v || !*v) return;
+  snprintf(dst, n, "%s", v);
+  size_t len = strlen(dst);
+  while (len > 1 && dst[len-1] == '/') dst[--len] = '\0';
+}
+
+static void paths_init(void) {
+  set_root(g_proc_root, sizeof(g_proc_root), "PROC_ROOT");
+  set_root(g_sys_root, sizeof(g_sys_root), "SYS_ROOT");
+}
+
+static FILE *proc_fopen(const char *rel) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", g_proc_root, rel);
+  return fopen(path, "r");
+}
+
+static int sys_open(const char *rel) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", g_sys_root, rel);
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+
 static int read_cpu(unsigned long long *total, unsigned long long *idle) {
-  FILE *f = fopen("/proc/stat", "r");
+  FILE *f = proc_fopen("stat");
   if (!f) return 0;
 
   char line[512];
@@ -76,50 +197,368 @@ static int read_cpu(unsigned long long *total, unsigned long long *idle) {
 }
 
 static int read_load(double *l1, double *l5, double *l15) {
-  FILE *f = fopen("/proc/loadavg", "r");
+  FILE *f = proc_fopen("loadavg");
   if (!f) return 0;
   int ok = fscanf(f, "%lf %lf %lf", l1, l5, l15) == 3;
   fclose(f);
   return ok;
 }
 
-static int read_mem(unsigned long long *mem_total, unsigned long long *mem_avail) {
-  FILE *f = fopen("/proc/meminfo", "r");
-  if (!f) return 0;
-
-  char key[64];
-  unsigned long long val = 0;
-  char unit[32];
+// /proc/meminfo and /proc/vmstat are parsed together in one pass per file.
+// The keys we keep sit in a perfect hash on (length, first, middle and last
+// byte): the multipliers were searched offline so these 31 keys land in
+// distinct slots, and one compare rejects every other key. A new key needs
+// a new search.
+enum {
+  MK_MEMTOTAL, MK_MEMFREE, MK_MEMAVAILABLE, MK_BUFFERS, MK_CACHED,
+  MK_SWAPCACHED, MK_ANONPAGES, MK_SHMEM, MK_SLAB, MK_SRECLAIMABLE,
+  MK_SUNRECLAIM, MK_DIRTY, MK_WRITEBACK, MK_SWAPTOTAL, MK_SWAPFREE,
+  MK_HUGEPAGES_TOTAL, MK_HUGEPAGES_FREE, MK_HUGEPAGESIZE, MK_KERNELSTACK,
+  MK_PAGETABLES, MK_MAPPED, MK_PGMAJFAULT, MK_PSWPIN, MK_PSWPOUT,
+  MK_PGSCAN_KSWAPD, MK_PGSCAN_DIRECT, MK_PGSCAN_KHUGEPAGED,
+  MK_PGSTEAL_KSWAPD, MK_PGSTEAL_DIRECT, MK_PGSTEAL_KHUGEPAGED, MK_OOM_KILL, MK_N
+};
+
+#define MK_HASH(k, n) (((n) * 14 + (unsigned char)(k)[0] * 16 + \
+                        (unsigned char)(k)[(n) - 1] * 15 + (unsigned char)(k)[(n) / 2]) & 63)
+
+static const struct { const char *name; int len, id; } MK_SLOTS[64] = {
+  [ 0] = { "pgsteal_khugepaged", 18, MK_PGSTEAL_KHUGEPAGED },
+  [ 2] = { "SUnreclaim", 10, MK_SUNRECLAIM },
+  [ 3] = { "MemTotal", 8, MK_MEMTOTAL },
+  [ 6] = { "Shmem", 5, MK_SHMEM },
+  [ 7] = { "Slab", 4, MK_SLAB },
+  [ 8] = { "Cached", 6, MK_CACHED },
+  [11] = { "HugePages_Total", 15, MK_HUGEPAGES_TOTAL },
+  [12] = { "MemAvailable", 12, MK_MEMAVAILABLE },
+  [15] = { "Dirty", 5, MK_DIRTY },
+  [17] = { "SwapFree", 8, MK_SWAPFREE },
+  [20] = { "HugePages_Free", 14, MK_HUGEPAGES_FREE },
+  [22] = { "SwapTotal", 9, MK_SWAPTOTAL },
+  [24] = { "Writeback", 9, MK_WRITEBACK },
+  [27] = { "AnonPages", 9, MK_ANONPAGES },
+  [30] = { "pswpout", 7, MK_PSWPOUT },
+  [31] = { "oom_kill", 8, MK_OOM_KILL },
+  [33] = { "pgscan_direct", 13, MK_PGSCAN_DIRECT },
+  [35] = { "MemFree", 7, MK_MEMFREE },
+  [37] = { "Buffers", 7, MK_BUFFERS },
+  [42] = { "PageTables", 10, MK_PAGETABLES },
+  [44] = { "SReclaimable", 12, MK_SRECLAIMABLE },
+  [47] = { "pgsteal_direct", 14, MK_PGSTEAL_DIRECT },
+  [48] = { "Mapped", 6, MK_MAPPED },
+  [49] = { "pgscan_kswapd", 13, MK_PGSCAN_KSWAPD },
+  [50] = { "pgscan_khugepaged", 17, MK_PGSCAN_KHUGEPAGED },
+  [54] = { "pswpin", 6, MK_PSWPIN },
+  [57] = { "SwapCached", 10, MK_SWAPCACHED },
+  [58] = { "Hugepagesize", 12, MK_HUGEPAGESIZE },
+  [59] = { "KernelStack", 11, MK_KERNELSTACK },
+  [62] = { "pgmajfault", 10, MK_PGMAJFAULT },
+  [63] = { "pgsteal_kswapd", 14, MK_PGSTEAL_KSWAPD },
+};
+
+// "Key:   123 kB" (meminfo, scaled to bytes) or "key 123" (vmstat) lines;
+// keys not in the table keep their slot in `v` untouched.
+static void mk_parse(const char *p, const char *end, unsigned long long *v) {
+  while (p < end) {
+    const char *k = p;
+    while (p < end && *p != ':' && *p != ' ' && *p != '\n') p++;
+    int n = (int)(p - k);
+    int slot = n > 0 ? MK_HASH(k, n) : 0;
+    if (n > 0 && MK_SLOTS[slot].len == n && memcmp(MK_SLOTS[slot].name, k, (size_t)n) == 0) {
+      while (p < end && (*p == ':' || *p == ' ')) p++;
+      unsigned long long x = 0;
+      while (p < end && *p >= '0' && *p <= '9') x = x * 10 + (unsigned long long)(*p++ - '0');
+      if (end - p >= 3 && p[0] == ' ' && p[1] == 'k' && p[2] == 'B') x *= 1024ULL;
+      v[MK_SLOTS[slot].id] = x;
+    }
+    while (p < end && *p != '\n') p++;
+    p++;
+  }
+}
 
-  *mem_total = 0;
-  *mem_avail = 0;
+// Read all of a /proc file through a descriptor kept open across ticks;
+// procfs regenerates the text on every pread from offset 0.
+static int fd_pread(int fd, char *buf, int cap) {
+  int len = 0;
+  while (len < cap - 1) {
+    ssize_t r = pread(fd, buf + len, (size_t)(cap - 1 - len), len);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) break;
+    len += (int)r;
+  }
+  buf[len] = '\0';
+  return len;
+}
 
-  while (fscanf(f, "%63s %llu %31s", key, &val, unit) == 3) {
-    if (strcmp(key, "MemTotal:") == 0) *mem_total = val * 1024ULL;
-    if (strcmp(key, "MemAvailable:") == 0) *mem_avail = val * 1024ULL;
-    if (*mem_total && *mem_avail) break;
+static int proc_pread(int *fd, const char *rel, char *buf, int cap) {
+  if (*fd < 0) {
+    char path[320];
+    snprintf(path, sizeof(path), "%s/%s", g_proc_root, rel);
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (*fd < 0) return -1;
   }
-  fclose(f);
-  return (*mem_total != 0);
+  return fd_pread(*fd, buf, cap);
 }
 
 static int read_uptime(double *up) {
-  FILE *f = fopen("/proc/uptime", "r");
+  FILE *f = proc_fopen("uptime");
   if (!f) return 0;
   int ok = fscanf(f, "%lf", up) == 1;
   fclose(f);
   return ok;
 }
 
-static int read_temp(double *celsius) {
-  FILE *f = fopen("/sys/class/thermal/thermal_zone0/temp", "r");
-  if (!f) return 0;
-  long mv = 0;
-  int ok = fscanf(f, "%ld", &mv) == 1;
-  fclose(f);
-  if (!ok) return 0;
-  *celsius = (double)mv / 1000.0;
-  return 1;
+// Every thermal zone and hwmon temp*_input, and each CPU's scaling_cur_freq,
+// are found once at startup and then read through persistent fds: a tick
+// costs one pread per sensor and core, with no opens or stdio. All of them
+// count towards the hottest; a Sample carries SENS_MAX, the hottest always
+// among them, and how many it left out.
+#define SENS_MAX 64
+#define SENS_NAME 32
+#define FREQ_MAX 64
+
+typedef struct {
+  int fd;
+  char name[SENS_NAME];
+} SensFd;
+
+typedef struct {
+  SensFd *t;
+  int nt, cap;
+  int freq_fd[FREQ_MAX];        // -1 for a core without cpufreq (or offline)
+  int nf;
+  unsigned int fmax_khz;        // highest cpuinfo_max_freq
+} Sensors;
+
+// A one-line sysfs attribute, trailing whitespace stripped.
+static int sys_line(const char *rel, char *out, int cap) {
+  int fd = sys_open(rel);
+  if (fd < 0) return 0;
+  int n = fd_pread(fd, out, cap);
+  close(fd);
+  while (n > 0 && isspace((unsigned char)out[n-1])) out[--n] = '\0';
+  return n > 0;
+}
+
+static int fd_long(int fd, long long *v) {
+  char buf[32];
+  if (fd < 0 || fd_pread(fd, buf, sizeof(buf)) <= 0) return 0;
+  char *end;
+  *v = strtoll(buf, &end, 10);
+  return end != buf;
+}
+
+static void sens_add(Sensors *z, const char *rel, const char *name) {
+  int fd = sys_open(rel);
+  if (fd < 0) return;
+  if (z->nt == z->cap) {
+    int cap = z->cap ? z->cap * 2 : 16;
+    SensFd *t = (SensFd*)realloc(z->t, sizeof(SensFd) * (size_t)cap);
+    if (!t) { close(fd); return; }
+    z->t = t;
+    z->cap = cap;
+  }
+  z->t[z->nt].fd = fd;
+  snprintf(z->t[z->nt].name, SENS_NAME, "%.31s", name);
+  z->nt++;
+}
+
+// hwmon names have '_' where a zone type may have '-' (cpu-thermal).
+static int sens_same_type(const char *a, const char *b) {
+  for (; *a && *b; a++, b++)
+    if (*a != *b && !((*a == '-' || *a == '_') && (*b == '-' || *b == '_'))) return 0;
+  return *a == *b;
+}
+
+static void sensors_init(Sensors *z) {
+  char rel[256], name[64], label[64], base[48], nm[96];
+  char seen[64][24];            // zone types, then hwmon names
+  int nzone = 0, nseen = 0;
+  memset(z, 0, sizeof(*z));
+  // Zones of one type (several acpitz) get their zone number.
+  for (int i=0; i<64; i++) {
+    snprintf(rel, sizeof(rel), "class/thermal/thermal_zone%d/type", i);
+    if (!sys_line(rel, name, sizeof(name))) break;
+    int dup = 0;
+    for (int j=0; j<nseen && !dup; j++) dup = strcmp(seen[j], name) == 0;
+    if (!dup && nseen < 64) snprintf(seen[nseen++], sizeof(seen[0]), "%.23s", name);
+    if (dup) snprintf(nm, sizeof(nm), "%.23s.%d", name, i);
+    else snprintf(nm, sizeof(nm), "%.23s", name);
+    snprintf(rel, sizeof(rel), "class/thermal/thermal_zone%d/temp", i);
+    sens_add(z, rel, nm);
+  }
+  nzone = nseen;
+  // A hwmon device named after a zone type is thermal_hwmon re-exporting
+  // those zones. Any other is its own sensor, however its labels repeat
+  // another's: a second coretemp package, a second nvme. Labels carry the
+  // device name, and from the second device of a name on, its number.
+  for (int i=0; i<64; i++) {
+    snprintf(rel, sizeof(rel), "class/hwmon/hwmon%d/name", i);
+    if (!sys_line(rel, name, sizeof(name))) break;
+    int alias = 0, nth = 0;
+    for (int j=0; j<nzone && !alias; j++) alias = sens_same_type(seen[j], name);
+    if (alias) continue;
+    for (int j=nzone; j<nseen; j++) nth += strcmp(seen[j], name) == 0;
+    if (nseen < 64) snprintf(seen[nseen++], sizeof(seen[0]), "%.23s", name);
+    if (nth) snprintf(base, sizeof(base), "%.16s.%d", name, nth);
+    else snprintf(base, sizeof(base), "%.16s", name);
+    for (int k=1; k<=64; k++) {
+      snprintf(rel, sizeof(rel), "class/hwmon/hwmon%d/temp%d_label", i, k);
+      if (sys_line(rel, label, sizeof(label))) snprintf(nm, sizeof(nm), "%s:%s", base, label);
+      else if (k == 1) snprintf(nm, sizeof(nm), "%s", base);
+      else snprintf(nm, sizeof(nm), "%s/%d", base, k);
+      snprintf(rel, sizeof(rel), "class/hwmon/hwmon%d/temp%d_input", i, k);
+      sens_add(z, rel, nm);
+    }
+  }
+
+  int any = 0;
+  for (int i=0; i<FREQ_MAX; i++) {
+    struct stat st;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d", g_sys_root, i);
+    if (stat(path, &st) != 0) break;
+    snprintf(rel, sizeof(rel), "devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
+    z->freq_fd[i] = sys_open(rel);
+    if (z->freq_fd[i] >= 0) any = 1;
+    snprintf(rel, sizeof(rel), "devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", i);
+    if (sys_line(rel, name, sizeof(name))) {
+      unsigned int khz = (unsigned int)strtoul(name, NULL, 10);
+      if (khz > z->fmax_khz) z->fmax_khz = khz;
+    }
+    z->nf = i + 1;
+  }
+  if (!any) {
+    for (int i=0; i<z->nf; i++) if (z->freq_fd[i] >= 0) close(z->freq_fd[i]);
+    z->nf = 0;
+  }
+}
+
+static void sensors_free(Sensors *z) {
+  for (int i=0; i<z->nt; i++) close(z->t[i].fd);
+  for (int i=0; i<z->nf; i++) if (z->freq_fd[i] >= 0) close(z->freq_fd[i]);
+  free(z->t);
+  z->t = NULL;
+  z->nt = z->cap = z->nf = 0;
+}
+
+// perf_event_open counters, one group per CPU read with a single read(2):
+// context switches, migrations and page faults from the software PMU, which
+// every kernel has (VMs included), plus cycles/instructions and cache
+// references/misses when a hardware PMU is there. Counting system-wide needs
+// CAP_PERFMON or perf_event_paranoid <= 0; without it, or with PERF=0 in the
+// environment, nothing is opened and the panels leave the counters out.
+#define PERF_MAX 64
+enum { PS_CSW, PS_MIG, PS_FLT, PS_N };
+enum { PH_CYC, PH_INS, PH_REF, PH_MISS, PH_N };
+
+typedef struct {
+  int sw[PERF_MAX], hw[PERF_MAX];   // group leaders, -1 if not open
+  int n;                            // CPUs covered
+  int hw_n;                         // hardware events per group: 0, 2 or 4
+  int fds[PERF_MAX * (PS_N + PH_N)];
+  int nfds;
+  unsigned long long prev_sw[PERF_MAX][PS_N], prev_hw[PERF_MAX][PH_N];
+  int have_prev;
+} Perf;
+
+static int perf_open(Perf *pf, unsigned int type, unsigned long long config,
+                     int cpu, int leader) {
+  struct perf_event_attr a;
+  memset(&a, 0, sizeof(a));
+  a.size = sizeof(a);
+  a.type = type;
+  a.config = config;
+  a.read_format = PERF_FORMAT_GROUP;
+  a.disabled = (leader < 0);
+  int fd = (int)syscall(SYS_perf_event_open, &a, -1, cpu, leader, PERF_FLAG_FD_CLOEXEC);
+  if (fd >= 0) pf->fds[pf->nfds++] = fd;
+  return fd;
+}
+
+// Leader plus `n` members on one CPU; -1 (and nothing left open) if any fails.
+static int perf_group(Perf *pf, unsigned int type, const unsigned long long *cfg,
+                      int n, int cpu) {
+  int mark = pf->nfds;
+  int lead = perf_open(pf, type, cfg[0], cpu, -1);
+  for (int i=1; i<n && lead >= 0; i++) {
+    if (perf_open(pf, type, cfg[i], cpu, lead) < 0) lead = -1;
+  }
+  if (lead < 0) {
+    while (pf->nfds > mark) close(pf->fds[--pf->nfds]);
+    return -1;
+  }
+  ioctl(lead, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return lead;
+}
+
+static void perf_init(Perf *pf) {
+  static const unsigned long long SW[PS_N] = {
+    PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS, PERF_COUNT_SW_PAGE_FAULTS,
+  };
+  static const unsigned long long HW[PH_N] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+  };
+  memset(pf, 0, sizeof(*pf));
+  const char *env = getenv("PERF");
+  if (env && strcmp(env, "0") == 0) return;
+
+  int ncpu = (int)sysconf(_SC_NPROCESSORS_CONF);
+  ncpu = MAX(1, MIN(ncpu, PERF_MAX));
+  int any = 0;
+  pf->hw_n = PH_N;
+  for (int cpu=0; cpu<ncpu; cpu++) {
+    pf->sw[cpu] = perf_group(pf, PERF_TYPE_SOFTWARE, SW, PS_N, cpu);
+    // Without a hardware PMU the first CPU says so; VMs often expose
+    // cycles/instructions but not the cache events.
+    pf->hw[cpu] = -1;
+    if (pf->hw_n == PH_N) {
+      pf->hw[cpu] = perf_group(pf, PERF_TYPE_HARDWARE, HW, PH_N, cpu);
+      if (pf->hw[cpu] < 0 && cpu == 0) pf->hw_n = 2;
+    }
+    if (pf->hw_n == 2 && pf->hw[cpu] < 0) {
+      pf->hw[cpu] = perf_group(pf, PERF_TYPE_HARDWARE, HW, 2, cpu);
+      if (pf->hw[cpu] < 0 && cpu == 0) pf->hw_n = 0;
+    }
+    if (pf->sw[cpu] >= 0) any = 1;
+  }
+  if (!any) {
+    while (pf->nfds > 0) close(pf->fds[--pf->nfds]);
+    pf->hw_n = 0;
+    return;
+  }
+  pf->n = ncpu;
+}
+
+static void perf_free(Perf *pf) {
+  while (pf->nfds > 0) close(pf->fds[--pf->nfds]);
+  pf->n = 0;
+}
+
+// One group's counts in open order; returns how many were read.
+static int perf_read(int fd, unsigned long long *v, int n) {
+  unsigned long long buf[1 + PH_N];
+  if (fd < 0) return 0;
+  ssize_t r = read(fd, buf, sizeof(unsigned long long) * (size_t)(1 + n));
+  if (r < (ssize_t)sizeof(unsigned long long)) return 0;
+  int got = (int)MIN((unsigned long long)n, buf[0]);
+  for (int i=0; i<got; i++) v[i] = buf[1 + i];
+  return got;
+}
+
+// Up to `max` whitespace-separated unsigned fields; returns how many parsed.
+// Much cheaper than sscanf for the wide per-device lines.
+static int parse_u64s(const char *p, unsigned long long *out, int max) {
+  int n = 0;
+  while (n < max) {
+    char *end;
+    while (*p == ' ' || *p == '\t') p++;
+    if (!isdigit((unsigned char)*p)) break;
+    out[n++] = strtoull(p, &end, 10);
+    p = end;
+  }
+  return n;
 }
 
 static int is_pid_dir(const char *name) {
@@ -135,7 +574,7 @@ static int choose_iface(char *out, size_t outsz) {
   const char *env = getenv("IFACE");
   if (env && *env) { snprintf(out, outsz, "%s", env); return 1; }
 
-  FILE *f = fopen("/proc/net/dev", "r");
+  FILE *f = proc_fopen("net/dev");
   if (!f) return 0;
 
   char line[512];
@@ -159,46 +598,49 @@ static int choose_iface(char *out, size_t outsz) {
   return 0;
 }
 
-static int read_net_dev(const char *iface,
-                        unsigned long long *rxB, unsigned long long *txB,
-                        unsigned long long *rxErr, unsigned long long *rxDrop,
-                        unsigned long long *txErr, unsigned long long *txDrop) {
-  FILE *f = fopen("/proc/net/dev", "r");
-  if (!f) return 0;
+// One interface from /proc/net/dev, plus what changed since the last read.
+typedef struct {
+  char name[32];
+  unsigned long long rxB, txB, rxE, rxD, txE, txD;
+  double rx_mbs, tx_mbs;
+  unsigned long long d_rxE, d_rxD, d_txE, d_txD;
+} NetDev;
+
+#define MAX_DEVS 64
+
+// Every interface in one pass. Returns the count, or -1 if unreadable.
+static int read_net_devs(NetDev *out, int max) {
+  FILE *f = proc_fopen("net/dev");
+  if (!f) return -1;
 
   char line[512];
   fgets(line, sizeof(line), f);
   fgets(line, sizeof(line), f);
 
-  int ok = 0;
-  while (fgets(line, sizeof(line), f)) {
+  int n = 0;
+  while (n < max && fgets(line, sizeof(line), f)) {
     char *p = line;
     while (*p == ' ') p++;
     char *colon = strchr(p, ':');
     if (!colon) continue;
     *colon = '\0';
-    if (strcmp(p, iface) != 0) continue;
-
-    unsigned long long a[16] = {0};
-    int n = sscanf(colon + 1,
-      "%llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-      &a[0],&a[1],&a[2],&a[3],&a[4],&a[5],&a[6],&a[7],
-      &a[8],&a[9],&a[10],&a[11],&a[12],&a[13],&a[14],&a[15]
-    );
-    if (n >= 12) {
-      *rxB = a[0];
-      *rxErr = a[2];
-      *rxDrop = a[3];
-      *txB = a[8];
-      *txErr = a[10];
-      *txDrop = a[11];
-      ok = 1;
-    }
-    break;
+
+    unsigned long long a[12];
+    if (parse_u64s(colon + 1, a, 12) < 12) continue;
+
+    NetDev *d = &out[n++];
+    memset(d, 0, sizeof(*d));
+    snprintf(d->name, sizeof(d->name), "%.31s", p);
+    d->rxB = a[0];
+    d->rxE = a[2];
+    d->rxD = a[3];
+    d->txB = a[8];
+    d->txE = a[10];
+    d->txD = a[11];
   }
 
   fclose(f);
-  return ok;
+  return n;
 }
 
 // ---------------------------
@@ -231,7 +673,7 @@ static int choose_disk(char *out, size_t outsz) {
   const char *env = getenv("DISK");
   if (env && *env) { snprintf(out, outsz, "%s", env); return 1; }
 
-  FILE *f = fopen("/proc/diskstats", "r");
+  FILE *f = proc_fopen("diskstats");
   if (!f) return 0;
 
   char line[512];
@@ -256,72 +698,455 @@ static int choose_disk(char *out, size_t outsz) {
   return 1;
 }
 
-static int read_diskstats(const char *dev,
-                          unsigned long long *rd_sectors,
-                          unsigned long long *wr_sectors) {
-  FILE *f = fopen("/proc/diskstats", "r");
-  if (!f) return 0;
+// One block device from /proc/diskstats, plus its rates since the last read.
+typedef struct {
+  char name[32];
+  unsigned long long rdsec, wrsec;
+  double r_mbs, w_mbs;
+} DiskDev;
 
-  char line[512];
-  int ok = 0;
+// Whole disks (disk_score() > 0) and `want`, in one pass. Returns the count,
+// or -1 if unreadable.
+static int read_disk_devs(DiskDev *out, int max, const char *want) {
+  FILE *f = proc_fopen("diskstats");
+  if (!f) return -1;
 
-  while (fgets(line, sizeof(line), f)) {
-    unsigned int major=0, minor=0;
-    char name[64] = {0};
+  char line[512];
+  int n = 0;
 
-    unsigned long long reads=0, reads_merged=0, sectors_read=0, ms_read=0;
-    unsigned long long writes=0, writes_merged=0, sectors_written=0, ms_write=0;
-
-    int n = sscanf(line,
-      "%u %u %63s %llu %llu %llu %llu %llu %llu %llu %llu",
-      &major, &minor, name,
-      &reads, &reads_merged, &sectors_read, &ms_read,
-      &writes, &writes_merged, &sectors_written, &ms_write
-    );
-    if (n < 11) continue;
-
-    if (strcmp(name, dev) == 0) {
-      *rd_sectors = sectors_read;
-      *wr_sectors = sectors_written;
-      ok = 1;
-      break;
-    }
+  while (n < max && fgets(line, sizeof(line), f)) {
+    // major minor name, then reads, reads merged, sectors read, ms reading,
+    // writes, writes merged, sectors written, ...
+    unsigned long long mm[2], a[7];
+    char *p = line;
+    if (parse_u64s(p, mm, 2) < 2) continue;
+    while (*p == ' ') p++;
+    while (isdigit((unsigned char)*p)) p++;
+    while (*p == ' ') p++;
+    while (isdigit((unsigned char)*p)) p++;
+    while (*p == ' ') p++;
+    char *name = p;
+    while (*p && *p != ' ' && *p != '\n') p++;
+    if (p == name || !*p) continue;
+    *p++ = '\0';
+    if (parse_u64s(p, a, 7) < 7) continue;
+    if (disk_score(name) <= 0 && strcmp(name, want) != 0) continue;
+
+    DiskDev *d = &out[n++];
+    memset(d, 0, sizeof(*d));
+    snprintf(d->name, sizeof(d->name), "%.31s", name);
+    d->rdsec = a[2];
+    d->wrsec = a[6];
   }
 
   fclose(f);
-  return ok;
+  return n;
 }
 
 // ---------------------------
-// FS usage (/)
+// Filesystems (every mount)
 // ---------------------------
-static int read_fs_usage(const char *path,
-                         double *usedPct,
-                         unsigned long long *usedB,
-                         unsigned long long *totB,
-                         double *inodePct) {
-  struct statvfs v;
-  if (statvfs(path, &v) != 0) return 0;
-
-  unsigned long long fr = (unsigned long long)v.f_frsize;
-  unsigned long long total = (unsigned long long)v.f_blocks * fr;
-  unsigned long long avail = (unsigned long long)v.f_bavail * fr;
-  unsigned long long used  = (total > avail) ? (total - avail) : 0;
-
-  double p = 0.0;
-  if (total > 0) p = (double)used / (double)total * 100.0;
-
-  unsigned long long itot = (unsigned long long)v.f_files;
-  unsigned long long iav  = (unsigned long long)v.f_favail;
-  unsigned long long iuse = (itot > iav) ? (itot - iav) : 0;
-  double ip = 0.0;
-  if (itot > 0) ip = (double)iuse / (double)itot * 100.0;
-
-  *usedPct = p;
-  *usedB = used;
-  *totB = total;
-  *inodePct = ip;
-  return 1;
+// Mounts come from /proc/self/mountinfo, which is re-parsed only when
+// poll() flags a change, so a steady tick reads nothing. statvfs runs on
+// detached worker threads: a hung NFS or FUSE server blocks a worker, never
+// the tick. Each tick queues every mount and waits up to MNT_WAIT_MS for the
+// answers; anything slower keeps the last round's numbers, and a call in
+// flight for MNT_STUCK_SECS marks its mount stuck until it returns. While
+// the worker is blocked another one takes over, up to MNT_WORKERS.
+// Mount points are kept whole (kubelet volume paths run past 128 bytes)
+// and the table grows with mountinfo, so no mount is ever dropped.
+#define MNT_WAIT_MS 20
+#define MNT_STUCK_SECS 1.0
+#define MNT_WORKERS 4
+#define MNT_RATE_N 24           // used bytes, one point per MNT_RATE_SECS,
+#define MNT_RATE_SECS 5.0       // so the fill rate spans the last 2 minutes
+
+// Pseudo and read-only image filesystems: nothing there fills up.
+static const char *const MNT_SKIP[] = {
+  "proc", "sysfs", "devtmpfs", "devpts", "cgroup", "cgroup2", "securityfs",
+  "debugfs", "tracefs", "pstore", "bpf", "mqueue", "hugetlbfs", "configfs",
+  "fusectl", "autofs", "binfmt_misc", "rpc_pipefs", "nsfs", "efivarfs",
+  "selinuxfs", "ramfs", "squashfs", "iso9660", "fuse.lxcfs", "fuse.gvfsd-fuse",
+};
+
+typedef struct {
+  int id;                       // mountinfo mount ID, 0 for a free slot
+  unsigned int dev;             // major:minor, shared by bind mounts
+  int live;                     // in the last parse and not a duplicate
+  int ord;                      // line in mountinfo: later mounts cover earlier
+  char *dir;                    // owned; changed only by the owner, under mu
+  char type[24];
+  int want, busy;               // queued / a worker is in statvfs on it
+  double t_call;                // when that call started
+  int have, err;
+  unsigned long long tot, avail, itot, iuse;
+  double rt[MNT_RATE_N];        // fill-rate history, touched by the owner only
+  unsigned long long ru[MNT_RATE_N];
+  int rn;
+} MntSlot;
+
+// Everything the workers touch. Blocked workers can outlive the Mounts that
+// started them, so this is freed by whoever drops the last reference.
+typedef struct {
+  pthread_mutex_t mu;
+  pthread_cond_t work, done;
+  MntSlot *a;                   // may move when it grows: workers keep indices
+  int n, cap;                   // slots in use / allocated
+  int workers, idle;
+  int refs;                     // the owner plus each worker
+  int quit;
+} MntShared;
+
+typedef struct {
+  const char *dir;              // the slot's string, valid until the next parse
+  char type[24];
+  int have, stuck;
+  unsigned long long tot, used, avail;
+  double pct, ipct;
+  double fill;                  // bytes/s, + filling, - draining
+  int have_fill;
+} MountRow;
+
+typedef struct {
+  MntShared *sh;
+  int fd;                       // mountinfo, polled for changes
+  int parsed;
+  char *buf;
+  int cap;
+  MountRow *rows;               // real filesystems, stuck first, then fullest
+  int n, nstuck, rcap;
+  MntSlot **ix;                 // mounts_parse scratch
+  int ixcap;
+} Mounts;
+
+static void mnt_shared_unref(MntShared *sh) {
+  int last = --sh->refs == 0;
+  pthread_mutex_unlock(&sh->mu);
+  if (!last) return;
+  pthread_cond_destroy(&sh->work);
+  pthread_cond_destroy(&sh->done);
+  pthread_mutex_destroy(&sh->mu);
+  for (int i=0; i<sh->n; i++) free(sh->a[i].dir);
+  free(sh->a);
+  free(sh);
+}
+
+static void *mnt_worker(void *arg) {
+  MntShared *sh = (MntShared*)arg;
+  pthread_mutex_lock(&sh->mu);
+  while (!sh->quit) {
+    int i = 0;
+    while (i < sh->n && !(sh->a[i].id && sh->a[i].want)) i++;
+    if (i == sh->n) {
+      if (sh->idle > 0) break;  // one idle worker is enough
+      sh->idle++;
+      pthread_cond_wait(&sh->work, &sh->mu);
+      sh->idle--;
+      continue;
+    }
+    MntSlot *m = &sh->a[i];
+    char *dir = strdup(m->dir);
+    m->want = 0;
+    m->busy = 1;
+    m->t_call = now_s();
+    pthread_mutex_unlock(&sh->mu);
+    struct statvfs v;
+    int r = dir ? statvfs(dir, &v) : -1, err = dir ? errno : ENOMEM;
+    free(dir);
+    pthread_mutex_lock(&sh->mu);
+    // Slots are only reused once idle, so slot i is still this mount; the
+    // table may have been reallocated meanwhile.
+    m = &sh->a[i];
+    m->busy = 0;
+    if (r == 0) {
+      unsigned long long fr = (unsigned long long)v.f_frsize;
+      m->tot = (unsigned long long)v.f_blocks * fr;
+      m->avail = (unsigned long long)v.f_bavail * fr;
+      m->itot = (unsigned long long)v.f_files;
+      m->iuse = m->itot > v.f_favail ? m->itot - (unsigned long long)v.f_favail : 0;
+      m->have = 1;
+      m->err = 0;
+    } else {
+      m->err = err;
+    }
+    // Wake the tick once the queue is drained, not per mount.
+    int more = 0;
+    for (int j=0; j<sh->n && !more; j++) more = sh->a[j].id && sh->a[j].want;
+    if (!more) pthread_cond_broadcast(&sh->done);
+  }
+  sh->workers--;
+  mnt_shared_unref(sh);
+  return NULL;
+}
+
+static void mounts_init(Mounts *M) {
+  memset(M, 0, sizeof(*M));
+  M->fd = -1;
+  M->sh = (MntShared*)calloc(1, sizeof(MntShared));
+  pthread_mutex_init(&M->sh->mu, NULL);
+  pthread_cond_init(&M->sh->work, NULL);
+  pthread_cond_init(&M->sh->done, NULL);
+  M->sh->refs = 1;
+}
+
+static void mounts_free(Mounts *M) {
+  if (!M->sh) return;
+  MntShared *sh = M->sh;
+  pthread_mutex_lock(&sh->mu);
+  sh->quit = 1;
+  pthread_cond_broadcast(&sh->work);
+  mnt_shared_unref(sh);
+  if (M->fd >= 0) close(M->fd);
+  free(M->buf);
+  free(M->rows);
+  free(M->ix);
+  memset(M, 0, sizeof(*M));
+  M->fd = -1;
+}
+
+// Mount points escape space, tab, newline and backslash as \ooo.
+static void mnt_unescape(char *s) {
+  char *o = s;
+  for (; *s; s++) {
+    if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' && s[2] >= '0' && s[2] <= '7' &&
+        s[3] >= '0' && s[3] <= '7') {
+      *o++ = (char)((s[1] - '0') * 64 + (s[2] - '0') * 8 + (s[3] - '0'));
+      s += 3;
+    } else {
+      *o++ = *s;
+    }
+  }
+  *o = '\0';
+}
+
+static char *mnt_field(char **p) {
+  char *s = *p;
+  while (*s == ' ') s++;
+  char *e = s;
+  while (*e && *e != ' ' && *e != '\n') e++;
+  *p = *e == ' ' ? e + 1 : e;
+  *e = '\0';
+  return s;
+}
+
+static int mnt_skip(const char *type) {
+  for (size_t i=0; i<sizeof(MNT_SKIP)/sizeof(MNT_SKIP[0]); i++)
+    if (strcmp(type, MNT_SKIP[i]) == 0) return 1;
+  return 0;
+}
+
+// Called with sh->mu held.
+static void mnt_add(MntShared *sh, int id, int ord, unsigned int dev, const char *dir,
+                    const char *type) {
+  MntSlot *m = NULL, *fresh = NULL;
+  for (int i=0; i<sh->n && !m; i++) {
+    if (sh->a[i].id == id) m = &sh->a[i];
+    else if (!fresh && !sh->a[i].id && !sh->a[i].busy) fresh = &sh->a[i];
+  }
+  if (!m) {
+    if (!fresh) {
+      if (sh->n == sh->cap) {
+        int cap = sh->cap ? sh->cap * 2 : 64;
+        MntSlot *a = (MntSlot*)realloc(sh->a, sizeof(MntSlot) * (size_t)cap);
+        if (!a) return;
+        sh->a = a;
+        sh->cap = cap;
+      }
+      fresh = &sh->a[sh->n++];
+      fresh->dir = NULL;
+    }
+    free(fresh->dir);
+    memset(fresh, 0, sizeof(*fresh));
+    m = fresh;
+    m->id = id;
+  }
+  if (!m->dir || strcmp(m->dir, dir) != 0) {
+    char *d = strdup(dir);
+    if (!d) { if (!m->dir) m->id = 0; return; }
+    free(m->dir);
+    m->dir = d;
+  }
+  m->dev = dev;
+  m->ord = ord;
+  m->live = 1;
+  snprintf(m->type, sizeof(m->type), "%s", type);
+}
+
+// Same mount point, newest mount first.
+static int cmp_mnt_dir(const void *pa, const void *pb) {
+  const MntSlot *a = *(MntSlot *const*)pa, *b = *(MntSlot *const*)pb;
+  int c = strcmp(a->dir, b->dir);
+  return c ? c : b->ord - a->ord;
+}
+
+// Same device, shortest mount point first, then the earliest mount.
+static int cmp_mnt_dev(const void *pa, const void *pb) {
+  const MntSlot *a = *(MntSlot *const*)pa, *b = *(MntSlot *const*)pb;
+  if (a->dev != b->dev) return a->dev < b->dev ? -1 : 1;
+  size_t la = strlen(a->dir), lb = strlen(b->dir);
+  if (la != lb) return la < lb ? -1 : 1;
+  return a->ord - b->ord;
+}
+
+static void mounts_parse(Mounts *M) {
+  if (!M->buf) { M->cap = 16384; M->buf = (char*)malloc((size_t)M->cap); }
+  int len = proc_pread(&M->fd, "self/mountinfo", M->buf, M->cap);
+  while (len == M->cap - 1) {
+    M->cap *= 2;
+    M->buf = (char*)realloc(M->buf, (size_t)M->cap);
+    len = fd_pread(M->fd, M->buf, M->cap);
+  }
+  MntShared *sh = M->sh;
+  pthread_mutex_lock(&sh->mu);
+  for (int i=0; i<sh->n; i++) sh->a[i].live = 0;
+  // id parent major:minor root dir opts [optional...] - type source superopts
+  int ord = 0;
+  for (char *p = len > 0 ? M->buf : NULL; p && *p; ord++) {
+    char *nl = strchr(p, '\n');
+    if (nl) *nl = '\0';
+    char *q = p;
+    int id = atoi(mnt_field(&q));
+    mnt_field(&q);
+    char *mm = mnt_field(&q);
+    mnt_field(&q);
+    char *dir = mnt_field(&q);
+    char *sep = strstr(q, " - ");
+    p = nl ? nl + 1 : NULL;
+    if (id <= 0 || !sep) continue;
+    q = sep + 3;
+    char *type = mnt_field(&q);
+    if (mnt_skip(type)) continue;
+    unsigned int maj = (unsigned int)strtoul(mm, &mm, 10);
+    unsigned int min = *mm == ':' ? (unsigned int)strtoul(mm + 1, NULL, 10) : 0;
+    mnt_unescape(dir);
+    mnt_add(sh, id, ord, (maj << 20) | min, dir, type);
+  }
+  // No mountinfo (an old kernel, a fixture without one): just "/".
+  if (len <= 0) mnt_add(sh, -1, 0, 0, "/", "?");
+  // One row per mount point: the last mount there hides the ones under it.
+  // Then one per filesystem, at the shortest mount point of its device.
+  // Sorted rather than pairwise: container hosts carry thousands of mounts.
+  if (M->ixcap < sh->n) {
+    M->ixcap = sh->cap;
+    M->ix = (MntSlot**)realloc(M->ix, sizeof(MntSlot*) * (size_t)M->ixcap);
+  }
+  int k = 0;
+  for (int i=0; i<sh->n; i++) if (sh->a[i].live) M->ix[k++] = &sh->a[i];
+  qsort(M->ix, (size_t)k, sizeof(MntSlot*), cmp_mnt_dir);
+  for (int i=1; i<k; i++)
+    if (strcmp(M->ix[i]->dir, M->ix[i - 1]->dir) == 0) M->ix[i]->live = 0;
+  int j = 0;
+  for (int i=0; i<k; i++) if (M->ix[i]->live) M->ix[j++] = M->ix[i];
+  qsort(M->ix, (size_t)j, sizeof(MntSlot*), cmp_mnt_dev);
+  for (int i=1; i<j; i++)
+    if (M->ix[i]->dev && M->ix[i]->dev == M->ix[i - 1]->dev) M->ix[i]->live = 0;
+  pthread_mutex_unlock(&sh->mu);
+  M->parsed = 1;
+}
+
+// mountinfo signals a change with POLLPRI; a regular file never does.
+static int mounts_changed(Mounts *M) {
+  if (!M->parsed) return 1;
+  if (M->fd < 0) return 0;
+  struct pollfd pf = { M->fd, POLLPRI, 0 };
+  return poll(&pf, 1, 0) > 0 && (pf.revents & (POLLPRI | POLLERR));
+}
+
+static int cmp_mount_row(const void *pa, const void *pb) {
+  const MountRow *a = (const MountRow*)pa, *b = (const MountRow*)pb;
+  if (a->stuck != b->stuck) return b->stuck - a->stuck;
+  double fa = MAX(a->pct, a->ipct), fb = MAX(b->pct, b->ipct);
+  if (fa != fb) return fa < fb ? 1 : -1;
+  return strcmp(a->dir, b->dir);
+}
+
+static void mounts_tick(Mounts *M) {
+  if (!M->sh) return;
+  if (mounts_changed(M)) mounts_parse(M);
+  MntShared *sh = M->sh;
+  pthread_mutex_lock(&sh->mu);
+  double t0 = now_s();
+  int blocked = 0;
+  for (int i=0; i<sh->n; i++) {
+    MntSlot *m = &sh->a[i];
+    if (!m->id) continue;
+    if (m->busy) { blocked += t0 - m->t_call > MNT_WAIT_MS / 1000.0; continue; }
+    if (!m->live) { m->id = 0; continue; }
+    m->want = 1;
+  }
+  if (sh->workers - blocked < 1 && sh->workers < MNT_WORKERS) {
+    pthread_t th;
+    pthread_attr_t at;
+    pthread_attr_init(&at);
+    pthread_attr_setdetachstate(&at, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&th, &at, mnt_worker, sh) == 0) { sh->workers++; sh->refs++; }
+    pthread_attr_destroy(&at);
+  }
+  pthread_cond_broadcast(&sh->work);
+
+  // Wait for this round only; a call that was already hanging is not.
+  struct timespec dl;
+  clock_gettime(CLOCK_REALTIME, &dl);
+  dl.tv_nsec += MNT_WAIT_MS * 1000000L;
+  if (dl.tv_nsec >= 1000000000L) { dl.tv_nsec -= 1000000000L; dl.tv_sec++; }
+  for (;;) {
+    int pending = 0;
+    for (int i=0; i<sh->n && !pending; i++) {
+      const MntSlot *m = &sh->a[i];
+      pending = m->id && m->live && (m->want || (m->busy && m->t_call >= t0));
+    }
+    if (!pending || pthread_cond_timedwait(&sh->done, &sh->mu, &dl) == ETIMEDOUT) break;
+  }
+
+  double now = now_s();
+  M->n = M->nstuck = 0;
+  if (M->rcap < sh->n) {
+    M->rcap = sh->cap;
+    M->rows = (MountRow*)realloc(M->rows, sizeof(MountRow) * (size_t)M->rcap);
+  }
+  for (int i=0; i<sh->n; i++) {
+    MntSlot *m = &sh->a[i];
+    if (!m->id || !m->live) continue;
+    int stuck = m->busy && now - m->t_call > MNT_STUCK_SECS;
+    // Nothing to show: no answer yet, an error, or no blocks (pseudo fs).
+    if (!stuck && (!m->have || m->err || m->tot == 0)) continue;
+    MountRow *r = &M->rows[M->n++];
+    memset(r, 0, sizeof(*r));
+    r->dir = m->dir;
+    memcpy(r->type, m->type, sizeof(r->type));
+    r->stuck = stuck;
+    M->nstuck += stuck;
+    r->have = m->have;
+    if (!m->have) continue;
+    r->tot = m->tot;
+    r->avail = m->avail;
+    r->used = m->tot > m->avail ? m->tot - m->avail : 0;
+    if (m->tot) r->pct = (double)r->used / (double)m->tot * 100.0;
+    if (m->itot) r->ipct = (double)m->iuse / (double)m->itot * 100.0;
+    if (stuck) continue;
+    if (m->rn == 0 || now - m->rt[m->rn - 1] >= MNT_RATE_SECS) {
+      if (m->rn == MNT_RATE_N) {
+        memmove(m->rt, m->rt + 1, sizeof(m->rt[0]) * (MNT_RATE_N - 1));
+        memmove(m->ru, m->ru + 1, sizeof(m->ru[0]) * (MNT_RATE_N - 1));
+        m->rn--;
+      }
+      m->rt[m->rn] = now;
+      m->ru[m->rn++] = r->used;
+    }
+    double span = now - m->rt[0];
+    if (span >= 2 * MNT_RATE_SECS) {
+      r->fill = ((double)r->used - (double)m->ru[0]) / span;
+      r->have_fill = 1;
+    }
+  }
+  pthread_mutex_unlock(&sh->mu);
+  qsort(M->rows, (size_t)M->n, sizeof(MountRow), cmp_mount_row);
+}
+
+static const MountRow *mounts_find(const Mounts *M, const char *dir) {
+  for (int i=0; i<M->n; i++)
+    if (strcmp(M->rows[i].dir, dir) == 0) return &M->rows[i];
+  return NULL;
 }
 
 // ---------------------------
@@ -374,6 +1199,55 @@ static void throttled_summary(unsigned int flags, char *out, size_t n) {
   else         snprintf(out, n, "PWR %s", now[0]?now:"OK");
 }
 
+// ---------------------------
+// Sample (one tick of system-wide metrics)
+// ---------------------------
+typedef struct {
+  double cpu_pct;
+  double mem_pct;
+  unsigned long long memT, memA;
+  double l1, l5, l15;
+  double up;
+  int have_tc;
+  double tc;                         // hottest sensor
+  // Every sensor (C) and each CPU's current clock (MHz, 0 when unknown)
+  int n_sens, hot;                   // hot: index of the hottest, -1 if none
+  int sens_more;                     // sensors past SENS_MAX, not carried
+  char sens_name[SENS_MAX][SENS_NAME];
+  float sens_c[SENS_MAX];
+  int n_freq;
+  unsigned short freq_mhz[FREQ_MAX], freq_max_mhz;
+  // perf_event rates (/s) and ratios, all CPUs and per CPU. have_perf is 0
+  // without counters, 1 for software events only, 2 with IPC, 3 with misses.
+  int have_perf, n_pcpu;
+  double csw_s, mig_s, flt_s, ipc, miss_pct;
+  float pc_csw[PERF_MAX], pc_ipc[PERF_MAX], pc_miss[PERF_MAX];
+  // --fast: per-core busy % over MS windows since the last tick (fast_n of
+  // them), the aggregate's over the same windows, and the sampler thread's
+  // own CPU as % of one core.
+  int fast_ms, fast_n;
+  double cpu_lo, cpu_p50, cpu_p99, cpu_hi, fast_cpu;
+  double all_p50, all_p99, all_hi;
+  double disk_r_mbs, disk_w_mbs;
+  double net_rx_mbs, net_tx_mbs;
+  unsigned long long d_rxE, d_rxD, d_txE, d_txD;
+  int have_fs;
+  double fsPct, inodePct;
+  unsigned long long fsUsedB, fsTotB;
+  int have_thr;
+  unsigned int thrFlags;
+  int have_iface, have_disk;
+  char iface[64];
+  char disk[64];
+  char busy_disk[32], busy_nic[32];  // most traffic this tick, any device
+  double busy_disk_mbs, busy_nic_mbs;
+  // Memory breakdown (bytes; cache excludes shmem) and vmstat rates (/s)
+  unsigned long long memFree, memAnon, memCache, memShmem, memSlab;
+  unsigned long long memDirty, memWback, swapT, swapF, hugeT, hugeF;
+  double majflt_s, pgscan_s, pgsteal_s, swpin_s, swpout_s;
+  unsigned long long oomKills;       // since boot
+} Sample;
+
 // ---------------------------
 // Process tracking
 // ---------------------------
@@ -388,17 +1262,55 @@ typedef struct {
   int seen;
 } ProcTrack;
 
+// `slot` maps pid -> index+1 into `a` (open addressing, 0 = empty) so a
+// scan's upserts stay linear. Pruning and sorting move entries; they mark
+// the index stale and the next lookup rebuilds it in one pass.
 typedef struct {
   ProcTrack *a;
   int n;
   int cap;
+  int *slot;
+  int nslot;                    // power of two, at least twice `cap`
+  int stale;
 } ProcTable;
 
-static void proctable_init(ProcTable *t) { t->a=NULL; t->n=0; t->cap=0; }
-static void proctable_free(ProcTable *t) { free(t->a); t->a=NULL; t->n=0; t->cap=0; }
+static void proctable_init(ProcTable *t) { memset(t, 0, sizeof(*t)); }
+
+static void proctable_free(ProcTable *t) {
+  free(t->a);
+  free(t->slot);
+  memset(t, 0, sizeof(*t));
+}
+
+static unsigned int pid_slot(const ProcTable *t, int pid) {
+  return ((unsigned int)pid * 2654435761u) & (unsigned int)(t->nslot - 1);
+}
+
+static void proctable_put(ProcTable *t, int i) {
+  unsigned int h = pid_slot(t, t->a[i].pid);
+  while (t->slot[h]) h = (h + 1) & (unsigned int)(t->nslot - 1);
+  t->slot[h] = i + 1;
+}
+
+static void proctable_reindex(ProcTable *t) {
+  int want = 64;
+  while (want < t->cap * 2) want *= 2;
+  if (want != t->nslot) {
+    free(t->slot);
+    t->slot = (int*)malloc(sizeof(int) * (size_t)want);
+    t->nslot = want;
+  }
+  memset(t->slot, 0, sizeof(int) * (size_t)t->nslot);
+  for (int i=0; i<t->n; i++) proctable_put(t, i);
+  t->stale = 0;
+}
 
 static ProcTrack* proctable_get(ProcTable *t, int pid) {
-  for (int i=0;i<t->n;i++) if (t->a[i].pid == pid) return &t->a[i];
+  if (t->stale || t->nslot < t->cap * 2 || !t->slot) proctable_reindex(t);
+  unsigned int h = pid_slot(t, pid);
+  for (int i; (i = t->slot[h]) != 0; h = (h + 1) & (unsigned int)(t->nslot - 1)) {
+    if (t->a[i-1].pid == pid) return &t->a[i-1];
+  }
   return NULL;
 }
 
@@ -408,11 +1320,13 @@ static ProcTrack* proctable_upsert(ProcTable *t, int pid) {
   if (t->n == t->cap) {
     t->cap = (t->cap == 0) ? 256 : t->cap * 2;
     t->a = (ProcTrack*)realloc(t->a, sizeof(ProcTrack) * t->cap);
+    proctable_reindex(t);
   }
   ProcTrack *nw = &t->a[t->n++];
   memset(nw, 0, sizeof(*nw));
   nw->pid = pid;
   nw->cpu_avg = 0.0;
+  proctable_put(t, t->n - 1);
   return nw;
 }
 
@@ -424,20 +1338,13 @@ static void proctable_prune_unseen(ProcTable *t) {
       t->a[w++] = t->a[i];
     }
   }
+  if (w != t->n) t->stale = 1;
   t->n = w;
 }
 
-static int read_proc_stat(int pid, char *comm_out, size_t comm_sz, char *state_out,
-                          unsigned long long *jiff_out) {
-  char path[64];
-  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-  FILE *f = fopen(path, "r");
-  if (!f) return 0;
-
-  char buf[4096];
-  if (!fgets(buf, sizeof(buf), f)) { fclose(f); return 0; }
-  fclose(f);
-
+// Parse /proc/<pid>/stat (or a thread's) already read into `buf`.
+static int parse_proc_stat(char *buf, char *comm_out, size_t comm_sz, char *state_out,
+                           unsigned long long *jiff_out) {
   char *lp = strchr(buf, '(');
   char *rp = strrchr(buf, ')');
   if (!lp || !rp || rp <= lp) return 0;
@@ -454,20 +1361,56 @@ static int read_proc_stat(int pid, char *comm_out, size_t comm_sz, char *state_o
 
   *state_out = tok[0];
 
+  // utime and stime are fields 14 and 15; the state (field 3) was idx 0.
   unsigned long long ut=0, st=0;
-  for (int idx = 1; idx <= 13; idx++) {
+  for (int idx = 1; idx <= 12; idx++) {
     tok = strtok_r(NULL, " ", &save);
     if (!tok) return 0;
-    if (idx == 12) ut = strtoull(tok, NULL, 10);
-    if (idx == 13) st = strtoull(tok, NULL, 10);
+    if (idx == 11) ut = strtoull(tok, NULL, 10);
+    if (idx == 12) st = strtoull(tok, NULL, 10);
   }
   *jiff_out = ut + st;
   return 1;
 }
 
+// Plain open/read, no stdio: a scan of thousands of tasks or threads then
+// allocates nothing per file.
+static int read_stat_at(int dirfd, const char *rel, char *comm_out, size_t comm_sz,
+                        char *state_out, unsigned long long *jiff_out) {
+  int fd = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return 0;
+  char buf[4096];
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) return 0;
+  buf[n] = '\0';
+  return parse_proc_stat(buf, comm_out, comm_sz, state_out, jiff_out);
+}
+
+static int read_proc_stat(int pid, char *comm_out, size_t comm_sz, char *state_out,
+                          unsigned long long *jiff_out) {
+  char rel[320];
+  snprintf(rel, sizeof(rel), "%s/%d/stat", g_proc_root, pid);
+  return read_stat_at(AT_FDCWD, rel, comm_out, comm_sz, state_out, jiff_out);
+}
+
+// Turn a jiffies reading into cur/avg CPU% with the table's EWMA.
+static void track_cpu(ProcTrack *p, unsigned long long jiff, long hz, double dt) {
+  unsigned long long dj = 0;
+  if (p->last_jiff > 0 && jiff >= p->last_jiff) dj = (jiff - p->last_jiff);
+  p->last_jiff = jiff;
+
+  double curpct = 0.0;
+  if (dj > 0) curpct = (double)dj / ((double)hz * dt) * 100.0;
+  p->cpu_cur = curpct;
+
+  if (p->cpu_avg <= 0.0001) p->cpu_avg = curpct;
+  else p->cpu_avg = (1.0 - EWMA_ALPHA)*p->cpu_avg + EWMA_ALPHA*curpct;
+}
+
 static unsigned long long read_proc_rss_bytes(int pid) {
-  char path[64];
-  snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+  char path[320];
+  snprintf(path, sizeof(path), "%s/%d/statm", g_proc_root, pid);
   FILE *f = fopen(path, "r");
   if (!f) return 0;
   unsigned long long size=0, rss=0;
@@ -488,214 +1431,4218 @@ static int cmp_proc_avg(const void *A, const void *B) {
   return (a->pid - b->pid);
 }
 
-// ---------------------------
-// Formatting + graphs
-// ---------------------------
-static void fmt_bytes(unsigned long long b, char *out, size_t n) {
-  const char *u = "B";
-  double v = (double)b;
-  if (v >= 1024) { v/=1024; u="KB"; }
-  if (v >= 1024) { v/=1024; u="MB"; }
-  if (v >= 1024) { v/=1024; u="GB"; }
-  snprintf(out, n, "%.1f%s", v, u);
+// Threads of the processes expanded in TASKS. Only those PIDs are walked,
+// each through /proc/<pid>/task into its own ProcTable, so threads get the
+// same EWMA as tasks. Tables live until their process is collapsed and
+// only ever grow, so churn in a process with 10k+ threads reuses the same
+// memory from scan to scan.
+#define EXPAND_MAX 8
+
+typedef struct {
+  int pid;
+  ProcTable th;
+} Expanded;
+
+typedef struct {
+  Expanded e[EXPAND_MAX];
+  int n;
+  long hz;
+} Threads;
+
+static Expanded *threads_find(Threads *t, int pid) {
+  for (int i=0; i<t->n; i++) if (t->e[i].pid == pid) return &t->e[i];
+  return NULL;
 }
 
-static void fmt_uptime(double sec, char *out, size_t n) {
-  int s = (int)sec;
-  int d = s / 86400; s %= 86400;
-  int h = s / 3600;  s %= 3600;
-  int m = s / 60;    s %= 60;
-  snprintf(out, n, "%dd %02d:%02d:%02d", d, h, m, s);
+static void threads_drop(Threads *t, int i) {
+  proctable_free(&t->e[i].th);
+  t->e[i] = t->e[--t->n];
 }
 
-static void draw_single_graph(WINDOW *w, const char *title,
-                              const Hist *h, int count,
-                              double vmin, double vmax,
-                              int color_pair, const char *unit) {
-  int H, W;
-  getmaxyx(w, H, W);
-  box(w, 0, 0);
+// Expand `pid`, or collapse it if it already is.
+static void threads_toggle(Threads *t, int pid) {
+  for (int i=0; i<t->n; i++) if (t->e[i].pid == pid) { threads_drop(t, i); return; }
+  if (t->n == EXPAND_MAX) threads_drop(t, 0);
+  Expanded *e = &t->e[t->n++];
+  e->pid = pid;
+  proctable_init(&e->th);
+}
 
-  int x0=1, y0=1, x1=W-2, y1=H-2;
-  int pw = x1-x0+1, ph = y1-y0+1;
-  if (pw < 10 || ph < 4) return;
+static void threads_free(Threads *t) {
+  while (t->n > 0) threads_drop(t, t->n - 1);
+}
 
-  int n = MIN(count, pw);
-  n = MIN(n, h->len);
+// A process that is gone is collapsed.
+static void threads_scan(Threads *t, double dt) {
+  if (t->hz <= 0) t->hz = sysconf(_SC_CLK_TCK) > 0 ? sysconf(_SC_CLK_TCK) : 100;
+  for (int i=t->n-1; i>=0; i--) {
+    Expanded *e = &t->e[i];
+    char path[320];
+    snprintf(path, sizeof(path), "%s/%d/task", g_proc_root, e->pid);
+    DIR *d = opendir(path);
+    if (!d) { threads_drop(t, i); continue; }
+    int dfd = dirfd(d);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+      if (!is_pid_dir(de->d_name)) continue;
+      char rel[300], comm[64], state = '?';
+      unsigned long long jiff = 0;
+      snprintf(rel, sizeof(rel), "%s/stat", de->d_name);
+      if (!read_stat_at(dfd, rel, comm, sizeof(comm), &state, &jiff)) continue;
+      ProcTrack *p = proctable_upsert(&e->th, atoi(de->d_name));
+      p->seen = 1;
+      p->state = state;
+      memcpy(p->comm, comm, sizeof(p->comm));
+      track_cpu(p, jiff, t->hz, dt);
+    }
+    closedir(d);
+    proctable_prune_unseen(&e->th);
+    qsort(e->th.a, (size_t)e->th.n, sizeof(ProcTrack), cmp_proc_avg);
+    e->th.stale = 1;
+  }
+}
 
-  double latest = hist_get_latest(h);
+// ---------------------------
+// Task filter
+// ---------------------------
+// `/` in TASKS. The text is an extended regex, case-insensitive (a plain
+// substring if it does not compile), tried on comm, command line, user and
+// cgroup; a comm:, cmd:, user:, cg: or state: prefix narrows it to one.
+// Results are cached per PID with the filter generation they were made
+// for, and the command line, user and cgroup are read once per PID and
+// again only when its comm changes (an exec), so a scan evaluates only new
+// and exec'd tasks and an edit only re-runs the regex. Without `local`
+// (/proc is another host's) only comm and state can match.
+enum { FF_ANY, FF_COMM, FF_CMD, FF_USER, FF_CG, FF_STATE };
+
+#define FILTER_UIDS 32
+#define FILTER_KEEP 16          // passes an unseen PID stays cached
 
-  wattron(w, A_BOLD);
-  mvwprintw(w, 0, 2, " %s ", title);
-  wattroff(w, A_BOLD);
+typedef struct {
+  char cmd[160];
+  char user[32];
+  char cg[128];
+} TaskInfo;
 
-  char num[64];
-  snprintf(num, sizeof(num), "%.1f%s", latest, unit?unit:"");
-  mvwprintw(w, 0, MAX(2, W-(int)strlen(num)-2), "%s", num);
+typedef struct {
+  int pid;                      // 0 = empty slot
+  unsigned int comm_h;          // comm the result and info are for
+  unsigned int gen;             // filter generation of `match`, 0 = none
+  unsigned int seen;            // last pass that looked it up
+  char state;
+  unsigned char match;
+  unsigned char have_info;
+  TaskInfo *info;
+} FilterEnt;
 
-  int midy = y0 + ph/2;
-  for (int x=x0; x<=x1; x++) mvwaddch(w, midy, x, ACS_HLINE);
+typedef struct {
+  char text[64];                // as typed
+  int len;
+  const char *pat;              // text past the field prefix
+  int field;
+  regex_t re;
+  int have_re;                  // else a substring match on `pat`
+  unsigned int gen;             // bumped on every edit
+  unsigned int pass;
+  int local;
+  FilterEnt *e;
+  int nent, used;               // nent is a power of two
+  unsigned int uid[FILTER_UIDS];
+  char uname[FILTER_UIDS][32];
+  int nuid;
+} Filter;
+
+static int filter_on(const Filter *f) { return f && f->pat && *f->pat; }
+
+// Re-read `text` after an edit.
+static void filter_set(Filter *f) {
+  static const struct { const char *pfx; int field; } pf[] = {
+    { "comm:", FF_COMM }, { "cmd:", FF_CMD }, { "user:", FF_USER },
+    { "cg:", FF_CG }, { "state:", FF_STATE },
+  };
+  if (f->have_re) regfree(&f->re);
+  f->field = FF_ANY;
+  f->pat = f->text;
+  for (size_t i=0; i<sizeof(pf)/sizeof(pf[0]); i++) {
+    size_t n = strlen(pf[i].pfx);
+    if (strncmp(f->text, pf[i].pfx, n) == 0) { f->field = pf[i].field; f->pat = f->text + n; break; }
+  }
+  f->have_re = *f->pat && regcomp(&f->re, f->pat, REG_EXTENDED | REG_ICASE | REG_NOSUB) == 0;
+  if (++f->gen == 0) f->gen = 1;
+}
 
-  double range = vmax - vmin;
-  if (range <= 0.0001) range = 1.0;
+static void filter_free(Filter *f) {
+  if (f->have_re) regfree(&f->re);
+  for (int i=0; i<f->nent; i++) free(f->e[i].info);
+  free(f->e);
+  memset(f, 0, sizeof(*f));
+}
 
-  int prevx=-1, prevy=-1;
+static unsigned int str_hash(const char *s) {
+  unsigned int h = 2166136261u;
+  while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
 
-  if (color_pair > 0) wattron(w, COLOR_PAIR(color_pair));
+static const char *filter_user(Filter *f, unsigned int uid) {
+  for (int i=0; i<f->nuid; i++) if (f->uid[i] == uid) return f->uname[i];
+  int i = f->nuid < FILTER_UIDS ? f->nuid++ : (int)(uid % FILTER_UIDS);
+  struct passwd pw, *r = NULL;
+  char buf[1024];
+  f->uid[i] = uid;
+  if (getpwuid_r(uid, &pw, buf, sizeof(buf), &r) == 0 && r)
+    snprintf(f->uname[i], sizeof(f->uname[i]), "%s", r->pw_name);
+  else
+    snprintf(f->uname[i], sizeof(f->uname[i]), "%u", uid);
+  return f->uname[i];
+}
 
-  for (int col=0; col<n; col++) {
-    double val = hist_get_lastN(h, n, col);
-    double t = (val - vmin) / range;
-    if (t < 0) t = 0;
-    if (t > 1) t = 1;
+static int read_pid_file(int pid, const char *name, char *buf, int cap) {
+  char path[320];
+  snprintf(path, sizeof(path), "%s/%d/%s", g_proc_root, pid, name);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { buf[0] = '\0'; return 0; }
+  int n = fd_pread(fd, buf, cap);
+  close(fd);
+  return n;
+}
 
-    int y = y1 - (int)(t * (ph - 1) + 0.5);
-    int x = x0 + col;
+static void filter_info(Filter *f, int pid, TaskInfo *ti) {
+  char buf[4096];
+  memset(ti, 0, sizeof(*ti));
+  struct stat st;
+  snprintf(buf, sizeof(buf), "%s/%d", g_proc_root, pid);
+  if (stat(buf, &st) == 0) snprintf(ti->user, sizeof(ti->user), "%s", filter_user(f, st.st_uid));
+
+  // argv is NUL-separated; kernel threads have none.
+  int n = read_pid_file(pid, "cmdline", buf, sizeof(buf));
+  while (n > 0 && buf[n-1] == '\0') n--;
+  for (int i=0; i<n; i++) if (buf[i] == '\0') buf[i] = ' ';
+  buf[n] = '\0';
+  snprintf(ti->cmd, sizeof(ti->cmd), "%.*s", (int)sizeof(ti->cmd) - 1, buf);
+
+  // The last hierarchy listed; on cgroup v2 the only one ("0::/path").
+  n = read_pid_file(pid, "cgroup", buf, sizeof(buf));
+  while (n > 0 && buf[n-1] == '\n') buf[--n] = '\0';
+  char *ln = strrchr(buf, '\n');
+  ln = ln ? ln + 1 : buf;
+  char *p = strchr(ln, ':');
+  p = p ? strchr(p + 1, ':') : NULL;
+  snprintf(ti->cg, sizeof(ti->cg), "%.*s", (int)sizeof(ti->cg) - 1, p ? p + 1 : "");
+}
 
-    mvwaddch(w, y, x, 'o');
+// Rebuild the PID cache without the PIDs no recent pass has looked up,
+// growing it while it would still be over a quarter full.
+static void filter_rehash(Filter *f) {
+  int keep = 0;
+  for (int i=0; i<f->nent; i++)
+    if (f->e[i].pid && f->pass - f->e[i].seen <= FILTER_KEEP) keep++;
+  int n = 64;
+  while (n < (keep + 1) * 4) n *= 2;
+  FilterEnt *old = f->e;
+  int on = f->nent;
+  f->e = (FilterEnt*)calloc((size_t)n, sizeof(FilterEnt));
+  f->nent = n;
+  f->used = 0;
+  for (int i=0; i<on; i++) {
+    if (!old[i].pid) continue;
+    if (f->pass - old[i].seen > FILTER_KEEP) { free(old[i].info); continue; }
+    unsigned int h = ((unsigned int)old[i].pid * 2654435761u) & (unsigned int)(n - 1);
+    while (f->e[h].pid) h = (h + 1) & (unsigned int)(n - 1);
+    f->e[h] = old[i];
+    f->used++;
+  }
+  free(old);
+}
 
-    if (prevx >= 0) {
-      int dy = y - prevy;
-      int steps = abs(dy);
-      if (steps > 0) {
-        int dir = (dy > 0) ? 1 : -1;
-        for (int s=1; s<=steps; s++) {
-          int yy = prevy + s*dir;
-          mvwaddch(w, yy, x, ACS_VLINE);
-        }
-      }
-    }
-    prevx=x; prevy=y;
+static FilterEnt *filter_ent(Filter *f, int pid) {
+  if ((f->used + 1) * 2 > f->nent) filter_rehash(f);
+  unsigned int m = (unsigned int)(f->nent - 1);
+  unsigned int h = ((unsigned int)pid * 2654435761u) & m;
+  while (f->e[h].pid && f->e[h].pid != pid) h = (h + 1) & m;
+  FilterEnt *e = &f->e[h];
+  if (!e->pid) {
+    e->pid = pid;
+    f->used++;
   }
+  return e;
+}
 
-  if (color_pair > 0) wattroff(w, COLOR_PAIR(color_pair));
+static int filter_str(const Filter *f, const char *s) {
+  if (!*s) return 0;
+  if (f->have_re) return regexec(&f->re, s, 0, NULL, 0) == 0;
+  return strcasestr(s, f->pat) != NULL;
 }
 
-static void draw_dual_graph(WINDOW *w, const char *title,
-                            const Hist *a, const Hist *b,
-                            int count, double vmin, double vmax,
-                            int colorA, int colorB,
-                            const char *labelA, const char *labelB,
-                            const char *unit,
-                            const char *extraLine) {
-  int H, W;
-  getmaxyx(w, H, W);
-  box(w, 0, 0);
+// Call once before each walk over a table.
+static void filter_begin(Filter *f) { f->pass++; }
+
+static int filter_match(Filter *f, const ProcTrack *p) {
+  FilterEnt *e = filter_ent(f, p->pid);
+  unsigned int h = str_hash(p->comm);
+  e->seen = f->pass;
+  if (e->comm_h != h) { e->comm_h = h; e->gen = 0; e->have_info = 0; }
+  if (f->field == FF_STATE && e->state != p->state) e->gen = 0;
+  if (e->gen == f->gen) return e->match;
+
+  int want = f->field != FF_COMM && f->field != FF_STATE;
+  if (f->local && want && !e->have_info) {
+    if (!e->info) e->info = (TaskInfo*)malloc(sizeof(TaskInfo));
+    filter_info(f, p->pid, e->info);
+    e->have_info = 1;
+  }
+  const TaskInfo *ti = e->have_info ? e->info : NULL;
+  char st[2] = { p->state, '\0' };
+  int m = 0;
+  switch (f->field) {
+  case FF_COMM:  m = filter_str(f, p->comm); break;
+  case FF_STATE: m = filter_str(f, st); break;
+  case FF_CMD:   m = ti && filter_str(f, ti->cmd); break;
+  case FF_USER:  m = ti && filter_str(f, ti->user); break;
+  case FF_CG:    m = ti && filter_str(f, ti->cg); break;
+  default:
+    m = filter_str(f, p->comm) ||
+        (ti && (filter_str(f, ti->cmd) || filter_str(f, ti->user) || filter_str(f, ti->cg)));
+  }
+  e->gen = f->gen;
+  e->state = p->state;
+  e->match = (unsigned char)m;
+  return m;
+}
 
-  int x0=1, y0=1, x1=W-2, y1=H-2;
-  int pw = x1-x0+1, ph = y1-y0+1;
-  if (pw < 10 || ph < 4) return;
+// ---------------------------
+// Sockets (sock_diag)
+// ---------------------------
+// The NET panel's socket view. Every TCP socket, IPv4 and IPv6, comes from
+// one inet_diag dump: the legacy TCPDIAG_GETSOCK request covers both
+// families, and the kernel runs only one dump per netlink socket at a time,
+// so requests cannot be queued behind each other. UDP takes one dump per
+// family. TCP sockets rank by bytes acked + received since the last scan,
+// then by retransmits; UDP has no byte counters and ranks by queued bytes.
+//
+// Owners come from a socket inode -> PID index filled from /proc/<pid>/fd.
+// It is only walked when a dump turns up inodes it does not know, and then
+// only PIDs that are new or whose fd count changed are read. The count is
+// st_size of /proc/<pid>/fd, which needs Linux 6.2; older kernels report 0
+// there, so a 0 is checked by counting the entries instead: one getdents
+// per PID, still no readlink per fd. What is still unknown after that gets
+// one walk over every PID, at most every SOCK_FULL_SECS; inodes it does
+// not find either (kernel sockets, other users' processes) are left
+// unowned for good.
+#define SOCK_FULL_SECS 2.0
+#define SOCK_ROWS 64                  // ranked sockets that get a comm
+#define SOCK_BUF 32768
+
+// u32 -> int, open addressing with key 0 as the empty slot. `gen` is the
+// last scan that touched an entry; a rebuild drops what two scans missed.
+typedef struct {
+  unsigned int *k, *gen;
+  int *v;
+  int n, used;                        // n is a power of two
+} U32Map;
+
+static void u32map_free(U32Map *m) {
+  free(m->k); free(m->gen); free(m->v);
+  memset(m, 0, sizeof(*m));
+}
+
+static void u32map_clear(U32Map *m) {
+  if (m->k) memset(m->k, 0, sizeof(unsigned int) * (size_t)m->n);
+  m->used = 0;
+}
+
+static unsigned int u32map_home(const U32Map *m, unsigned int k) {
+  return (k * 2654435761u) & (unsigned int)(m->n - 1);
+}
+
+static int *u32map_find(U32Map *m, unsigned int k) {
+  if (!m->n) return NULL;
+  for (unsigned int h = u32map_home(m, k); m->k[h]; h = (h + 1) & (unsigned int)(m->n - 1))
+    if (m->k[h] == k) return &m->v[h];
+  return NULL;
+}
+
+static void u32map_rehash(U32Map *m, unsigned int gen) {
+  int keep = 0;
+  for (int i=0; i<m->n; i++) if (m->k[i] && m->gen[i] + 1 >= gen) keep++;
+  U32Map o = *m;
+  int n = 64;
+  while (n < (keep + 1) * 4) n *= 2;
+  m->n = n;
+  m->used = 0;
+  m->k = (unsigned int*)calloc((size_t)n, sizeof(unsigned int));
+  m->gen = (unsigned int*)malloc(sizeof(unsigned int) * (size_t)n);
+  m->v = (int*)malloc(sizeof(int) * (size_t)n);
+  for (int i=0; i<o.n; i++) {
+    if (!o.k[i] || o.gen[i] + 1 < gen) continue;
+    unsigned int h = u32map_home(m, o.k[i]);
+    while (m->k[h]) h = (h + 1) & (unsigned int)(n - 1);
+    m->k[h] = o.k[i]; m->gen[h] = o.gen[i]; m->v[h] = o.v[i];
+    m->used++;
+  }
+  free(o.k); free(o.gen); free(o.v);
+}
+
+// Entry for `k`, added with value `dflt` if absent; either way touched.
+static int *u32map_at(U32Map *m, unsigned int k, unsigned int gen, int dflt) {
+  if ((m->used + 1) * 2 > m->n) u32map_rehash(m, gen);
+  unsigned int h = u32map_home(m, k);
+  while (m->k[h] && m->k[h] != k) h = (h + 1) & (unsigned int)(m->n - 1);
+  if (!m->k[h]) { m->k[h] = k; m->v[h] = dflt; m->used++; }
+  m->gen[h] = gen;
+  return &m->v[h];
+}
+
+typedef struct {
+  unsigned int ino;
+  int pid;                            // owner, 0 when unknown
+  unsigned char proto, family, state;
+  unsigned char src[16], dst[16];
+  unsigned short sport, dport;
+  unsigned int rq, wq;                // queued bytes
+  unsigned long long acked, rcvd;     // TCP payload bytes, lifetime
+  unsigned int retrans;
+  double rx_s, tx_s, retr_s;          // since the last scan
+  char comm[16];
+} Sock;
+
+typedef struct {
+  int on;                             // scan only while the view is up
+  int fd;                             // NETLINK_SOCK_DIAG, -1 until needed
+  Sock *a, *old;                      // this scan, ranked; the last one
+  int n, nold, cap, capold;
+  U32Map prev;                        // inode -> index into `old`
+  U32Map owner;                       // inode -> PID, 0 pending, -1 none
+  U32Map fds;                         // PID -> fd count when last read
+  unsigned int gen, wgen, seq;        // scans, walks, netlink requests
+  int pending;
+  double t_last, t_full;
+  int n_tcp, n_udp, unowned;
+  char *buf;
+} Socks;
+
+static void socks_init(Socks *S) {
+  memset(S, 0, sizeof(*S));
+  S->fd = -1;
+}
+
+static void socks_free(Socks *S) {
+  if (S->fd >= 0) close(S->fd);
+  free(S->a); free(S->old); free(S->buf);
+  u32map_free(&S->prev); u32map_free(&S->owner); u32map_free(&S->fds);
+  socks_init(S);
+}
+
+// The kernel's struct tcp_info (linux/tcp.h) up to the byte counters,
+// spelled out rather than built on glibc's copy, which is shorter and free
+// to grow. Only the offsets below are read; they are the kernel ABI, and a
+// reply from an older kernel that ends before them leaves them 0.
+typedef struct {
+  unsigned char state, ca_state, retransmits, probes, backoff, options, wscale, flags;
+  unsigned int rto_to_rcv_space[23];
+  unsigned int total_retrans;
+  unsigned long long pacing_rate, max_pacing_rate, bytes_acked, bytes_received;
+} TcpInfo;
+_Static_assert(offsetof(TcpInfo, total_retrans) == 100, "tcpi_total_retrans");
+_Static_assert(offsetof(TcpInfo, bytes_acked) == 120, "tcpi_bytes_acked");
+_Static_assert(offsetof(TcpInfo, bytes_received) == 128, "tcpi_bytes_received");
+
+static void sock_add(Socks *S, int proto, const struct inet_diag_msg *d, int len) {
+  if (!d->idiag_inode) return;
+  if (S->n == S->cap) {
+    S->cap = S->cap ? S->cap * 2 : 256;
+    S->a = (Sock*)realloc(S->a, sizeof(Sock) * (size_t)S->cap);
+  }
+  Sock *s = &S->a[S->n++];
+  memset(s, 0, sizeof(*s));
+  s->ino = d->idiag_inode;
+  s->proto = (unsigned char)proto;
+  s->family = d->idiag_family;
+  s->state = d->idiag_state;
+  memcpy(s->src, d->id.idiag_src, 16);
+  memcpy(s->dst, d->id.idiag_dst, 16);
+  s->sport = ntohs(d->id.idiag_sport);
+  s->dport = ntohs(d->id.idiag_dport);
+  s->rq = d->idiag_rqueue;
+  s->wq = d->idiag_wqueue;
+  if (proto == IPPROTO_TCP) S->n_tcp++; else S->n_udp++;
+
+  const struct rtattr *a = (const struct rtattr*)(d + 1);
+  len -= (int)NLMSG_ALIGN(sizeof(*d));
+  for (; RTA_OK(a, len); a = RTA_NEXT(a, len)) {
+    if (a->rta_type != INET_DIAG_INFO) continue;
+    TcpInfo ti;
+    memset(&ti, 0, sizeof(ti));
+    memcpy(&ti, RTA_DATA(a), MIN(sizeof(ti), (size_t)RTA_PAYLOAD(a)));
+    s->acked = ti.bytes_acked;
+    s->rcvd = ti.bytes_received;
+    s->retrans = ti.total_retrans;
+  }
+}
+
+// One dump request; its replies are appended to S->a. Returns 0 on error.
+static int sock_dump(Socks *S, int type, const void *req, int rlen, int proto) {
+  struct { struct nlmsghdr h; unsigned char r[64]; } m;
+  memset(&m, 0, sizeof(m));
+  m.h.nlmsg_len = (unsigned int)NLMSG_LENGTH(rlen);
+  m.h.nlmsg_type = (unsigned short)type;
+  m.h.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  m.h.nlmsg_seq = ++S->seq;
+  memcpy(m.r, req, (size_t)rlen);
+  struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+  if (sendto(S->fd, &m, m.h.nlmsg_len, 0, (struct sockaddr*)&sa, sizeof(sa)) < 0) return 0;
+
+  for (;;) {
+    ssize_t n = recv(S->fd, S->buf, SOCK_BUF, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return 0;
+    int left = (int)n;
+    for (struct nlmsghdr *h = (struct nlmsghdr*)S->buf; NLMSG_OK(h, left); h = NLMSG_NEXT(h, left)) {
+      if (h->nlmsg_seq != S->seq) continue;
+      if (h->nlmsg_type == NLMSG_DONE) return 1;
+      if (h->nlmsg_type == NLMSG_ERROR) return 0;
+      sock_add(S, proto, (const struct inet_diag_msg*)NLMSG_DATA(h), (int)NLMSG_PAYLOAD(h, 0));
+    }
+  }
+}
+
+// Read the fds of PIDs that are new or whose fd count changed (every PID
+// when `full`), giving pending inodes their owner.
+static void socks_walk(Socks *S, int full) {
+  DIR *d = opendir(g_proc_root);
+  if (!d) return;
+  S->wgen++;
+  int pfd = dirfd(d);
+  struct dirent *de;
+  while (S->pending > 0 && (de = readdir(d))) {
+    if (!is_pid_dir(de->d_name)) continue;
+    char rel[300];
+    struct stat st;
+    snprintf(rel, sizeof(rel), "%s/fd", de->d_name);
+    if (fstatat(pfd, rel, &st, 0) != 0) continue;
+    int pid = atoi(de->d_name);
+    int *nfd = u32map_at(&S->fds, (unsigned int)pid, S->wgen, -1);
+    int n = (int)st.st_size;
+    if (!full && n > 0 && *nfd == n) continue;
+
+    int fdd = openat(pfd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *fdir = fdd >= 0 ? fdopendir(fdd) : NULL;
+    if (!fdir) { if (fdd >= 0) close(fdd); continue; }
+    struct dirent *fe;
+    if (n == 0) {                     // before 6.2, or really no fds
+      while ((fe = readdir(fdir))) n += fe->d_name[0] != '.';
+      if (!full && *nfd == n) { closedir(fdir); continue; }
+      rewinddir(fdir);
+    }
+    *nfd = n;
+    while ((fe = readdir(fdir))) {
+      char link[64];
+      ssize_t ln = readlinkat(dirfd(fdir), fe->d_name, link, sizeof(link) - 1);
+      if (ln < 9 || memcmp(link, "socket:[", 8) != 0) continue;
+      link[ln] = '\0';
+      int *o = u32map_find(&S->owner, (unsigned int)strtoul(link + 8, NULL, 10));
+      if (o && *o <= 0) { if (*o == 0) S->pending--; *o = pid; }
+    }
+    closedir(fdir);
+  }
+  closedir(d);
+}
+
+static int cmp_sock(const void *A, const void *B) {
+  const Sock *a = (const Sock*)A, *b = (const Sock*)B;
+  double ra = a->rx_s + a->tx_s, rb = b->rx_s + b->tx_s;
+  if (ra != rb) return ra < rb ? 1 : -1;
+  if (a->retr_s != b->retr_s) return a->retr_s < b->retr_s ? 1 : -1;
+  unsigned long long qa = (unsigned long long)a->rq + a->wq, qb = (unsigned long long)b->rq + b->wq;
+  if (qa != qb) return qa < qb ? 1 : -1;
+  return a->ino < b->ino ? -1 : a->ino > b->ino;
+}
+
+// `pt` (may be NULL) names the owners; the top SOCK_ROWS not in it read
+// /proc/<pid>/comm once per socket.
+static void socks_scan(Socks *S, ProcTable *pt) {
+  if (S->fd < 0) {
+    S->fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (S->fd < 0) return;
+    if (!S->buf) S->buf = (char*)malloc(SOCK_BUF);
+  }
+  double now = now_s();
+  double dt = S->t_last > 0 ? now - S->t_last : 0.0;
+  S->t_last = now;
+  S->gen++;
+
+  Sock *t = S->old; S->old = S->a; S->a = t;
+  int c = S->capold; S->capold = S->cap; S->cap = c;
+  S->nold = S->n;
+  S->n = S->n_tcp = S->n_udp = 0;
+
+  struct inet_diag_req tcp;
+  memset(&tcp, 0, sizeof(tcp));
+  tcp.idiag_family = AF_INET;
+  tcp.idiag_states = ~((1u << TCP_LISTEN) | (1u << TCP_TIME_WAIT) | (1u << TCP_CLOSE));
+  tcp.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+  sock_dump(S, TCPDIAG_GETSOCK, &tcp, sizeof(tcp), IPPROTO_TCP);
+  static const int fams[] = { AF_INET, AF_INET6 };
+  for (int i=0; i<2; i++) {
+    struct inet_diag_req_v2 udp;
+    memset(&udp, 0, sizeof(udp));
+    udp.sdiag_family = (unsigned char)fams[i];
+    udp.sdiag_protocol = IPPROTO_UDP;
+    udp.idiag_states = ~0u;
+    sock_dump(S, SOCK_DIAG_BY_FAMILY, &udp, sizeof(udp), IPPROTO_UDP);
+  }
+
+  // Rates against the last scan, and owners.
+  S->pending = 0;
+  for (int i=0; i<S->n; i++) {
+    Sock *s = &S->a[i];
+    int *pi = u32map_find(&S->prev, s->ino);
+    if (pi) {
+      Sock *o = &S->old[*pi];
+      if (dt > 0) {
+        if (s->acked >= o->acked) s->tx_s = (double)(s->acked - o->acked) / dt;
+        if (s->rcvd >= o->rcvd) s->rx_s = (double)(s->rcvd - o->rcvd) / dt;
+        if (s->retrans >= o->retrans) s->retr_s = (double)(s->retrans - o->retrans) / dt;
+      }
+      s->pid = o->pid;
+      memcpy(s->comm, o->comm, sizeof(s->comm));
+      o->ino = 0;                     // still open
+    }
+    if (*u32map_at(&S->owner, s->ino, S->gen, 0) == 0) S->pending++;
+  }
+  // A process that closed a socket may have opened the new ones without
+  // its fd count moving, so it is read again too.
+  for (int i=0; i<S->nold; i++)
+    if (S->old[i].ino && S->old[i].pid > 0) *u32map_at(&S->fds, (unsigned int)S->old[i].pid, S->wgen, -1) = -1;
+  if (S->pending > 0) socks_walk(S, 0);
+  if (S->pending > 0 && now - S->t_full >= SOCK_FULL_SECS) {
+    socks_walk(S, 1);
+    S->t_full = now;
+    for (int i=0; i<S->n; i++) {
+      int *o = u32map_find(&S->owner, S->a[i].ino);
+      if (o && *o == 0) *o = -1;
+    }
+  }
+  S->unowned = 0;
+  for (int i=0; i<S->n; i++) {
+    Sock *s = &S->a[i];
+    int *o = u32map_find(&S->owner, s->ino);
+    int pid = o && *o > 0 ? *o : 0;
+    if (pid != s->pid) { s->pid = pid; s->comm[0] = '\0'; }
+    if (!pid) S->unowned++;
+  }
+
+  qsort(S->a, (size_t)S->n, sizeof(Sock), cmp_sock);
+  u32map_clear(&S->prev);
+  for (int i=0; i<S->n; i++) *u32map_at(&S->prev, S->a[i].ino, S->gen, 0) = i;
+
+  for (int i=0; i<MIN(S->n, SOCK_ROWS); i++) {
+    Sock *s = &S->a[i];
+    if (!s->pid) continue;
+    ProcTrack *p = pt ? proctable_get(pt, s->pid) : NULL;
+    if (!p && s->comm[0]) continue;
+    if (p) { snprintf(s->comm, sizeof(s->comm), "%.15s", p->comm); continue; }
+    char buf[64];
+    int n = read_pid_file(s->pid, "comm", buf, sizeof(buf));
+    while (n > 0 && buf[n-1] == '\n') buf[--n] = '\0';
+    if (n > 0) { snprintf(s->comm, sizeof(s->comm), "%.15s", buf); continue; }
+    // The owner exited; the socket may live on in a child.
+    *u32map_at(&S->owner, s->ino, S->gen, 0) = 0;
+    s->pid = 0;
+  }
+}
+
+// ---------------------------
+// Fast sampler (--fast MS)
+// ---------------------------
+// A tick averages away bursts of a few tens of ms. With --fast a thread
+// reads /proc/stat through a persistent fd every MS and folds each core's
+// busy share over that window into a histogram, and the aggregate line's
+// into another; every tick takes their min, p50, p99 and max and starts
+// new ones. The CPU panel draws the per-core ones as bands. /proc/stat counts in USER_HZ ticks (10 ms at
+// the usual 100), so a core's window is only folded in once it has seen
+// one; shorter ones merge into the next instead of reading as 0 or 100%.
+#define FAST_MIN_MS 2
+#define FAST_MAX_MS 100
+
+typedef struct {
+  int ms;                       // period, 0 = off
+  int fd;
+  int ncpu;
+  char *buf;
+  int cap;
+  unsigned long long *prev_busy, *prev_tot;
+  pthread_t th;
+  int running;
+  pthread_mutex_t mu;
+  unsigned int bins[101];       // core windows by busy %, guarded by mu
+  unsigned int n;
+  unsigned long long all_busy, all_tot;
+  unsigned int abins[101];      // aggregate windows, guarded by mu
+  unsigned int an;
+  unsigned long long cpu_ns;    // the thread's own CPU time, guarded by mu
+  unsigned long long cpu_mark;
+  double wall_mark;
+  double lo, p50, p99, hi;      // the last tick that had windows
+  double a50, a99, ahi;         // the same for the aggregate
+} Fast;
+
+// Busy % of one cpu line over the window since it last moved, or -1 if it
+// has not seen a tick since (or this is its first read).
+static int fast_window(const unsigned long long *v, unsigned long long *prev_busy,
+                       unsigned long long *prev_tot) {
+  unsigned long long idle = v[3] + v[4];
+  unsigned long long busy = v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+  if (busy + idle <= *prev_tot) return -1;
+  int pct = -1;
+  if (*prev_tot) {
+    unsigned long long dt = busy + idle - *prev_tot;
+    unsigned long long db = busy >= *prev_busy ? busy - *prev_busy : 0;
+    pct = MIN(100, (int)((db * 100 + dt / 2) / dt));
+  }
+  *prev_busy = busy;
+  *prev_tot = busy + idle;
+  return pct;
+}
+
+// One read of /proc/stat, folded into the histograms.
+static void fast_sample(Fast *F) {
+  int len = fd_pread(F->fd, F->buf, F->cap);
+  if (len <= 0 || strncmp(F->buf, "cpu ", 4) != 0) return;
+  unsigned int add[101];
+  int nadd = 0;
+  memset(add, 0, sizeof(add));
+  unsigned long long v[8];
+  char *q = F->buf + 4;
+  for (int k=0; k<8; k++) v[k] = strtoull(q, &q, 10);
+  int all = fast_window(v, &F->all_busy, &F->all_tot);
+  char *p = strchr(q, '\n');
+  while (p && strncmp(p + 1, "cpu", 3) == 0) {
+    q = p + 4;
+    int i = (int)strtol(q, &q, 10);
+    for (int k=0; k<8; k++) v[k] = strtoull(q, &q, 10);
+    p = strchr(q, '\n');
+    if (i < 0 || i >= F->ncpu) continue;
+    int b = fast_window(v, &F->prev_busy[i], &F->prev_tot[i]);
+    if (b >= 0) { add[b]++; nadd++; }
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  pthread_mutex_lock(&F->mu);
+  for (int b=0; b<=100 && nadd; b++) F->bins[b] += add[b];
+  F->n += (unsigned int)nadd;
+  if (all >= 0) { F->abins[all]++; F->an++; }
+  F->cpu_ns = (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+  pthread_mutex_unlock(&F->mu);
+}
+
+static void *fast_main(void *arg) {
+  Fast *F = (Fast*)arg;
+  long period = (long)F->ms * 1000000L;
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (__atomic_load_n(&F->running, __ATOMIC_RELAXED)) {
+    next.tv_nsec += period;
+    while (next.tv_nsec >= 1000000000L) { next.tv_nsec -= 1000000000L; next.tv_sec++; }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {}
+    fast_sample(F);
+    // Fell behind (suspend, a stalled read): restart the schedule from now.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - next.tv_sec) * 1000000000L + (now.tv_nsec - next.tv_nsec) > period) next = now;
+  }
+  return NULL;
+}
+
+// 0 leaves it off. Returns 0 if the thread could not start.
+static int fast_start(Fast *F, int ms) {
+  memset(F, 0, sizeof(*F));
+  F->fd = -1;
+  if (ms <= 0) return 1;
+  long nc = sysconf(_SC_NPROCESSORS_CONF);
+  F->ncpu = (int)MAX(1, MIN(nc, 4096));
+  // The cpu lines come first; the rest of the file (interrupt counts) is
+  // never copied out.
+  F->cap = 256 + 192 * (F->ncpu + 1);
+  F->buf = (char*)malloc((size_t)F->cap);
+  F->prev_busy = (unsigned long long*)calloc((size_t)F->ncpu, sizeof(unsigned long long));
+  F->prev_tot = (unsigned long long*)calloc((size_t)F->ncpu, sizeof(unsigned long long));
+  if (proc_pread(&F->fd, "stat", F->buf, F->cap) <= 0) return 0;
+  pthread_mutex_init(&F->mu, NULL);
+  F->ms = MAX(FAST_MIN_MS, MIN(FAST_MAX_MS, ms));
+  F->wall_mark = now_s();
+  F->running = 1;
+  if (pthread_create(&F->th, NULL, fast_main, F) != 0) { F->running = 0; F->ms = 0; return 0; }
+  return 1;
+}
+
+static void fast_stop(Fast *F) {
+  if (F->running) {
+    __atomic_store_n(&F->running, 0, __ATOMIC_RELAXED);
+    pthread_join(F->th, NULL);
+    pthread_mutex_destroy(&F->mu);
+  }
+  if (F->fd >= 0) close(F->fd);
+  free(F->buf); free(F->prev_busy); free(F->prev_tot);
+  memset(F, 0, sizeof(*F));
+  F->fd = -1;
+}
+
+// Smallest busy % with at least `want` of the windows at or below it.
+static double fast_quantile(const unsigned int *bins, double want) {
+  unsigned long long acc = 0;
+  for (int b=0; b<=100; b++) {
+    acc += bins[b];
+    if ((double)acc >= want) return b;
+  }
+  return 100;
+}
+
+static void fast_take(Fast *F, Sample *s) {
+  s->fast_ms = F->ms;
+  if (!F->ms) return;
+  unsigned int bins[101], abins[101], n, an;
+  unsigned long long cpu;
+  pthread_mutex_lock(&F->mu);
+  memcpy(bins, F->bins, sizeof(bins));
+  memcpy(abins, F->abins, sizeof(abins));
+  n = F->n;
+  an = F->an;
+  cpu = F->cpu_ns;
+  memset(F->bins, 0, sizeof(F->bins));
+  memset(F->abins, 0, sizeof(F->abins));
+  F->n = F->an = 0;
+  pthread_mutex_unlock(&F->mu);
+
+  if (n > 0) {
+    F->lo = fast_quantile(bins, 1);
+    F->p50 = fast_quantile(bins, 0.50 * n);
+    F->p99 = fast_quantile(bins, 0.99 * n);
+    F->hi = fast_quantile(bins, n);
+  }
+  if (an > 0) {
+    F->a50 = fast_quantile(abins, 0.50 * an);
+    F->a99 = fast_quantile(abins, 0.99 * an);
+    F->ahi = fast_quantile(abins, an);
+  }
+  s->fast_n = (int)n;
+  s->cpu_lo = F->lo; s->cpu_p50 = F->p50; s->cpu_p99 = F->p99; s->cpu_hi = F->hi;
+  s->all_p50 = F->a50; s->all_p99 = F->a99; s->all_hi = F->ahi;
+  double wall = now_s();
+  if (wall > F->wall_mark) s->fast_cpu = (double)(cpu - F->cpu_mark) / 1e9 / (wall - F->wall_mark) * 100.0;
+  F->cpu_mark = cpu;
+  F->wall_mark = wall;
+}
+
+// ---------------------------
+// Collector (one tick of sampling)
+// ---------------------------
+// Everything a tick needs to carry over to the next one to turn counters
+// into rates. Each collect_* step fills its part of a Sample and can be
+// timed on its own by bench/.
+typedef struct {
+  unsigned long long prev_tot, prev_idle;
+
+  // Every device is tracked; iface/disk pick the one the panels show.
+  char iface[64];
+  int have_iface;
+  NetDev net[MAX_DEVS];
+  int n_net;
+  int have_prev_net;
+
+  char disk[64];
+  int have_disk;
+  DiskDev dsk[MAX_DEVS];
+  int n_dsk;
+  int have_prev_disk;
+
+  long hz;
+  ProcTable pt;
+  Threads thr;                  // threads of the PIDs expanded in TASKS
+  Filter *filter;               // TASKS filter to sort by, NULL to sort all
+  Socks socks;                  // NET socket view, scanned while it is up
+  Fast fast;                    // --fast sampler, started by the caller
+  Mounts mnt;                   // every filesystem; FS in the header is its "/"
+  unsigned int sort_gen;        // filter generation the table is sorted for
+  int fd_meminfo, fd_vmstat;
+  unsigned long long vm_prev[MK_N];
+  int have_prev_vm;
+  Sensors sens;
+  Perf perf;
+
+  int proc_every;               // rescan tasks every N ticks (the governor raises it)
+  int proc_wait;                // ticks until the next scan
+  double proc_dt;               // time since the last scan
+} Collector;
+
+static void collector_init(Collector *c) {
+  memset(c, 0, sizeof(*c));
+  read_cpu(&c->prev_tot, &c->prev_idle);
+  c->have_iface = choose_iface(c->iface, sizeof(c->iface));
+  c->have_disk = choose_disk(c->disk, sizeof(c->disk));
+  c->hz = sysconf(_SC_CLK_TCK);
+  if (c->hz <= 0) c->hz = 100;
+  proctable_init(&c->pt);
+  c->fd_meminfo = c->fd_vmstat = -1;
+  c->fast.fd = -1;
+  sensors_init(&c->sens);
+  perf_init(&c->perf);
+  socks_init(&c->socks);
+  mounts_init(&c->mnt);
+  c->proc_every = 1;
+}
+
+static void collector_free(Collector *c) {
+  proctable_free(&c->pt);
+  threads_free(&c->thr);
+  if (c->fd_meminfo >= 0) close(c->fd_meminfo);
+  if (c->fd_vmstat >= 0) close(c->fd_vmstat);
+  c->fd_meminfo = c->fd_vmstat = -1;
+  sensors_free(&c->sens);
+  perf_free(&c->perf);
+  socks_free(&c->socks);
+  mounts_free(&c->mnt);
+  fast_stop(&c->fast);
+}
+
+static void collect_cpu(Collector *c, Sample *s) {
+  unsigned long long tot=0, idle=0;
+  s->cpu_pct = 0.0;
+  if (read_cpu(&tot, &idle)) {
+    unsigned long long d_tot = tot - c->prev_tot;
+    unsigned long long d_idle = idle - c->prev_idle;
+    if (d_tot > 0) s->cpu_pct = (1.0 - (double)d_idle / (double)d_tot) * 100.0;
+    c->prev_tot = tot;
+    c->prev_idle = idle;
+  }
+}
+
+static void collect_load(Sample *s) {
+  s->l1 = s->l5 = s->l15 = 0;
+  read_load(&s->l1, &s->l5, &s->l15);
+}
+
+static double vm_rate(const Collector *c, const unsigned long long *v, int k, double dt) {
+  return v[k] > c->vm_prev[k] ? (double)(v[k] - c->vm_prev[k]) / dt : 0.0;
+}
+
+static void collect_mem(Collector *c, Sample *s, double dt) {
+  char buf[16384];
+  unsigned long long v[MK_N];
+  memset(v, 0, sizeof(v));
+  int n = proc_pread(&c->fd_meminfo, "meminfo", buf, sizeof(buf));
+  if (n > 0) mk_parse(buf, buf + n, v);
+  n = proc_pread(&c->fd_vmstat, "vmstat", buf, sizeof(buf));
+  if (n > 0) mk_parse(buf, buf + n, v);
+
+  s->memT = v[MK_MEMTOTAL];
+  s->memA = v[MK_MEMAVAILABLE];
+  double mem_used = (s->memT > s->memA) ? (double)(s->memT - s->memA) : 0.0;
+  s->mem_pct = (s->memT > 0) ? (mem_used / (double)s->memT) * 100.0 : 0.0;
+
+  s->memFree = v[MK_MEMFREE];
+  s->memAnon = v[MK_ANONPAGES];
+  s->memShmem = v[MK_SHMEM];
+  unsigned long long cache = v[MK_CACHED] + v[MK_BUFFERS];
+  s->memCache = cache > s->memShmem ? cache - s->memShmem : 0;
+  s->memSlab = v[MK_SLAB] ? v[MK_SLAB] : v[MK_SRECLAIMABLE] + v[MK_SUNRECLAIM];
+  s->memDirty = v[MK_DIRTY];
+  s->memWback = v[MK_WRITEBACK];
+  s->swapT = v[MK_SWAPTOTAL];
+  s->swapF = v[MK_SWAPFREE];
+  s->hugeT = v[MK_HUGEPAGES_TOTAL] * v[MK_HUGEPAGESIZE];
+  s->hugeF = v[MK_HUGEPAGES_FREE] * v[MK_HUGEPAGESIZE];
+  s->oomKills = v[MK_OOM_KILL];
+
+  s->majflt_s = s->pgscan_s = s->pgsteal_s = s->swpin_s = s->swpout_s = 0.0;
+  if (c->have_prev_vm && dt > 0) {
+    s->majflt_s = vm_rate(c, v, MK_PGMAJFAULT, dt);
+    s->pgscan_s = vm_rate(c, v, MK_PGSCAN_KSWAPD, dt) + vm_rate(c, v, MK_PGSCAN_DIRECT, dt) +
+                  vm_rate(c, v, MK_PGSCAN_KHUGEPAGED, dt);
+    s->pgsteal_s = vm_rate(c, v, MK_PGSTEAL_KSWAPD, dt) + vm_rate(c, v, MK_PGSTEAL_DIRECT, dt) +
+                   vm_rate(c, v, MK_PGSTEAL_KHUGEPAGED, dt);
+    s->swpin_s = vm_rate(c, v, MK_PSWPIN, dt);
+    s->swpout_s = vm_rate(c, v, MK_PSWPOUT, dt);
+  }
+  memcpy(c->vm_prev, v, sizeof(v));
+  c->have_prev_vm = 1;
+}
+
+static void collect_uptime(Sample *s) {
+  s->up = 0;
+  read_uptime(&s->up);
+}
+
+static void collect_temp(Collector *c, Sample *s) {
+  const Sensors *z = &c->sens;
+  s->tc = 0;
+  s->have_tc = 0;
+  s->hot = -1;
+  s->n_sens = MIN(z->nt, SENS_MAX);
+  s->sens_more = z->nt - s->n_sens;
+  int hot = -1;
+  float hot_c = 0.0f;
+  for (int i=0; i<z->nt; i++) {
+    long long mc = 0;
+    int ok = fd_long(z->t[i].fd, &mc);
+    float c = ok ? (float)mc / 1000.0f : 0.0f;
+    if (ok && (hot < 0 || c > hot_c)) { hot = i; hot_c = c; }
+    if (i < s->n_sens) {
+      memcpy(s->sens_name[i], z->t[i].name, sizeof(s->sens_name[i]));
+      s->sens_c[i] = c;
+    }
+  }
+  if (hot >= 0) {
+    // Past the cap, the hottest takes the last carried slot.
+    if (hot >= SENS_MAX) {
+      memcpy(s->sens_name[SENS_MAX - 1], z->t[hot].name, sizeof(s->sens_name[0]));
+      s->sens_c[SENS_MAX - 1] = hot_c;
+      hot = SENS_MAX - 1;
+    }
+    s->tc = hot_c;
+    s->have_tc = 1;
+    s->hot = hot;
+  }
+  s->n_freq = z->nf;
+  s->freq_max_mhz = (unsigned short)(z->fmax_khz / 1000);
+  for (int i=0; i<z->nf; i++) {
+    long long khz = 0;
+    s->freq_mhz[i] = fd_long(z->freq_fd[i], &khz) && khz > 0 ? (unsigned short)(khz / 1000) : 0;
+  }
+}
+
+static unsigned long long ctr_delta(unsigned long long cur, unsigned long long prev) {
+  return (cur >= prev) ? (cur - prev) : 0;
+}
+
+static void collect_perf(Collector *c, Sample *s, double dt) {
+  Perf *pf = &c->perf;
+  s->have_perf = 0;
+  s->n_pcpu = 0;
+  s->csw_s = s->mig_s = s->flt_s = s->ipc = s->miss_pct = 0.0;
+  if (pf->n == 0) return;
+  s->have_perf = pf->hw_n == PH_N ? 3 : pf->hw_n ? 2 : 1;
+  s->n_pcpu = pf->n;
+
+  unsigned long long sw[PS_N] = {0}, hw[PH_N] = {0};
+  for (int cpu=0; cpu<pf->n; cpu++) {
+    unsigned long long v[PH_N];
+    double d[PH_N] = {0};
+    int got = perf_read(pf->sw[cpu], v, PS_N);
+    for (int i=0; i<got; i++) {
+      d[i] = (double)ctr_delta(v[i], pf->prev_sw[cpu][i]);
+      pf->prev_sw[cpu][i] = v[i];
+    }
+    if (pf->have_prev && dt > 0) {
+      s->pc_csw[cpu] = (float)(d[PS_CSW] / dt);
+      for (int i=0; i<PS_N; i++) sw[i] += (unsigned long long)d[i];
+    } else {
+      s->pc_csw[cpu] = 0.0f;
+    }
+
+    memset(d, 0, sizeof(d));
+    got = perf_read(pf->hw[cpu], v, pf->hw_n);
+    for (int i=0; i<got; i++) {
+      d[i] = (double)ctr_delta(v[i], pf->prev_hw[cpu][i]);
+      pf->prev_hw[cpu][i] = v[i];
+    }
+    if (!pf->have_prev) memset(d, 0, sizeof(d));
+    s->pc_ipc[cpu] = d[PH_CYC] > 0 ? (float)(d[PH_INS] / d[PH_CYC]) : 0.0f;
+    s->pc_miss[cpu] = d[PH_REF] > 0 ? (float)(d[PH_MISS] / d[PH_REF] * 100.0) : 0.0f;
+    for (int i=0; i<PH_N; i++) hw[i] += (unsigned long long)d[i];
+  }
+  if (pf->have_prev && dt > 0) {
+    s->csw_s = (double)sw[PS_CSW] / dt;
+    s->mig_s = (double)sw[PS_MIG] / dt;
+    s->flt_s = (double)sw[PS_FLT] / dt;
+  }
+  if (hw[PH_CYC]) s->ipc = (double)hw[PH_INS] / (double)hw[PH_CYC];
+  if (hw[PH_REF]) s->miss_pct = (double)hw[PH_MISS] / (double)hw[PH_REF] * 100.0;
+  pf->have_prev = 1;
+}
+
+// Index of `name` in a device table (NetDev/DiskDev both start with it),
+// trying `hint` first since the kernel lists devices in a stable order.
+static int dev_find(const void *tab, size_t stride, int n, int hint, const char *name) {
+  const char *base = (const char*)tab;
+  if (hint < n && strcmp(base + (size_t)hint * stride, name) == 0) return hint;
+  for (int i=0; i<n; i++) if (strcmp(base + (size_t)i * stride, name) == 0) return i;
+  return -1;
+}
+
+// Disk rates (MB/s)
+static void collect_disk(Collector *c, Sample *s, double dt) {
+  s->disk_r_mbs = s->disk_w_mbs = 0.0;
+  s->busy_disk[0] = '\0';
+  s->busy_disk_mbs = 0.0;
+  s->have_disk = c->have_disk;
+  memcpy(s->disk, c->disk, sizeof(s->disk));
+
+  DiskDev cur[MAX_DEVS];
+  int n = read_disk_devs(cur, MAX_DEVS, c->have_disk ? c->disk : "");
+  if (n < 0) return;
+
+  for (int i=0; i<n; i++) {
+    DiskDev *d = &cur[i];
+    int j = c->have_prev_disk ? dev_find(c->dsk, sizeof(DiskDev), c->n_dsk, i, d->name) : -1;
+    if (j >= 0) {
+      double rBps = (double)ctr_delta(d->rdsec, c->dsk[j].rdsec) * 512.0 / dt;
+      double wBps = (double)ctr_delta(d->wrsec, c->dsk[j].wrsec) * 512.0 / dt;
+      d->r_mbs = rBps / (1024.0*1024.0);
+      d->w_mbs = wBps / (1024.0*1024.0);
+    }
+    if (c->have_disk && strcmp(d->name, c->disk) == 0) {
+      s->disk_r_mbs = d->r_mbs;
+      s->disk_w_mbs = d->w_mbs;
+    }
+    if (i == 0 || d->r_mbs + d->w_mbs > s->busy_disk_mbs) {
+      memcpy(s->busy_disk, d->name, sizeof(s->busy_disk));
+      s->busy_disk_mbs = d->r_mbs + d->w_mbs;
+    }
+  }
+  memcpy(c->dsk, cur, sizeof(DiskDev) * (size_t)n);
+  c->n_dsk = n;
+  c->have_prev_disk = 1;
+}
+
+// Net rates (MB/s) + errs/drops deltas
+static void collect_net(Collector *c, Sample *s, double dt) {
+  s->net_rx_mbs = s->net_tx_mbs = 0.0;
+  s->d_rxE = s->d_rxD = s->d_txE = s->d_txD = 0;
+  s->busy_nic[0] = '\0';
+  s->busy_nic_mbs = 0.0;
+  s->have_iface = c->have_iface;
+  memcpy(s->iface, c->iface, sizeof(s->iface));
+
+  NetDev cur[MAX_DEVS];
+  int n = read_net_devs(cur, MAX_DEVS);
+  if (n < 0) return;
+
+  for (int i=0; i<n; i++) {
+    NetDev *d = &cur[i];
+    int j = c->have_prev_net ? dev_find(c->net, sizeof(NetDev), c->n_net, i, d->name) : -1;
+    if (j >= 0) {
+      const NetDev *p = &c->net[j];
+      d->rx_mbs = ((double)ctr_delta(d->rxB, p->rxB) / dt) / (1024.0*1024.0);
+      d->tx_mbs = ((double)ctr_delta(d->txB, p->txB) / dt) / (1024.0*1024.0);
+      d->d_rxE = ctr_delta(d->rxE, p->rxE);
+      d->d_rxD = ctr_delta(d->rxD, p->rxD);
+      d->d_txE = ctr_delta(d->txE, p->txE);
+      d->d_txD = ctr_delta(d->txD, p->txD);
+    }
+    if (c->have_iface && strcmp(d->name, c->iface) == 0) {
+      s->net_rx_mbs = d->rx_mbs;
+      s->net_tx_mbs = d->tx_mbs;
+      s->d_rxE = d->d_rxE; s->d_rxD = d->d_rxD;
+      s->d_txE = d->d_txE; s->d_txD = d->d_txD;
+    }
+    if (strcmp(d->name, "lo") != 0 &&
+        (!s->busy_nic[0] || d->rx_mbs + d->tx_mbs > s->busy_nic_mbs)) {
+      memcpy(s->busy_nic, d->name, sizeof(s->busy_nic));
+      s->busy_nic_mbs = d->rx_mbs + d->tx_mbs;
+    }
+  }
+  memcpy(c->net, cur, sizeof(NetDev) * (size_t)n);
+  c->n_net = n;
+  c->have_prev_net = 1;
+}
+
+// Every mount; the header and the wire carry just /.
+static void collect_fs(Collector *c, Sample *s) {
+  mounts_tick(&c->mnt);
+  const MountRow *r = mounts_find(&c->mnt, "/");
+  s->have_fs = r && r->have;
+  s->fsPct = s->have_fs ? r->pct : 0.0;
+  s->inodePct = s->have_fs ? r->ipct : 0.0;
+  s->fsUsedB = s->have_fs ? r->used : 0;
+  s->fsTotB = s->have_fs ? r->tot : 0;
+}
+
+// Pi throttled
+static void collect_thr(Sample *s) {
+  s->thrFlags = 0;
+  s->have_thr = read_throttled(&s->thrFlags);
+}
+
+// Processes
+static void collect_procs(Collector *c, double dt) {
+  ProcTable *pt = &c->pt;
+  for (int i=0;i<pt->n;i++) pt->a[i].seen = 0;
+
+  DIR *d = opendir(g_proc_root);
+  if (d) {
+    struct dirent *de;
+    while ((de = readdir(d))) {
+      if (!is_pid_dir(de->d_name)) continue;
+      int pid = atoi(de->d_name);
+
+      char comm[64]; char state='?'; unsigned long long jiff=0;
+      if (!read_proc_stat(pid, comm, sizeof(comm), &state, &jiff)) continue;
+
+      ProcTrack *p = proctable_upsert(pt, pid);
+      p->seen = 1;
+      p->state = state;
+      strncpy(p->comm, comm, sizeof(p->comm)-1);
+      p->comm[sizeof(p->comm)-1] = '\0';
+
+      p->rss_bytes = read_proc_rss_bytes(pid);
+      track_cpu(p, jiff, c->hz, dt);
+    }
+    closedir(d);
+  }
+
+  proctable_prune_unseen(pt);
+}
+
+// With a filter, matching tasks move to the front and only they are
+// sorted; the rest is never shown.
+static void collect_sort(Collector *c) {
+  ProcTable *pt = &c->pt;
+  int n = pt->n;
+  if (filter_on(c->filter)) {
+    filter_begin(c->filter);
+    n = 0;
+    for (int i=0; i<pt->n; i++) {
+      if (!filter_match(c->filter, &pt->a[i])) continue;
+      ProcTrack tmp = pt->a[n];
+      pt->a[n++] = pt->a[i];
+      pt->a[i] = tmp;
+    }
+  }
+  qsort(pt->a, (size_t)n, sizeof(ProcTrack), cmp_proc_avg);
+  pt->stale = 1;
+  c->sort_gen = c->filter ? c->filter->gen : 0;
+}
+
+static void collector_tick(Collector *c, Sample *s, double dt) {
+  collect_cpu(c, s);
+  fast_take(&c->fast, s);
+  collect_load(s);
+  collect_mem(c, s, dt);
+  collect_uptime(s);
+  collect_temp(c, s);
+  collect_perf(c, s, dt);
+  collect_disk(c, s, dt);
+  collect_net(c, s, dt);
+  collect_fs(c, s);
+  collect_thr(s);
+  c->proc_dt += dt;
+  if (--c->proc_wait <= 0) {
+    collect_procs(c, c->proc_dt);
+    threads_scan(&c->thr, c->proc_dt);
+    collect_sort(c);
+    c->proc_dt = 0.0;
+    c->proc_wait = MAX(1, c->proc_every);
+  } else if (c->filter && c->sort_gen != c->filter->gen) {
+    collect_sort(c);              // the filter changed between scans
+  }
+  if (c->socks.on) socks_scan(&c->socks, &c->pt);
+}
+
+// ---------------------------
+// Bootstrap
+// ---------------------------
+// Every rate needs a previous reading, so a first tick a whole interval
+// after collector_init would show zeros until then. Instead boot takes a
+// baseline tick straight away and the caller's first real tick measures
+// over the BOOT_MS after it. The UI runs the baseline on a thread while it
+// brings up the terminal and lays out the panels.
+#define BOOT_MS 50
+
+typedef struct {
+  Collector *c;
+  int fast_ms;
+  int fast_ok, fast_err;        // fast_start's result, errno if it failed
+  double t;                     // when the baseline was taken
+  pthread_t th;
+  int threaded;
+} Boot;
+
+static void *boot_main(void *arg) {
+  Boot *b = (Boot*)arg;
+  collector_init(b->c);
+  b->fast_ok = fast_start(&b->c->fast, b->fast_ms);
+  b->fast_err = errno;
+  Sample s;
+  memset(&s, 0, sizeof(s));
+  // Stamped before the tick, as the main loop stamps t_cur: the rates read
+  // first, and the task scan can take far longer than BOOT_MS.
+  b->t = now_s();
+  collector_tick(b->c, &s, BOOT_MS / 1000.0);
+  return NULL;
+}
+
+// Leave `c` alone until boot_finish().
+static void boot_start(Boot *b, Collector *c, int fast_ms) {
+  memset(b, 0, sizeof(*b));
+  b->c = c;
+  b->fast_ms = fast_ms;
+  b->threaded = pthread_create(&b->th, NULL, boot_main, b) == 0;
+  if (!b->threaded) boot_main(b);
+}
+
+// Returns the time the first tick's dt counts from.
+static double boot_finish(Boot *b) {
+  if (b->threaded) pthread_join(b->th, NULL);
+  b->threaded = 0;
+  double wait = BOOT_MS / 1000.0 - (now_s() - b->t);
+  if (wait > 0) usleep((useconds_t)(wait * 1e6));
+  return b->t;
+}
+
+// ---------------------------
+// Overhead governor
+// ---------------------------
+// --budget PCT keeps sparta-mon's own CPU time (every thread, as a share of
+// one core) under PCT. Over budget it first rescans tasks less often, up to
+// every GOV_PROC_MAX ticks, then stretches the period towards MAX_DELAY_MS;
+// well under budget it gives both back in the reverse order. Each decision
+// averages over at least two task scans so their cost is always counted.
+#define GOV_PROC_MAX 8
+#define GOV_WINDOW 4            // minimum ticks per decision
+
+typedef struct {
+  double target;                // share of one core; 0 = governor off
+  double share;                 // measured over the last window
+  double cpu_mark, wall_mark;   // window start, wall_mark 0 = not started
+  int ticks;
+  int delay_ms;                 // period the governor wants, >= the user's
+} Governor;
+
+static double cpu_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void gov_init(Governor *g, double pct) {
+  memset(g, 0, sizeof(*g));
+  g->target = pct / 100.0;
+}
+
+// Call after each tick's work with the period the user asked for; returns
+// the period to sleep. `hold` (an anomaly recording owns the period) skips
+// the tick and restarts the window.
+static int gov_tick(Governor *g, Collector *c, int base_ms, int hold) {
+  if (g->target <= 0.0) return base_ms;
+  g->delay_ms = MAX(g->delay_ms, base_ms);
+  double cpu = cpu_s(), wall = now_s();
+  if (hold || g->wall_mark == 0.0) {
+    g->cpu_mark = cpu;
+    g->wall_mark = wall;
+    g->ticks = 0;
+    return g->delay_ms;
+  }
+  if (++g->ticks < MAX(GOV_WINDOW, 2 * c->proc_every) || wall <= g->wall_mark) return g->delay_ms;
+
+  g->share = (cpu - g->cpu_mark) / (wall - g->wall_mark);
+  if (g->share > g->target) {
+    if (c->proc_every < GOV_PROC_MAX) c->proc_every *= 2;
+    else {
+      // Cost per tick barely moves with the period, so scale it by the overshoot.
+      int want = (int)(g->delay_ms * MIN(2.0, g->share / g->target));
+      g->delay_ms = MIN(MAX_DELAY_MS, MAX(g->delay_ms + 50, want));
+    }
+  } else if (g->share < g->target * 0.5) {
+    if (g->delay_ms > base_ms) g->delay_ms = MAX(base_ms, g->delay_ms - MAX(50, g->delay_ms / 5));
+    else if (c->proc_every > 1) c->proc_every /= 2;
+  }
+  g->cpu_mark = cpu;
+  g->wall_mark = wall;
+  g->ticks = 0;
+  return g->delay_ms;
+}
+
+// ---------------------------
+// History rings for the graph panels
+// ---------------------------
+typedef struct {
+  Hist cpu, mem, temp;
+  Hist disk_r, disk_w;
+  Hist net_rx, net_tx;
+  Hist majflt, pgscan;          // MEM panel's faults/reclaim view, per second
+  Hist csw, mig, flt, ipc;      // perf_event counters, all CPUs
+  Hist cpu_lo, cpu_p50, cpu_p99, cpu_hi;  // --fast per-core busy % bands
+} HistSet;
+
+#define HISTSET_N ((int)(sizeof(HistSet) / sizeof(Hist)))
+
+static void histset_push(HistSet *h, const Sample *s) {
+  hist_push(&h->cpu, s->cpu_pct);
+  hist_push(&h->mem, s->mem_pct);
+  hist_push(&h->temp, s->have_tc ? s->tc : 0.0);
+  hist_push(&h->disk_r, s->disk_r_mbs);
+  hist_push(&h->disk_w, s->disk_w_mbs);
+  hist_push(&h->net_rx, s->net_rx_mbs);
+  hist_push(&h->net_tx, s->net_tx_mbs);
+  hist_push(&h->majflt, s->majflt_s);
+  hist_push(&h->pgscan, s->pgscan_s);
+  hist_push(&h->csw, s->csw_s);
+  hist_push(&h->mig, s->mig_s);
+  hist_push(&h->flt, s->flt_s);
+  hist_push(&h->ipc, s->ipc);
+  hist_push(&h->cpu_lo, s->cpu_lo);
+  hist_push(&h->cpu_p50, s->cpu_p50);
+  hist_push(&h->cpu_p99, s->cpu_p99);
+  hist_push(&h->cpu_hi, s->cpu_hi);
+}
+
+// ---------------------------
+// Formatting + graphs
+// ---------------------------
+// The render path formats through TextBuf: fixed-capacity buffers with
+// integer and fixed-point appenders, so a frame never allocates or goes
+// through the printf family.
+typedef struct {
+  char *p;
+  int len;
+  int cap;   // usable bytes, excluding the terminating NUL
+} TextBuf;
+
+static const char DIGITS2[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static void tb_init(TextBuf *b, char *mem, int size) {
+  b->p = mem;
+  b->len = 0;
+  b->cap = size - 1;
+  mem[0] = '\0';
+}
+
+static void tb_mem(TextBuf *b, const char *s, int n) {
+  if (n > b->cap - b->len) n = b->cap - b->len;
+  if (n > 0) { memcpy(b->p + b->len, s, (size_t)n); b->len += n; }
+  b->p[b->len] = '\0';
+}
+
+static void tb_str(TextBuf *b, const char *s) { tb_mem(b, s, (int)strlen(s)); }
+
+static void tb_strn(TextBuf *b, const char *s, int max) {
+  int n = 0;
+  while (n < max && s[n]) n++;
+  tb_mem(b, s, n);
+}
+
+static void tb_ch(TextBuf *b, char c) {
+  if (b->len < b->cap) b->p[b->len++] = c;
+  b->p[b->len] = '\0';
+}
+
+// Pad with spaces until the text written since `from` is `width` wide.
+static void tb_pad(TextBuf *b, int from, int width) {
+  while (b->len - from < width && b->len < b->cap) b->p[b->len++] = ' ';
+  b->p[b->len] = '\0';
+}
+
+// Right-align the text written since `from` in a field `width` wide.
+static void tb_rjust(TextBuf *b, int from, int width) {
+  int n = b->len - from;
+  int sh = width - n;
+  if (sh <= 0) return;
+  if (sh > b->cap - b->len) sh = b->cap - b->len;
+  memmove(b->p + from + sh, b->p + from, (size_t)n);
+  memset(b->p + from, ' ', (size_t)sh);
+  b->len += sh;
+  b->p[b->len] = '\0';
+}
+
+static void tb_u64(TextBuf *b, unsigned long long v) {
+  char tmp[24];
+  int i = sizeof(tmp);
+  while (v >= 100) {
+    unsigned d = (unsigned)(v % 100) * 2;
+    v /= 100;
+    tmp[--i] = DIGITS2[d + 1];
+    tmp[--i] = DIGITS2[d];
+  }
+  if (v >= 10) {
+    unsigned d = (unsigned)v * 2;
+    tmp[--i] = DIGITS2[d + 1];
+    tmp[--i] = DIGITS2[d];
+  } else {
+    tmp[--i] = (char)('0' + v);
+  }
+  tb_mem(b, tmp + i, (int)sizeof(tmp) - i);
+}
+
+static void tb_i64(TextBuf *b, long long v) {
+  if (v < 0) { tb_ch(b, '-'); tb_u64(b, 0ULL - (unsigned long long)v); }
+  else tb_u64(b, (unsigned long long)v);
+}
+
+static const long long POW10[] = { 1, 10, 100, 1000, 10000 };
+
+// Value scaled to `dec` decimals and rounded half away from zero; this is
+// also the key the render path compares to decide whether text changed.
+static long long fix_key(double v, int dec) {
+  double s = v * (double)POW10[dec];
+  if (!(s > -9e18 && s < 9e18)) s = 0.0; // NaN/inf
+  return (s < 0) ? -(long long)(-s + 0.5) : (long long)(s + 0.5);
+}
+
+static void tb_fixk(TextBuf *b, long long k, int dec) {
+  if (k < 0) { tb_ch(b, '-'); k = -k; }
+  tb_u64(b, (unsigned long long)(k / POW10[dec]));
+  if (dec > 0) {
+    char frac[4];
+    long long f = k % POW10[dec];
+    for (int i=dec-1; i>=0; i--) { frac[i] = (char)('0' + f % 10); f /= 10; }
+    tb_ch(b, '.');
+    tb_mem(b, frac, dec);
+  }
+}
+
+static void tb_fix(TextBuf *b, double v, int dec) { tb_fixk(b, fix_key(v, dec), dec); }
+
+// Byte counts as "%.1f" in the largest unit up to GB. The key packs unit and
+// tenths so callers can tell whether the printed value moved.
+static const char *const BYTE_UNITS[] = { "B", "KB", "MB", "GB" };
+
+static unsigned long long bytes_key(unsigned long long b) {
+  double v = (double)b;
+  unsigned long long u = 0;
+  while (u < 3 && v >= 1024) { v /= 1024; u++; }
+  return (u << 60) | (unsigned long long)fix_key(v, 1);
+}
+
+static void tb_bytes(TextBuf *b, unsigned long long bytes) {
+  unsigned long long k = bytes_key(bytes);
+  tb_fixk(b, (long long)(k & ((1ULL << 60) - 1)), 1);
+  tb_str(b, BYTE_UNITS[k >> 60]);
+}
+
+// Event counts and rates: whole numbers below 1000, then "%.1f" k/M/G.
+static void tb_count(TextBuf *b, double v) {
+  static const char UNITS[] = "kMG";
+  if (v < 999.5) { tb_fix(b, v, 0); return; }
+  int u = -1;
+  while (u < 2 && v >= 999.95) { v /= 1000.0; u++; }
+  tb_fix(b, v, 1);
+  tb_ch(b, UNITS[u]);
+}
+
+// ---------------------------
+// Panels (damage tracking)
+// ---------------------------
+// Each graph panel remembers what is already on screen: the chrome (box,
+// title, midline) is drawn once per resize, and the plot is redrawn one
+// column at a time, only where that column's glyphs differ from last frame.
+#define COL_EMPTY 0xffffffffffffffffULL
+
+typedef struct {
+  WINDOW *w;
+  int chrome;                   // box/title/midline drawn for this geometry
+  char label[128];              // right-aligned title text on screen
+  char extra[160];              // info line or bar signature on screen (row 1)
+  char foot[160];               // text on the bottom border
+  cchar_t *bg1;                 // row 1 background under the plot
+  int colorA, colorB;
+  double vmin, vmax;
+  unsigned long long key[HIST_MAX]; // per-column glyph key, COL_EMPTY if blank
+} Panel;
+
+typedef struct {
+  WINDOW *w;
+  int chrome;
+  int nrows;
+  char (*text)[512];            // row text on screen
+  int *attr;
+} TextPanel;
+
+static void panel_attach(Panel *p, WINDOW *w) {
+  int H, W;
+  getmaxyx(w, H, W);
+  (void)H;
+  p->w = w;
+  p->chrome = 0;
+  free(p->bg1);
+  p->bg1 = (cchar_t*)calloc((size_t)W + 1, sizeof(cchar_t));
+}
+
+static void panel_free(Panel *p) {
+  free(p->bg1);
+  p->bg1 = NULL;
+}
+
+static void textpanel_attach(TextPanel *t, WINDOW *w) {
+  int H, W;
+  getmaxyx(w, H, W);
+  (void)W;
+  t->w = w;
+  t->chrome = 0;
+  t->nrows = H;
+  free(t->text);
+  free(t->attr);
+  t->text = calloc((size_t)H, sizeof(*t->text));
+  t->attr = calloc((size_t)H, sizeof(*t->attr));
+}
+
+static void textpanel_free(TextPanel *t) {
+  free(t->text); t->text = NULL;
+  free(t->attr); t->attr = NULL;
+  t->nrows = 0;
+}
+
+// Print a row padded to `width` columns, but only if it changed.
+static void textpanel_row(TextPanel *t, int y, int x, int width,
+                          const char *s, int attr) {
+  if (y < 0 || y >= t->nrows || width <= 0) return;
+  if (t->attr[y] == attr && strcmp(t->text[y], s) == 0) return;
+  TextBuf b;
+  tb_init(&b, t->text[y], (int)sizeof(t->text[y]));
+  tb_str(&b, s);
+  t->attr[y] = attr;
+  int n = MIN(b.len, width);
+  if (attr) wattron(t->w, attr);
+  mvwaddnstr(t->w, y, x, s, n);
+  if (n < width) mvwhline(t->w, y, x + n, ' ', width - n);
+  if (attr) wattroff(t->w, attr);
+}
+
+static void textpanel_clear_rows(TextPanel *t) {
+  for (int y=0; y<t->nrows; y++) { t->text[y][0] = '\0'; t->attr[y] = -1; }
+}
+
+static unsigned long long graph_key(int ya, int pya, int yb, int pyb) {
+  return  (unsigned long long)(unsigned short)ya
+       | ((unsigned long long)(unsigned short)pya << 16)
+       | ((unsigned long long)(unsigned short)yb  << 32)
+       | ((unsigned long long)(unsigned short)pyb << 48);
+}
+
+static int graph_y(double val, double vmin, double range, int y1, int ph) {
+  double t = (val - vmin) / range;
+  if (t < 0) t = 0;
+  if (t > 1) t = 1;
+  return y1 - (int)(t * (ph - 1) + 0.5);
+}
+
+// Top of a rate graph: the peak of the `count` samples on screen plus 10%,
+// rounded up to 1, 2 or 5 x 10^k and at least `least`. It moves only when
+// a new peak arrives or the old one scrolls off, so the plot neither
+// rescales every tick nor clips earlier spikes.
+static double graph_scale(const Hist *a, const Hist *b, int count, double least) {
+  float lo, hi;
+  double peak = 0.0;
+  if (hist_range(a, count, &lo, &hi)) peak = hi;
+  if (b && hist_range(b, count, &lo, &hi)) peak = MAX(peak, hi);
+  double want = MAX(least, peak * 1.1);
+  if (want <= 0.0) return 1.0;
+  double d = 1.0;
+  while (d * 10.0 <= want) d *= 10.0;
+  while (d > want) d /= 10.0;
+  if (want <= d) return d;
+  if (want <= 2.0 * d) return 2.0 * d;
+  if (want <= 5.0 * d) return 5.0 * d;
+  return 10.0 * d;
+}
+
+// Glyph of one series at row y: 'o' on a flat step, a vertical run from the
+// previous column's row (exclusive) to this one (inclusive) otherwise.
+static int series_at(int y, int ys, int pys) {
+  if (ys < 0) return 0;
+  if (pys < 0 || pys == ys) return (y == ys) ? 'o' : 0;
+  if (pys < ys) return (y > pys && y <= ys) ? '|' : 0;
+  return (y < pys && y >= ys) ? '|' : 0;
+}
+
+static void graph_draw_col(Panel *p, int x, int y0, int y1, int midy,
+                           int ya, int pya, int yb, int pyb) {
+  WINDOW *w = p->w;
+  chtype ca = p->colorA > 0 ? COLOR_PAIR(p->colorA) : 0;
+  chtype cb = p->colorB > 0 ? COLOR_PAIR(p->colorB) : 0;
+
+  for (int y=y0; y<=y1; y++) {
+    int ga = series_at(y, ya, pya);
+    int gb = series_at(y, yb, pyb);
+    chtype c = 0;
+
+    if (gb && y == yb) c = (ga == 'o' ? 'X' : '*') | cb;
+    else if (gb && ga == 'o') c = 'X' | cb;
+    else if (ga) c = (ga == 'o' ? 'o' : ACS_VLINE) | ca;
+    else if (gb) c = ACS_VLINE | cb;
+
+    if (c) mvwaddch(w, y, x, c);
+    else if (y == midy) mvwaddch(w, y, x, ACS_HLINE);
+    else if (y == 1 && p->bg1) mvwadd_wch(w, y, x, &p->bg1[x]);
+    else mvwaddch(w, y, x, ' ');
+  }
+}
+
+// Draw box, title, label and info line as needed. A NULL `extra` leaves row 1
+// to the caller (see graph_bar). Returns 0 when the window is too small to
+// hold a plot.
+static int graph_frame(Panel *p, const char *title, const char *label,
+                       const char *extra) {
+  WINDOW *w = p->w;
+  int H, W;
+  getmaxyx(w, H, W);
+
+  int fresh = 0;
+  if (!p->chrome) {
+    werase(w);
+    box(w, 0, 0);
+    p->extra[0] = '\0';
+    p->foot[0] = '\0';
+    p->chrome = 1;
+    for (int i=0; i<HIST_MAX; i++) p->key[i] = COL_EMPTY;
+
+    int x0=1, y0=1, x1=W-2, y1=H-2;
+    int pw = x1-x0+1, ph = y1-y0+1;
+    if (pw >= 10 && ph >= 4) {
+      int midy = y0 + ph/2;
+      mvwhline(w, midy, x0, ACS_HLINE, pw);
+    }
+    if (p->bg1) mvwin_wchnstr(w, 1, 0, p->bg1, W);
+    fresh = 1;
+  }
+
+  if (fresh || strcmp(p->label, label) != 0) {
+    mvwhline(w, 0, 1, ACS_HLINE, W-2);
+    wattron(w, A_BOLD);
+    mvwprintw(w, 0, 2, " %s ", title);
+    wattroff(w, A_BOLD);
+    mvwprintw(w, 0, MAX(2, W-(int)strlen(label)-2), "%s", label);
+    snprintf(p->label, sizeof(p->label), "%s", label);
+  }
+
+  if (W-2 < 10 || H-2 < 4) return 0;
+
+  if (H < 6) extra = "";
+  if (extra && strcmp(p->extra, extra) != 0) {
+    mvwhline(w, 1, 1, ' ', W-2);
+    if (*extra) mvwprintw(w, 1, 2, "%.*s", W-4, extra);
+    snprintf(p->extra, sizeof(p->extra), "%s", extra);
+    if (p->bg1) mvwin_wchnstr(w, 1, 0, p->bg1, W);
+    for (int i=0; i<HIST_MAX; i++) p->key[i] = COL_EMPTY;
+  }
+  return 1;
+}
+
+// One slice of a stacked bar; `v` is in the same unit as the bar total.
+typedef struct {
+  const char *name;
+  unsigned long long v;
+  int color;                    // colour pair, 0 for the unfilled remainder
+} BarSeg;
+
+// Row 1 as a stacked bar in place of the info line. Widths use cumulative
+// rounding so they always add up to the bar; each slice is labelled when its
+// name and size fit inside it. Row 1 is only repainted when a width, label
+// or the colour mode changes, and the plot's row 1 background follows it.
+static void graph_bar(Panel *p, const BarSeg *seg, int n, unsigned long long total,
+                      int use_color) {
+  int H, W;
+  getmaxyx(p->w, H, W);
+  if (H < 6 || W < 14 || total == 0) return;
+  int bw = W - 4;
+
+  char sig[160];
+  char lab[12][32];
+  int x[13];
+  TextBuf sb;
+  tb_init(&sb, sig, sizeof(sig));
+  tb_ch(&sb, use_color ? 'c' : 'm');
+  unsigned long long acc = 0;
+  x[0] = 0;
+  for (int i=0; i<n && i<12; i++) {
+    acc += seg[i].v;
+    int end = (int)((double)MIN(acc, total) / (double)total * bw + 0.5);
+    x[i+1] = MAX(x[i], end);
+    if (i == n-1) x[i+1] = bw;
+    TextBuf lb;
+    tb_init(&lb, lab[i], sizeof(lab[i]));
+    tb_str(&lb, seg[i].name); tb_ch(&lb, ' '); tb_bytes(&lb, seg[i].v);
+    if (lb.len + 2 > x[i+1] - x[i]) {
+      tb_init(&lb, lab[i], sizeof(lab[i]));
+      if ((int)strlen(seg[i].name) + 2 <= x[i+1] - x[i]) tb_str(&lb, seg[i].name);
+    }
+    tb_i64(&sb, x[i+1]); tb_ch(&sb, ':'); tb_str(&sb, lab[i]); tb_ch(&sb, ';');
+  }
+  if (strcmp(p->extra, sig) == 0) return;
+
+  WINDOW *w = p->w;
+  mvwhline(w, 1, 1, ' ', W-2);
+  for (int i=0; i<n && i<12; i++) {
+    int len = x[i+1] - x[i];
+    if (len <= 0) continue;
+    chtype a = seg[i].color ? A_REVERSE : A_DIM;
+    if (use_color && seg[i].color) a |= COLOR_PAIR(seg[i].color);
+    wattron(w, a);
+    mvwhline(w, 1, 2 + x[i], ' ', len);
+    if (lab[i][0]) mvwaddstr(w, 1, 2 + x[i] + 1, lab[i]);
+    wattroff(w, a);
+  }
+  snprintf(p->extra, sizeof(p->extra), "%s", sig);
+  if (p->bg1) mvwin_wchnstr(w, 1, 0, p->bg1, W);
+  for (int i=0; i<HIST_MAX; i++) p->key[i] = COL_EMPTY;
+}
+
+// Text set into the bottom border, redrawn only when it changes.
+static void graph_footer(Panel *p, const char *text) {
+  if (strcmp(p->foot, text) == 0) return;
+  int H, W;
+  getmaxyx(p->w, H, W);
+  mvwhline(p->w, H-1, 1, ACS_HLINE, W-2);
+  if (*text && W > 8) mvwprintw(p->w, H-1, 2, " %.*s ", W-6, text);
+  snprintf(p->foot, sizeof(p->foot), "%s", text);
+}
+
+// In sweep mode (the default) samples stay where they were drawn and a write
+// head wraps around the plot, leaving a one-column gap in front of it, so
+// each tick only touches two columns on the terminal. In scroll mode ('w')
+// the newest sample is in the rightmost column and the plot shifts left
+// every tick, which rewrites every column: ncurses only turns a shift into
+// delete-character when the line's end moves, and a plot usually has
+// another panel to its right.
+static int g_sweep = 1;
+
+static void graph_plot(Panel *p, const Hist *a, const Hist *b, int count,
+                       double vmin, double vmax, int colorA, int colorB) {
+  WINDOW *w = p->w;
+  int H, W;
+  getmaxyx(w, H, W);
+
+  int x0=1, y0=1, x1=W-2, y1=H-2;
+  int pw = x1-x0+1, ph = y1-y0+1;
+  int midy = y0 + ph/2;
+
+  int n = MIN(count, pw);
+  n = MIN(n, a->len);
+  if (b) n = MIN(n, b->len);
+
+  double range = vmax - vmin;
+  if (range <= 0.0001) range = 1.0;
+
+  // A colour or scale change invalidates every column.
+  if (p->colorA != colorA || p->colorB != colorB ||
+      p->vmin != vmin || p->vmax != vmax) {
+    p->colorA = colorA; p->colorB = colorB;
+    p->vmin = vmin; p->vmax = vmax;
+    for (int i=0; i<HIST_MAX; i++) p->key[i] = COL_EMPTY;
+  }
+
+  int cols = MIN(pw, HIST_MAX);
+  int cur = (int)((a->seq + (unsigned long long)cols - 1) % (unsigned long long)cols);
+
+  int pya=-1, pyb=-1;
+  for (int col=0; col<cols; col++) {
+    int ya=-1, yb=-1;
+    unsigned long long k = COL_EMPTY;
+    int idx = col;  // index into the last n samples, oldest first
+    if (g_sweep) {
+      int age = (cur - col + cols) % cols;
+      idx = (age < n && age != cols - 1) ? n - 1 - age : -1;
+      if (col == 0) { pya = -1; pyb = -1; }
+    }
+    if (idx >= 0 && idx < n) {
+      ya = graph_y(hist_get_lastN(a, n, idx), vmin, range, y1, ph);
+      if (b) yb = graph_y(hist_get_lastN(b, n, idx), vmin, range, y1, ph);
+      k = graph_key(ya, pya, yb, pyb);
+    }
+    if (k != p->key[col]) {
+      graph_draw_col(p, x0 + col, y0, y1, midy, ya, pya, yb, pyb);
+      p->key[col] = k;
+    }
+    pya = ya; pyb = yb;
+  }
+}
+
+// Glyphs of one band column: '|' from min to p99, ':' on up to max, and
+// 'o' at p50. ylo < 0 leaves the column blank.
+static void graph_band_col(Panel *p, int x, int y0, int y1, int midy,
+                           int ylo, int y50, int y99, int yhi) {
+  WINDOW *w = p->w;
+  chtype ca = p->colorA > 0 ? COLOR_PAIR(p->colorA) : 0;
+  chtype cb = p->colorB > 0 ? COLOR_PAIR(p->colorB) : 0;
+  for (int y=y0; y<=y1; y++) {
+    chtype c = 0;
+    if (ylo >= 0) {
+      if (y == y50) c = 'o' | ca | A_BOLD;
+      else if (y >= y99 && y <= ylo) c = ACS_VLINE | ca;
+      else if (y >= yhi && y < y99) c = ':' | cb;
+    }
+    if (c) mvwaddch(w, y, x, c);
+    else if (y == midy) mvwaddch(w, y, x, ACS_HLINE);
+    else if (y == 1 && p->bg1) mvwadd_wch(w, y, x, &p->bg1[x]);
+    else mvwaddch(w, y, x, ' ');
+  }
+}
+
+// graph_plot for a distribution per sample: each column spans the min..max
+// of its tick, with the same scrolling, sweep and damage tracking.
+static void graph_bands(Panel *p, const Hist *lo, const Hist *p50, const Hist *p99,
+                        const Hist *hi, int count, double vmin, double vmax,
+                        int colorA, int colorB) {
+  int H, W;
+  getmaxyx(p->w, H, W);
+  int x0=1, y0=1, x1=W-2, y1=H-2;
+  int pw = x1-x0+1, ph = y1-y0+1;
+  int midy = y0 + ph/2;
+  int n = MIN(MIN(count, pw), lo->len);
+  double range = vmax - vmin;
+  if (range <= 0.0001) range = 1.0;
+
+  if (p->colorA != colorA || p->colorB != colorB ||
+      p->vmin != vmin || p->vmax != vmax) {
+    p->colorA = colorA; p->colorB = colorB;
+    p->vmin = vmin; p->vmax = vmax;
+    for (int i=0; i<HIST_MAX; i++) p->key[i] = COL_EMPTY;
+  }
+
+  int cols = MIN(pw, HIST_MAX);
+  int cur = (int)((lo->seq + (unsigned long long)cols - 1) % (unsigned long long)cols);
+  for (int col=0; col<cols; col++) {
+    int idx = col;
+    if (g_sweep) {
+      int age = (cur - col + cols) % cols;
+      idx = (age < n && age != cols - 1) ? n - 1 - age : -1;
+    }
+    int ylo = -1, y50 = -1, y99 = -1, yhi = -1;
+    unsigned long long k = COL_EMPTY;
+    if (idx >= 0 && idx < n) {
+      ylo = graph_y(hist_get_lastN(lo, n, idx), vmin, range, y1, ph);
+      y50 = graph_y(hist_get_lastN(p50, n, idx), vmin, range, y1, ph);
+      y99 = graph_y(hist_get_lastN(p99, n, idx), vmin, range, y1, ph);
+      yhi = graph_y(hist_get_lastN(hi, n, idx), vmin, range, y1, ph);
+      // The top bit keeps band keys apart from graph_plot's.
+      k = graph_key(ylo | 0x8000, y50, y99, yhi);
+    }
+    if (k != p->key[col]) {
+      graph_band_col(p, x0 + col, y0, y1, midy, ylo, y50, y99, yhi);
+      p->key[col] = k;
+    }
+  }
+}
+
+static void draw_dual_graph(Panel *p, const char *title,
+                            const Hist *a, const Hist *b,
+                            int count, double vmin, double vmax,
+                            int colorA, int colorB,
+                            const char *labelA, const char *labelB,
+                            const char *unit,
+                            const char *extraLine) {
+  char top[128];
+  TextBuf t;
+  tb_init(&t, top, sizeof(top));
+  tb_str(&t, labelA); tb_ch(&t, ' ');
+  tb_fix(&t, hist_get_latest(a), 1);
+  if (unit) tb_str(&t, unit);
+  tb_str(&t, "  ");
+  tb_str(&t, labelB); tb_ch(&t, ' ');
+  tb_fix(&t, hist_get_latest(b), 1);
+  if (unit) tb_str(&t, unit);
+  if (!graph_frame(p, title, top, extraLine)) return;
+  graph_plot(p, a, b, count, vmin, vmax, colorA, colorB);
+}
+
+// ---------------------------
+// Frame text
+// ---------------------------
+// Header and TASKS text is kept per field: a field is only re-formatted when
+// its value changes at display precision, and a line is only re-assembled
+// when one of its fields did.
+typedef struct {
+  long long key;
+  int valid;
+  int len;
+  char s[32];
+} TextField;
+
+static int field_fix(TextField *f, double v, int dec, const char *suffix) {
+  long long k = fix_key(v, dec);
+  if (f->valid && f->key == k) return 0;
+  TextBuf b;
+  tb_init(&b, f->s, sizeof(f->s));
+  tb_fixk(&b, k, dec);
+  if (suffix) tb_str(&b, suffix);
+  f->key = k;
+  f->valid = 1;
+  f->len = b.len;
+  return 1;
+}
+
+static int field_bytes(TextField *f, unsigned long long v) {
+  long long k = (long long)bytes_key(v);
+  if (f->valid && f->key == k) return 0;
+  TextBuf b;
+  tb_init(&b, f->s, sizeof(f->s));
+  tb_bytes(&b, v);
+  f->key = k;
+  f->valid = 1;
+  f->len = b.len;
+  return 1;
+}
+
+typedef struct {
+  TextField cpu, mem, l1, l5, l15, temp;
+  TextField fsPct, fsUsed, fsTot, ino;
+  int flags;                // which optional parts the line was built with
+  unsigned int thrFlags;
+  char thr[128];
+  char line[512];
+  int len;
+} HeaderText;
+
+#define HDR_BUILT 1
+#define HDR_TC    2
+#define HDR_FS    4
+#define HDR_THR   8
+
+// Refresh the status line from `s`. Returns 1 if its text changed.
+static int header_format(HeaderText *h, const Sample *s) {
+  int flags = HDR_BUILT | (s->have_tc ? HDR_TC : 0) |
+              (s->have_fs ? HDR_FS : 0) | (s->have_thr ? HDR_THR : 0);
+  int dirty = (flags != h->flags);
+
+  dirty |= field_fix(&h->cpu, s->cpu_pct, 1, "%");
+  dirty |= field_fix(&h->mem, s->mem_pct, 1, "%");
+  dirty |= field_fix(&h->l1, s->l1, 2, NULL);
+  dirty |= field_fix(&h->l5, s->l5, 2, NULL);
+  dirty |= field_fix(&h->l15, s->l15, 2, NULL);
+  if (s->have_tc) dirty |= field_fix(&h->temp, s->tc, 1, "C");
+  if (s->have_fs) {
+    dirty |= field_fix(&h->fsPct, s->fsPct, 1, "%");
+    dirty |= field_bytes(&h->fsUsed, s->fsUsedB);
+    dirty |= field_bytes(&h->fsTot, s->fsTotB);
+    dirty |= field_fix(&h->ino, s->inodePct, 1, "%");
+  }
+  if (s->have_thr && (!(h->flags & HDR_THR) || h->thrFlags != s->thrFlags)) {
+    throttled_summary(s->thrFlags, h->thr, sizeof(h->thr));
+    h->thrFlags = s->thrFlags;
+    dirty = 1;
+  }
+  h->flags = flags;
+  if (!dirty) return 0;
+
+  TextBuf b;
+  tb_init(&b, h->line, sizeof(h->line));
+  tb_str(&b, "CPU ");    tb_mem(&b, h->cpu.s, h->cpu.len);
+  tb_str(&b, " MEM ");   tb_mem(&b, h->mem.s, h->mem.len);
+  tb_str(&b, " LOAD ");  tb_mem(&b, h->l1.s, h->l1.len);
+  tb_ch(&b, ' ');        tb_mem(&b, h->l5.s, h->l5.len);
+  tb_ch(&b, ' ');        tb_mem(&b, h->l15.s, h->l15.len);
+  tb_str(&b, " TEMP ");
+  if (s->have_tc) tb_mem(&b, h->temp.s, h->temp.len);
+  else tb_str(&b, "n/a");
+  tb_str(&b, "  FS / ");
+  if (s->have_fs) {
+    tb_mem(&b, h->fsPct.s, h->fsPct.len);
+    tb_str(&b, " (");    tb_mem(&b, h->fsUsed.s, h->fsUsed.len);
+    tb_ch(&b, '/');      tb_mem(&b, h->fsTot.s, h->fsTot.len);
+    tb_str(&b, ") INO "); tb_mem(&b, h->ino.s, h->ino.len);
+  } else {
+    tb_str(&b, "n/a");
+  }
+  tb_str(&b, "  ");
+  tb_str(&b, s->have_thr ? h->thr : "PWR n/a");
+  tb_str(&b, "  IF ");   tb_str(&b, s->have_iface ? s->iface : "n/a");
+  tb_str(&b, " DK ");    tb_str(&b, s->have_disk ? s->disk : "n/a");
+  h->len = b.len;
+  return 1;
+}
+
+// What a TASKS row shows; a row is only re-formatted when this changes.
+typedef struct {
+  int valid;
+  int pid;
+  long long avg, cur;           // tenths of a percent
+  unsigned long long rss;       // bytes_key()
+  char state;
+  int attr;
+  int commW;
+  int thread;
+  char comm[64];
+} TaskRowKey;
+
+// "%-6d %4.1f %4.1f %-7s %c %.*s"; a thread row has its TID, no RSS of its
+// own, and its name indented under the process.
+static void task_row_format(TextBuf *b, const ProcTrack *p, int commW, int thread) {
+  int f = b->len;
+  tb_i64(b, p->pid);              tb_pad(b, f, 6); tb_ch(b, ' ');
+  f = b->len; tb_fix(b, p->cpu_avg, 1); tb_rjust(b, f, 4); tb_ch(b, ' ');
+  f = b->len; tb_fix(b, p->cpu_cur, 1); tb_rjust(b, f, 4); tb_ch(b, ' ');
+  f = b->len;
+  if (thread) tb_ch(b, '-'); else tb_bytes(b, p->rss_bytes);
+  tb_pad(b, f, 7); tb_ch(b, ' ');
+  tb_ch(b, p->state); tb_ch(b, ' ');
+  if (thread && commW > 3) { tb_str(b, "`- "); commW -= 3; }
+  tb_strn(b, p->comm, commW);
+}
+
+// Returns 1 and formats the row into `out` if its visible content changed.
+static int task_row_update(TaskRowKey *k, const ProcTrack *p, int attr,
+                           int commW, int thread, TextBuf *out) {
+  long long avg = fix_key(p->cpu_avg, 1);
+  long long cur = fix_key(p->cpu_cur, 1);
+  unsigned long long rss = bytes_key(p->rss_bytes);
+  if (k->valid && k->pid == p->pid && k->avg == avg && k->cur == cur &&
+      k->rss == rss && k->state == p->state && k->attr == attr &&
+      k->commW == commW && k->thread == thread && strcmp(k->comm, p->comm) == 0) return 0;
+
+  k->valid = 1;
+  k->thread = thread;
+  k->pid = p->pid;
+  k->avg = avg;
+  k->cur = cur;
+  k->rss = rss;
+  k->state = p->state;
+  k->attr = attr;
+  k->commW = commW;
+  memcpy(k->comm, p->comm, sizeof(k->comm));
+  task_row_format(out, p, commW, thread);
+  return 1;
+}
+
+// ---------------------------
+// Metrics exporter (OpenMetrics over HTTP)
+// ---------------------------
+// METRICS=[host:]port or METRICS=unix:/path starts a listener thread that
+// serves the last tick as OpenMetrics text. The sampler only copies its
+// results into `pub` under the lock; a scrape takes its own copy and renders
+// it into a buffer reused across requests, so it never reads /proc and never
+// holds up the UI loop for longer than that copy.
+#define METRICS_TOP_DEFAULT 10
+#define METRICS_TOP_MAX 64
+
+// Mount rows with their own copy of the mount points, which the sampler
+// frees on the next mountinfo change.
+typedef struct {
+  MountRow *a;
+  int n, cap;
+  char *dirs;                   // the rows' mount points, back to back
+  size_t dcap;
+} MountList;
+
+static void mount_list_set(MountList *l, const MountRow *src, int n) {
+  size_t need = 0;
+  for (int i=0; i<n; i++) need += strlen(src[i].dir) + 1;
+  if (l->cap < n) {
+    l->cap = n;
+    l->a = (MountRow*)realloc(l->a, sizeof(MountRow) * (size_t)n);
+  }
+  if (l->dcap < need) {
+    l->dcap = need;
+    l->dirs = (char*)realloc(l->dirs, need);
+  }
+  char *p = l->dirs;
+  for (int i=0; i<n; i++) {
+    size_t k = strlen(src[i].dir) + 1;
+    l->a[i] = src[i];
+    memcpy(p, src[i].dir, k);
+    l->a[i].dir = p;
+    p += k;
+  }
+  l->n = n;
+}
+
+static void mount_list_free(MountList *l) {
+  free(l->a);
+  free(l->dirs);
+  memset(l, 0, sizeof(*l));
+}
+
+typedef struct {
+  Sample s;
+  NetDev net[MAX_DEVS];
+  int n_net;
+  DiskDev dsk[MAX_DEVS];
+  int n_dsk;
+  MountList mnt;                // deep-copied, never by assignment
+  ProcTrack top[METRICS_TOP_MAX];
+  int n_top;
+  int n_tasks;
+  unsigned long long ticks;
+} MetricsSnap;
+
+typedef struct {
+  int fd;                       // listening socket, -1 when disabled
+  char unix_path[108];
+  int top;                      // tasks exported, METRICS_TOP
+  pthread_t th;
+  pthread_mutex_t mu;
+  MetricsSnap pub;              // latest tick, guarded by mu
+  MetricsSnap snap;             // the exporter thread's copy
+  char *buf;                    // response body, reused across scrapes
+  int cap;
+} Exporter;
+
+static void metrics_publish(Exporter *x, const Collector *c, const Sample *s) {
+  if (x->fd < 0) return;
+  MetricsSnap *m = &x->pub;
+  int top = MIN(x->top, c->pt.n);
+  pthread_mutex_lock(&x->mu);
+  m->s = *s;
+  memcpy(m->net, c->net, sizeof(NetDev) * (size_t)c->n_net);
+  m->n_net = c->n_net;
+  memcpy(m->dsk, c->dsk, sizeof(DiskDev) * (size_t)c->n_dsk);
+  m->n_dsk = c->n_dsk;
+  mount_list_set(&m->mnt, c->mnt.rows, c->mnt.n);
+  memcpy(m->top, c->pt.a, sizeof(ProcTrack) * (size_t)top);
+  m->n_top = top;
+  m->n_tasks = c->pt.n;
+  m->ticks++;
+  pthread_mutex_unlock(&x->mu);
+}
+
+// Label values escape backslash, double quote and newline.
+static void om_esc(TextBuf *b, const char *s) {
+  for (; *s; s++) {
+    if (*s == '\\' || *s == '"') { tb_ch(b, '\\'); tb_ch(b, *s); }
+    else if (*s == '\n') tb_str(b, "\\n");
+    else tb_ch(b, *s);
+  }
+}
+
+// OpenMetrics names a counter family without the _total suffix its samples
+// carry; the older Prometheus text format expects the suffix on both.
+static void om_family(TextBuf *b, const char *name, const char *type,
+                      const char *help, int om) {
+  int counter = (strcmp(type, "counter") == 0);
+  tb_str(b, "# TYPE "); tb_str(b, name);
+  if (counter && !om) tb_str(b, "_total");
+  tb_ch(b, ' '); tb_str(b, type); tb_ch(b, '\n');
+  tb_str(b, "# HELP "); tb_str(b, name);
+  if (counter && !om) tb_str(b, "_total");
+  tb_ch(b, ' '); tb_str(b, help); tb_ch(b, '\n');
+}
+
+static void om_gauge(TextBuf *b, const char *name, const char *help,
+                     double v, int dec, int om) {
+  om_family(b, name, "gauge", help, om);
+  tb_str(b, name); tb_ch(b, ' '); tb_fix(b, v, dec); tb_ch(b, '\n');
+}
+
+// `name{key="val"} ` ready for the value.
+static void om_sample(TextBuf *b, const char *name, const char *key, const char *val) {
+  tb_str(b, name); tb_ch(b, '{');
+  tb_str(b, key); tb_str(b, "=\""); om_esc(b, val); tb_str(b, "\"} ");
+}
+
+static const char *const THR_REASONS[] = {
+  "undervoltage", "freq_capped", "throttled", "soft_temp_limit",
+};
+
+static void metrics_render(TextBuf *b, const MetricsSnap *m, int om) {
+  const Sample *s = &m->s;
+
+  om_family(b, "sparta_samples", "counter", "Sampler ticks since start.", om);
+  tb_str(b, "sparta_samples_total "); tb_u64(b, m->ticks); tb_ch(b, '\n');
+
+  om_gauge(b, "sparta_cpu_usage_ratio", "Busy share of all CPUs over the last tick.",
+           s->cpu_pct / 100.0, 4, om);
+  if (s->fast_ms) {
+    static const char *const Q[] = { "0", "0.5", "0.99", "1" };
+    const double v[] = { s->cpu_lo, s->cpu_p50, s->cpu_p99, s->cpu_hi };
+    // "quantile" is reserved for summaries, and this is a gauge.
+    om_family(b, "sparta_cpu_core_busy_ratio", "gauge",
+              "Quantiles (q) of per-core busy share over --fast windows in the last tick.", om);
+    for (int i=0; i<4; i++) {
+      om_sample(b, "sparta_cpu_core_busy_ratio", "q", Q[i]);
+      tb_fix(b, v[i] / 100.0, 2); tb_ch(b, '\n');
+    }
+    const double a[] = { s->all_p50, s->all_p99, s->all_hi };
+    om_family(b, "sparta_cpu_all_busy_ratio", "gauge",
+              "Quantiles (q) of all-CPU busy share over --fast windows in the last tick.", om);
+    for (int i=0; i<3; i++) {
+      om_sample(b, "sparta_cpu_all_busy_ratio", "q", Q[i + 1]);
+      tb_fix(b, a[i] / 100.0, 2); tb_ch(b, '\n');
+    }
+  }
+  om_gauge(b, "sparta_memory_total_bytes", "MemTotal.", (double)s->memT, 0, om);
+  om_gauge(b, "sparta_memory_available_bytes", "MemAvailable.", (double)s->memA, 0, om);
+  om_gauge(b, "sparta_memory_usage_ratio", "1 - MemAvailable/MemTotal.",
+           s->mem_pct / 100.0, 4, om);
+  {
+    static const char *const kinds[] = {
+      "free", "anon", "cache", "shmem", "slab", "dirty", "writeback",
+    };
+    const unsigned long long vals[] = {
+      s->memFree, s->memAnon, s->memCache, s->memShmem, s->memSlab, s->memDirty, s->memWback,
+    };
+    om_family(b, "sparta_memory_bytes", "gauge", "Memory breakdown from /proc/meminfo.", om);
+    for (int i=0; i<(int)(sizeof(kinds) / sizeof(kinds[0])); i++) {
+      om_sample(b, "sparta_memory_bytes", "kind", kinds[i]);
+      tb_u64(b, vals[i]); tb_ch(b, '\n');
+    }
+  }
+  om_gauge(b, "sparta_swap_total_bytes", "SwapTotal.", (double)s->swapT, 0, om);
+  om_gauge(b, "sparta_swap_free_bytes", "SwapFree.", (double)s->swapF, 0, om);
+  om_gauge(b, "sparta_hugepages_total_bytes", "HugePages_Total x Hugepagesize.", (double)s->hugeT, 0, om);
+  om_gauge(b, "sparta_hugepages_free_bytes", "HugePages_Free x Hugepagesize.", (double)s->hugeF, 0, om);
+  om_gauge(b, "sparta_major_faults_per_second", "pgmajfault rate over the last tick.", s->majflt_s, 1, om);
+  om_gauge(b, "sparta_pages_scanned_per_second", "pgscan_* rate over the last tick.", s->pgscan_s, 1, om);
+  om_gauge(b, "sparta_pages_stolen_per_second", "pgsteal_* rate over the last tick.", s->pgsteal_s, 1, om);
+  om_gauge(b, "sparta_swap_in_pages_per_second", "pswpin rate over the last tick.", s->swpin_s, 1, om);
+  om_gauge(b, "sparta_swap_out_pages_per_second", "pswpout rate over the last tick.", s->swpout_s, 1, om);
+  om_family(b, "sparta_oom_kills", "counter", "OOM killer invocations since boot.", om);
+  tb_str(b, "sparta_oom_kills_total "); tb_u64(b, s->oomKills); tb_ch(b, '\n');
+  om_gauge(b, "sparta_load1", "1-minute load average.", s->l1, 2, om);
+  om_gauge(b, "sparta_load5", "5-minute load average.", s->l5, 2, om);
+  om_gauge(b, "sparta_load15", "15-minute load average.", s->l15, 2, om);
+  om_gauge(b, "sparta_uptime_seconds", "Time since boot.", s->up, 2, om);
+  if (s->n_sens > 0) {
+    om_family(b, "sparta_temperature_celsius", "gauge", "Thermal zone and hwmon sensors.", om);
+    for (int i=0; i<s->n_sens; i++) {
+      om_sample(b, "sparta_temperature_celsius", "sensor", s->sens_name[i]);
+      tb_fix(b, s->sens_c[i], 1); tb_ch(b, '\n');
+    }
+    if (s->sens_more > 0)
+      om_gauge(b, "sparta_temperature_sensors_omitted",
+               "Sensors past the per-sample cap; the hottest is always exported.", s->sens_more, 0, om);
+  }
+  if (s->have_perf) {
+    om_gauge(b, "sparta_context_switches_per_second", "perf_event context-switches, all CPUs.", s->csw_s, 0, om);
+    om_gauge(b, "sparta_cpu_migrations_per_second", "perf_event cpu-migrations, all CPUs.", s->mig_s, 0, om);
+    om_gauge(b, "sparta_page_faults_per_second", "perf_event page-faults, all CPUs.", s->flt_s, 0, om);
+    om_family(b, "sparta_cpu_context_switches_per_second", "gauge", "perf_event context-switches per CPU.", om);
+    for (int i=0; i<s->n_pcpu; i++) {
+      tb_str(b, "sparta_cpu_context_switches_per_second{cpu=\""); tb_i64(b, i); tb_str(b, "\"} ");
+      tb_fix(b, s->pc_csw[i], 0); tb_ch(b, '\n');
+    }
+  }
+  if (s->have_perf >= 2) {
+    om_family(b, "sparta_cpu_instructions_per_cycle", "gauge", "Instructions per cycle per CPU.", om);
+    for (int i=0; i<s->n_pcpu; i++) {
+      tb_str(b, "sparta_cpu_instructions_per_cycle{cpu=\""); tb_i64(b, i); tb_str(b, "\"} ");
+      tb_fix(b, s->pc_ipc[i], 2); tb_ch(b, '\n');
+    }
+  }
+  if (s->have_perf >= 3) {
+    om_family(b, "sparta_cpu_cache_miss_ratio", "gauge", "Cache misses per cache reference per CPU.", om);
+    for (int i=0; i<s->n_pcpu; i++) {
+      tb_str(b, "sparta_cpu_cache_miss_ratio{cpu=\""); tb_i64(b, i); tb_str(b, "\"} ");
+      tb_fix(b, s->pc_miss[i] / 100.0, 4); tb_ch(b, '\n');
+    }
+  }
+  if (s->n_freq > 0) {
+    om_family(b, "sparta_cpu_frequency_hertz", "gauge", "scaling_cur_freq per CPU.", om);
+    for (int i=0; i<s->n_freq; i++) {
+      tb_str(b, "sparta_cpu_frequency_hertz{cpu=\""); tb_i64(b, i); tb_str(b, "\"} ");
+      tb_u64(b, (unsigned long long)s->freq_mhz[i] * 1000000ULL); tb_ch(b, '\n');
+    }
+  }
+
+  om_family(b, "sparta_disk_read_bytes", "counter", "Bytes read.", om);
+  for (int i=0; i<m->n_dsk; i++) {
+    om_sample(b, "sparta_disk_read_bytes_total", "device", m->dsk[i].name);
+    tb_u64(b, m->dsk[i].rdsec * 512ULL); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_disk_written_bytes", "counter", "Bytes written.", om);
+  for (int i=0; i<m->n_dsk; i++) {
+    om_sample(b, "sparta_disk_written_bytes_total", "device", m->dsk[i].name);
+    tb_u64(b, m->dsk[i].wrsec * 512ULL); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_disk_read_bytes_per_second", "gauge", "Read rate over the last tick.", om);
+  for (int i=0; i<m->n_dsk; i++) {
+    om_sample(b, "sparta_disk_read_bytes_per_second", "device", m->dsk[i].name);
+    tb_fix(b, m->dsk[i].r_mbs * 1048576.0, 0); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_disk_written_bytes_per_second", "gauge", "Write rate over the last tick.", om);
+  for (int i=0; i<m->n_dsk; i++) {
+    om_sample(b, "sparta_disk_written_bytes_per_second", "device", m->dsk[i].name);
+    tb_fix(b, m->dsk[i].w_mbs * 1048576.0, 0); tb_ch(b, '\n');
+  }
+
+  om_family(b, "sparta_network_receive_bytes", "counter", "Bytes received.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_receive_bytes_total", "device", m->net[i].name);
+    tb_u64(b, m->net[i].rxB); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_network_transmit_bytes", "counter", "Bytes sent.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_transmit_bytes_total", "device", m->net[i].name);
+    tb_u64(b, m->net[i].txB); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_network_receive_errors", "counter", "Receive errors.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_receive_errors_total", "device", m->net[i].name);
+    tb_u64(b, m->net[i].rxE); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_network_receive_drops", "counter", "Receive drops.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_receive_drops_total", "device", m->net[i].name);
+    tb_u64(b, m->net[i].rxD); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_network_transmit_errors", "counter", "Transmit errors.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_transmit_errors_total", "device", m->net[i].name);
+    tb_u64(b, m->net[i].txE); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_network_transmit_drops", "counter", "Transmit drops.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_transmit_drops_total", "device", m->net[i].name);
+    tb_u64(b, m->net[i].txD); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_network_receive_bytes_per_second", "gauge", "Receive rate over the last tick.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_receive_bytes_per_second", "device", m->net[i].name);
+    tb_fix(b, m->net[i].rx_mbs * 1048576.0, 0); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_network_transmit_bytes_per_second", "gauge", "Transmit rate over the last tick.", om);
+  for (int i=0; i<m->n_net; i++) {
+    om_sample(b, "sparta_network_transmit_bytes_per_second", "device", m->net[i].name);
+    tb_fix(b, m->net[i].tx_mbs * 1048576.0, 0); tb_ch(b, '\n');
+  }
+
+  // A stuck mount keeps its last numbers until statvfs answers again.
+  om_family(b, "sparta_filesystem_size_bytes", "gauge", "Filesystem size.", om);
+  for (int i=0; i<m->mnt.n; i++) {
+    if (!m->mnt.a[i].have) continue;
+    om_sample(b, "sparta_filesystem_size_bytes", "mountpoint", m->mnt.a[i].dir);
+    tb_u64(b, m->mnt.a[i].tot); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_filesystem_used_bytes", "gauge", "Bytes not available to users.", om);
+  for (int i=0; i<m->mnt.n; i++) {
+    if (!m->mnt.a[i].have) continue;
+    om_sample(b, "sparta_filesystem_used_bytes", "mountpoint", m->mnt.a[i].dir);
+    tb_u64(b, m->mnt.a[i].used); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_filesystem_usage_ratio", "gauge", "Used share of the filesystem.", om);
+  for (int i=0; i<m->mnt.n; i++) {
+    if (!m->mnt.a[i].have) continue;
+    om_sample(b, "sparta_filesystem_usage_ratio", "mountpoint", m->mnt.a[i].dir);
+    tb_fix(b, m->mnt.a[i].pct / 100.0, 4); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_filesystem_inode_usage_ratio", "gauge", "Used share of inodes.", om);
+  for (int i=0; i<m->mnt.n; i++) {
+    if (!m->mnt.a[i].have) continue;
+    om_sample(b, "sparta_filesystem_inode_usage_ratio", "mountpoint", m->mnt.a[i].dir);
+    tb_fix(b, m->mnt.a[i].ipct / 100.0, 4); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_filesystem_fill_bytes_per_second", "gauge",
+            "Growth of used bytes over the last 2 minutes.", om);
+  for (int i=0; i<m->mnt.n; i++) {
+    if (!m->mnt.a[i].have_fill) continue;
+    om_sample(b, "sparta_filesystem_fill_bytes_per_second", "mountpoint", m->mnt.a[i].dir);
+    tb_fix(b, m->mnt.a[i].fill, 0); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_filesystem_stuck", "gauge", "1 while statvfs has not returned for 1s.", om);
+  for (int i=0; i<m->mnt.n; i++) {
+    om_sample(b, "sparta_filesystem_stuck", "mountpoint", m->mnt.a[i].dir);
+    tb_ch(b, m->mnt.a[i].stuck ? '1' : '0'); tb_ch(b, '\n');
+  }
+
+  if (s->have_thr) {
+    om_gauge(b, "sparta_throttled_flags", "Raw vcgencmd get_throttled bits.",
+             (double)s->thrFlags, 0, om);
+    om_family(b, "sparta_throttled", "gauge",
+              "1 if the condition is active now or has occurred since boot.", om);
+    for (int i=0; i<4; i++) {
+      for (int since=0; since<2; since++) {
+        tb_str(b, "sparta_throttled{reason=\""); tb_str(b, THR_REASONS[i]);
+        tb_str(b, since ? "\",scope=\"since_boot\"} " : "\",scope=\"now\"} ");
+        tb_ch(b, (s->thrFlags & (1u << (i + since * 16))) ? '1' : '0');
+        tb_ch(b, '\n');
+      }
+    }
+  }
+
+  om_gauge(b, "sparta_tasks", "Processes seen in the last scan.", (double)m->n_tasks, 0, om);
+  om_family(b, "sparta_task_cpu_ratio", "gauge",
+            "Busiest tasks: smoothed CPU, 1.0 = one core.", om);
+  for (int i=0; i<m->n_top; i++) {
+    const ProcTrack *p = &m->top[i];
+    tb_str(b, "sparta_task_cpu_ratio{pid=\""); tb_i64(b, p->pid);
+    tb_str(b, "\",comm=\""); om_esc(b, p->comm); tb_str(b, "\"} ");
+    tb_fix(b, p->cpu_avg / 100.0, 4); tb_ch(b, '\n');
+  }
+  om_family(b, "sparta_task_resident_bytes", "gauge", "Busiest tasks: resident set size.", om);
+  for (int i=0; i<m->n_top; i++) {
+    const ProcTrack *p = &m->top[i];
+    tb_str(b, "sparta_task_resident_bytes{pid=\""); tb_i64(b, p->pid);
+    tb_str(b, "\",comm=\""); om_esc(b, p->comm); tb_str(b, "\"} ");
+    tb_u64(b, p->rss_bytes); tb_ch(b, '\n');
+  }
+
+  if (om) tb_str(b, "# EOF\n");
+}
+
+// Render the thread's snapshot, growing the reused buffer until it fits.
+static int metrics_body(Exporter *x, int om) {
+  for (;;) {
+    TextBuf b;
+    tb_init(&b, x->buf, x->cap);
+    metrics_render(&b, &x->snap, om);
+    if (b.len < b.cap) return b.len;
+    char *nb = realloc(x->buf, (size_t)x->cap * 2);
+    if (!nb) return b.len;
+    x->buf = nb;
+    x->cap *= 2;
+  }
+}
+
+static int send_all(int fd, const char *p, int n) {
+  while (n > 0) {
+    ssize_t w = send(fd, p, (size_t)n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return 0;
+    p += w;
+    n -= (int)w;
+  }
+  return 1;
+}
+
+static void metrics_serve(Exporter *x, int fd) {
+  char req[2048];
+  int n = 0;
+  while (n < (int)sizeof(req) - 1) {
+    ssize_t r = recv(fd, req + n, sizeof(req) - 1 - (size_t)n, 0);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return;
+    n += (int)r;
+    req[n] = '\0';
+    if (strstr(req, "\r\n\r\n")) break;
+  }
+
+  int found = strncmp(req, "GET / ", 6) == 0 ||
+              (strncmp(req, "GET /metrics", 12) == 0 &&
+               (req[12] == ' ' || req[12] == '?'));
+  int om = strstr(req, "application/openmetrics-text") != NULL;
+
+  int len = 0;
+  if (found) {
+    pthread_mutex_lock(&x->mu);
+    MountList mnt = x->snap.mnt;
+    x->snap = x->pub;
+    x->snap.mnt = mnt;
+    mount_list_set(&x->snap.mnt, x->pub.mnt.a, x->pub.mnt.n);
+    pthread_mutex_unlock(&x->mu);
+    len = metrics_body(x, om);
+  }
+
+  char hdr[256];
+  TextBuf h;
+  tb_init(&h, hdr, sizeof(hdr));
+  tb_str(&h, found ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n");
+  tb_str(&h, "Content-Type: ");
+  tb_str(&h, om ? "application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                : "text/plain; version=0.0.4; charset=utf-8\r\n");
+  tb_str(&h, "Content-Length: "); tb_i64(&h, len);
+  tb_str(&h, "\r\nConnection: close\r\n\r\n");
+  if (send_all(fd, hdr, h.len) && len > 0) send_all(fd, x->buf, len);
+}
+
+static void *metrics_thread(void *arg) {
+  Exporter *x = (Exporter*)arg;
+  for (;;) {
+    int fd = accept4(x->fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;  // metrics_stop() shut the socket down
+    }
+    // A stalled client only ever holds up this thread, and not for long.
+    struct timeval tv = { 2, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    metrics_serve(x, fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+static int metrics_listen_unix(Exporter *x, const char *path) {
+  struct sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(sa.sun_path)) { errno = ENAMETOOLONG; return -1; }
+  snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", path);
+
+  // Replace a socket left behind by an earlier run, but nothing else.
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  if (bind(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0) { close(fd); return -1; }
+  snprintf(x->unix_path, sizeof(x->unix_path), "%s", path);
+  return fd;
+}
+
+// Split "port", "host:port" or "[v6addr]:port". A bare port means loopback.
+static const char *split_hostport(const char *spec, char *host, size_t n) {
+  snprintf(host, n, "127.0.0.1");
+  const char *colon = strrchr(spec, ':');
+  if (!colon) return spec;
+  int hl = (int)(colon - spec);
+  if (hl > 1 && spec[0] == '[' && spec[hl-1] == ']') { spec++; hl -= 2; }
+  snprintf(host, n, "%.*s", MIN(hl, (int)n - 1), spec);
+  return colon + 1;
+}
+
+// Bound (not yet listening) TCP socket for `spec`; ":port" binds all
+// addresses. Returns -1 with errno set on failure.
+static int tcp_listen(const char *spec) {
+  char host[128];
+  const char *port = split_hostport(spec, host, sizeof(host));
+
+  struct addrinfo hints, *res = NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  int rc = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+  if (rc != 0) { errno = EINVAL; return -1; }
+
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) continue;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0) { close(fd); fd = -1; }
+  }
+  int err = errno;
+  freeaddrinfo(res);
+  errno = err;
+  return fd;
+}
+
+// Returns 0 (after saying why on stderr) if METRICS is set but unusable.
+static int metrics_start(Exporter *x, const char *spec) {
+  x->fd = -1;
+  if (!spec || !*spec) return 1;
+
+  const char *env = getenv("METRICS_TOP");
+  x->top = (env && *env) ? atoi(env) : METRICS_TOP_DEFAULT;
+  x->top = MAX(0, MIN(METRICS_TOP_MAX, x->top));
+
+  int fd = (strncmp(spec, "unix:", 5) == 0) ? metrics_listen_unix(x, spec + 5)
+                                            : tcp_listen(spec);
+  if (fd < 0 || listen(fd, 16) != 0) {
+    fprintf(stderr, "sparta-mon: METRICS=%s: %s\n", spec, strerror(errno));
+    if (fd >= 0) close(fd);
+    return 0;
+  }
+
+  x->cap = 64 * 1024;
+  x->buf = malloc((size_t)x->cap);
+  pthread_mutex_init(&x->mu, NULL);
+  x->fd = fd;
+
+  // Leave signals (SIGWINCH in particular) to the UI thread.
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int rc = pthread_create(&x->th, NULL, metrics_thread, x);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (rc != 0) {
+    fprintf(stderr, "sparta-mon: METRICS: %s\n", strerror(rc));
+    close(fd);
+    x->fd = -1;
+    return 0;
+  }
+  return 1;
+}
+
+static void metrics_stop(Exporter *x) {
+  if (x->fd < 0) return;
+  shutdown(x->fd, SHUT_RDWR);
+  pthread_join(x->th, NULL);
+  close(x->fd);
+  x->fd = -1;
+  if (x->unix_path[0]) unlink(x->unix_path);
+  free(x->buf);
+  x->buf = NULL;
+  mount_list_free(&x->pub.mnt);
+  mount_list_free(&x->snap.mnt);
+}
+
+// ---------------------------
+// Anomaly triggers
+// ---------------------------
+// TRIGGERS=cpu>90,disk_w:z4,... watches the panel metrics, either against a
+// fixed threshold or against a streaming EWMA baseline (fires when the
+// value sits N standard deviations above it). Rules fire on the rising
+// edge; a firing rule drops sampling to MIN_DELAY_MS and records every tick,
+// panels and the whole task table, as JSON lines under SNAP_DIR (default
+// /tmp) until SNAP_SECS (default 10) pass without a new firing.
+#define BASE_ALPHA 0.05         // baseline memory of ~20 samples
+#define BASE_WARMUP 20          // samples before z-scores count
+#define WATCH_RULES 16
+#define WATCH_PRE 240           // history per panel written at the start
+
+// In HistSet order. `floor` is the smallest standard deviation a z-score
+// is taken against, so a flat idle metric does not fire on noise.
+static const struct { const char *name; double floor; } WATCH_METRICS[] = {
+  { "cpu", 2.0 }, { "mem", 0.5 }, { "temp", 1.0 },
+  { "disk_r", 0.5 }, { "disk_w", 0.5 }, { "net_rx", 0.1 }, { "net_tx", 0.1 },
+  { "majflt", 5.0 }, { "pgscan", 100.0 },
+  { "csw", 1000.0 }, { "mig", 50.0 }, { "flt", 1000.0 }, { "ipc", 0.1 },
+  { "cpu_min", 2.0 }, { "cpu_p50", 2.0 }, { "cpu_p99", 2.0 }, { "cpu_max", 2.0 },
+};
+_Static_assert(sizeof(WATCH_METRICS) / sizeof(WATCH_METRICS[0]) == sizeof(HistSet) / sizeof(Hist),
+               "one WATCH_METRICS entry per HistSet ring");
+
+typedef struct {
+  double mean, var;
+  long n;
+} Baseline;
+
+typedef struct {
+  int m;                        // WATCH_METRICS index
+  char op;                      // '>', '<' or 'z'
+  double v;
+  int armed;                    // condition was false since the last firing
+} WatchRule;
+
+typedef struct {
+  WatchRule rules[WATCH_RULES];
+  int n_rules;
+  Baseline base[HISTSET_N];
+  char dir[256];
+  double window_s;
+  double until;                 // recording while now < until
+  FILE *f;
+  char *buf;                    // record being formatted
+  int cap;
+  char host[64];
+  char fired[96];               // what started or last extended the recording
+  unsigned long long files;
+} Watch;
+
+static double watch_value(const Sample *s, int m) {
+  switch (m) {
+    case 0: return s->cpu_pct;
+    case 1: return s->mem_pct;
+    case 2: return s->have_tc ? s->tc : 0.0;
+    case 3: return s->disk_r_mbs;
+    case 4: return s->disk_w_mbs;
+    case 5: return s->net_rx_mbs;
+    case 6: return s->net_tx_mbs;
+    case 7: return s->majflt_s;
+    case 8: return s->pgscan_s;
+    case 9: return s->csw_s;
+    case 10: return s->mig_s;
+    case 11: return s->flt_s;
+    case 12: return s->ipc;
+    case 13: return s->cpu_lo;
+    case 14: return s->cpu_p50;
+    case 15: return s->cpu_p99;
+    case 16: return s->cpu_hi;
+  }
+  return 0.0;
+}
+
+// Returns 0 (after printing why) if TRIGGERS does not parse; no TRIGGERS
+// leaves the watch idle.
+static int watch_init(Watch *w) {
+  memset(w, 0, sizeof(*w));
+  snprintf(w->dir, sizeof(w->dir), "%s", getenv("SNAP_DIR") ? getenv("SNAP_DIR") : "/tmp");
+  const char *secs = getenv("SNAP_SECS");
+  w->window_s = (secs && atof(secs) > 0) ? atof(secs) : 10.0;
+  gethostname(w->host, sizeof(w->host) - 1);
+
+  const char *spec = getenv("TRIGGERS");
+  if (!spec || !*spec) return 1;
+  char tmp[512];
+  snprintf(tmp, sizeof(tmp), "%s", spec);
+  char *save = NULL;
+  for (char *tok = strtok_r(tmp, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+    size_t nl = strcspn(tok, "<>:");
+    WatchRule r = { -1, tok[nl], 0.0, 1 };
+    for (int m=0; m<HISTSET_N; m++) {
+      if (strlen(WATCH_METRICS[m].name) == nl && strncmp(tok, WATCH_METRICS[m].name, nl) == 0) r.m = m;
+    }
+    const char *val = tok + nl + 1;
+    if (r.op == ':' && tok[nl+1] == 'z') { r.op = 'z'; val++; }
+    char *end = NULL;
+    if (r.m >= 0 && r.op && r.op != ':') r.v = strtod(val, &end);
+    if (r.m < 0 || !end || end == val || *end || w->n_rules == WATCH_RULES) {
+      fprintf(stderr, "sparta-mon: TRIGGERS: bad rule '%s' (want e.g. cpu>90, temp<20, disk_w:z4;"
+                      " metrics cpu mem temp disk_r disk_w net_rx net_tx majflt pgscan csw mig flt ipc"
+                      " cpu_min cpu_p50 cpu_p99 cpu_max)\n", tok);
+      return 0;
+    }
+    w->rules[w->n_rules++] = r;
+  }
+  return 1;
+}
+
+static int watch_grow(Watch *w, const TextBuf *b) {
+  if (b->len < b->cap) return 0;
+  char *nb = realloc(w->buf, (size_t)w->cap * 2);
+  if (!nb) return 0;
+  w->buf = nb;
+  w->cap *= 2;
+  return 1;
+}
+
+static void json_str(TextBuf *b, const char *s) {
+  tb_ch(b, '"');
+  for (; *s; s++) {
+    if (*s == '\\' || *s == '"') { tb_ch(b, '\\'); tb_ch(b, *s); }
+    else if ((unsigned char)*s < 0x20) tb_ch(b, ' ');
+    else tb_ch(b, *s);
+  }
+  tb_ch(b, '"');
+}
+
+static double wall_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void watch_head(TextBuf *b, const char *type) {
+  tb_str(b, "{\"type\":\""); tb_str(b, type);
+  tb_str(b, "\",\"time\":"); tb_fix(b, wall_s(), 3);
+}
+
+// The first record: what fired and the panels as they looked up to now.
+static void watch_render_start(TextBuf *b, const Watch *w, const HistSet *h) {
+  watch_head(b, "start");
+  tb_str(b, ",\"host\":"); json_str(b, w->host);
+  tb_str(b, ",\"trigger\":"); json_str(b, w->fired);
+  tb_str(b, ",\"hist\":{");
+  for (int m=0; m<HISTSET_N; m++) {
+    const Hist *hh = (const Hist *)h + m;
+    int n = MIN(WATCH_PRE, hh->len);
+    if (m) tb_ch(b, ',');
+    tb_ch(b, '"'); tb_str(b, WATCH_METRICS[m].name); tb_str(b, "\":[");
+    for (int i=0; i<n; i++) {
+      if (i) tb_ch(b, ',');
+      tb_fix(b, hist_get_lastN(hh, n, i), 2);
+    }
+    tb_ch(b, ']');
+  }
+  tb_str(b, "}}\n");
+}
+
+static void watch_render_tick(TextBuf *b, const Sample *s, const ProcTable *pt,
+                              const char *fired) {
+  watch_head(b, "tick");
+  if (fired[0]) { tb_str(b, ",\"trigger\":"); json_str(b, fired); }
+  for (int m=0; m<HISTSET_N; m++) {
+    tb_str(b, ",\""); tb_str(b, WATCH_METRICS[m].name); tb_str(b, "\":");
+    tb_fix(b, watch_value(s, m), 2);
+  }
+  tb_str(b, ",\"load\":["); tb_fix(b, s->l1, 2); tb_ch(b, ',');
+  tb_fix(b, s->l5, 2); tb_ch(b, ','); tb_fix(b, s->l15, 2); tb_ch(b, ']');
+  tb_str(b, ",\"mem_avail\":"); tb_u64(b, s->memA);
+  // [free, anon, cache, shmem, slab, dirty, writeback] in bytes.
+  tb_str(b, ",\"mem\":["); tb_u64(b, s->memFree); tb_ch(b, ',');
+  tb_u64(b, s->memAnon); tb_ch(b, ','); tb_u64(b, s->memCache); tb_ch(b, ',');
+  tb_u64(b, s->memShmem); tb_ch(b, ','); tb_u64(b, s->memSlab); tb_ch(b, ',');
+  tb_u64(b, s->memDirty); tb_ch(b, ','); tb_u64(b, s->memWback); tb_ch(b, ']');
+  tb_str(b, ",\"swap_used\":"); tb_u64(b, s->swapT > s->swapF ? s->swapT - s->swapF : 0);
+  tb_str(b, ",\"pgsteal\":"); tb_fix(b, s->pgsteal_s, 1);
+  tb_str(b, ",\"swpin\":"); tb_fix(b, s->swpin_s, 1);
+  tb_str(b, ",\"swpout\":"); tb_fix(b, s->swpout_s, 1);
+  tb_str(b, ",\"oom_kills\":"); tb_u64(b, s->oomKills);
+  tb_str(b, ",\"sensors\":{");
+  for (int i=0; i<s->n_sens; i++) {
+    if (i) tb_ch(b, ',');
+    json_str(b, s->sens_name[i]); tb_ch(b, ':'); tb_fix(b, s->sens_c[i], 1);
+  }
+  tb_str(b, "},\"mhz\":[");
+  for (int i=0; i<s->n_freq; i++) { if (i) tb_ch(b, ','); tb_u64(b, s->freq_mhz[i]); }
+  tb_ch(b, ']');
+  tb_str(b, ",\"disk\":"); json_str(b, s->have_disk ? s->disk : "");
+  tb_str(b, ",\"iface\":"); json_str(b, s->have_iface ? s->iface : "");
+  tb_str(b, ",\"net_errs\":["); tb_u64(b, s->d_rxE); tb_ch(b, ','); tb_u64(b, s->d_rxD);
+  tb_ch(b, ','); tb_u64(b, s->d_txE); tb_ch(b, ','); tb_u64(b, s->d_txD); tb_ch(b, ']');
+  if (s->have_fs) { tb_str(b, ",\"fs\":"); tb_fix(b, s->fsPct, 2); }
+  if (s->have_thr) { tb_str(b, ",\"thr\":"); tb_u64(b, s->thrFlags); }
+
+  // [pid, comm, state, cpu_cur, cpu_avg, rss_bytes] for every task.
+  tb_str(b, ",\"tasks\":[");
+  for (int i=0; i<pt->n; i++) {
+    const ProcTrack *p = &pt->a[i];
+    if (i) tb_ch(b, ',');
+    tb_ch(b, '['); tb_i64(b, p->pid); tb_ch(b, ',');
+    json_str(b, p->comm); tb_str(b, ",\"");
+    tb_ch(b, p->state ? p->state : '?'); tb_str(b, "\",");
+    tb_fix(b, p->cpu_cur, 1); tb_ch(b, ',');
+    tb_fix(b, p->cpu_avg, 1); tb_ch(b, ',');
+    tb_u64(b, p->rss_bytes); tb_ch(b, ']');
+  }
+  tb_str(b, "]}\n");
+}
+
+// Write one record, growing the buffer until it fits.
+#define WATCH_WRITE(w, render) do {                   \
+    for (;;) {                                        \
+      TextBuf b;                                      \
+      tb_init(&b, (w)->buf, (w)->cap);                \
+      render;                                         \
+      if (watch_grow((w), &b)) continue;              \
+      fwrite(b.p, 1, (size_t)b.len, (w)->f);          \
+      break;                                          \
+    }                                                 \
+  } while (0)
+
+static void watch_open(Watch *w, const HistSet *h) {
+  char stamp[32], path[400];
+  time_t t = time(NULL);
+  struct tm tm;
+  localtime_r(&t, &tm);
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+  snprintf(path, sizeof(path), "%s/sparta-%.63s-%s.jsonl", w->dir, w->host, stamp);
+  w->f = fopen(path, "a");
+  if (!w->f) return;
+  if (!w->buf) { w->cap = 65536; w->buf = malloc((size_t)w->cap); }
+  w->files++;
+  WATCH_WRITE(w, watch_render_start(&b, w, h));
+}
+
+static void watch_close(Watch *w) {
+  if (!w->f) return;
+  WATCH_WRITE(w, { watch_head(&b, "end"); tb_str(&b, "}\n"); });
+  fclose(w->f);
+  w->f = NULL;
+}
+
+static void watch_free(Watch *w) {
+  watch_close(w);
+  free(w->buf);
+  w->buf = NULL;
+}
+
+// Check the rules against this tick, update the baselines and record if a
+// window is open. Returns 1 while recording; callers then sample every
+// MIN_DELAY_MS.
+static int watch_tick(Watch *w, const Sample *s, const HistSet *h, const ProcTable *pt) {
+  if (w->n_rules == 0) return 0;
+  double now = now_s();
+
+  char fired[96] = "";
+  TextBuf fb;
+  tb_init(&fb, fired, sizeof(fired));
+  for (int i=0; i<w->n_rules; i++) {
+    WatchRule *r = &w->rules[i];
+    const Baseline *bl = &w->base[r->m];
+    double x = watch_value(s, r->m);
+    int on;
+    if (r->op == '>') on = x > r->v;
+    else if (r->op == '<') on = x < r->v;
+    else {
+      // Compare squares: (x - mean) > z * max(sd, floor), above the mean only.
+      double d = x - bl->mean, fl = WATCH_METRICS[r->m].floor;
+      on = bl->n >= BASE_WARMUP && d > 0 && d * d > r->v * r->v * MAX(bl->var, fl * fl);
+    }
+    if (on && r->armed) {
+      if (fb.len) tb_ch(&fb, ' ');
+      tb_str(&fb, WATCH_METRICS[r->m].name);
+      if (r->op == 'z') { tb_str(&fb, ":z"); tb_fix(&fb, r->v, 1); }
+      else { tb_ch(&fb, r->op); tb_fix(&fb, r->v, 1); }
+      tb_str(&fb, "=");
+      tb_fix(&fb, x, 1);
+      if (r->op == 'z') { tb_str(&fb, "/"); tb_fix(&fb, bl->mean, 1); }
+    }
+    r->armed = !on;
+  }
+
+  for (int m=0; m<HISTSET_N; m++) {
+    Baseline *bl = &w->base[m];
+    double x = watch_value(s, m);
+    if (bl->n++ == 0) { bl->mean = x; bl->var = 0.0; continue; }
+    double d = x - bl->mean, inc = BASE_ALPHA * d;
+    bl->mean += inc;
+    bl->var = (1.0 - BASE_ALPHA) * (bl->var + d * inc);
+  }
+
+  if (fired[0]) {
+    memcpy(w->fired, fired, sizeof(fired));
+    if (!w->f) watch_open(w, h);
+    w->until = now + w->window_s;
+  }
+  if (!w->f) return 0;
+  WATCH_WRITE(w, watch_render_tick(&b, s, pt, fired));
+  if (now >= w->until) { watch_close(w); return 0; }
+  return 1;
+}
+
+// ---------------------------
+// Shared-memory publication
+// ---------------------------
+// `sparta-mon --collector` samples once per tick and publishes the Sample,
+// the history rings and the top of the task table to a POSIX shm segment
+// (SPARTA_SHM, default /sparta-mon). Viewers map it read-only, so N viewers
+// cost one collection plus N renders. Writes are guarded by a seqlock: the
+// collector makes `seq` odd while it updates the frame, and a reader retries
+// if `seq` was odd or moved while it copied.
+#define SHM_MAGIC 0x53504d31u   // "SPM1"
+#define SHM_TASKS 512
+#define SHM_STALE_S 2.0
+#define SHM_BACKFILL_S 30       // a crashed collector's history is still worth showing
+
+typedef struct {
+  unsigned int magic;
+  unsigned int size;            // sizeof(ShmFrame) in the collector
+  int pid;                      // collector, 0 once it has exited
+  int delay_ms;
+  unsigned long long seq;
+  long long t_pub_ms;           // wall clock of the last publish
+  Sample s;
+  HistSet h;
+  int n_tasks;
+  int n_top;                    // the busiest n_top tasks, sorted
+  ProcTrack top[SHM_TASKS];
+} ShmFrame;
+
+typedef struct {
+  int fd;
+  ShmFrame *f;
+  char name[64];
+} ShmPub;
+
+typedef struct {
+  int fd;
+  const ShmFrame *f;
+  unsigned long long seq;       // last frame applied
+  double t_seq;                 // when it was applied
+  Sample s;
+  ProcTrack top[SHM_TASKS];
+  ProcTable pt;                 // view of `top` for the TASKS panel
+  int hn[HISTSET_N];            // staged ring values, applied once consistent
+  int hreset[HISTSET_N];
+  unsigned long long hseq[HISTSET_N];
+  float stage[HISTSET_N][HIST_MAX];
+} ShmView;
+
+static const char *shm_name(void) {
+  const char *v = getenv("SPARTA_SHM");
+  return (v && *v) ? v : "/sparta-mon";
+}
+
+static int pid_alive(int pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static long long wall_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Seed `h` with the rings of the collector segment `name`: a live
+// collector's, or one a crashed collector published to in the last
+// SHM_BACKFILL_S. Returns 1 if it did.
+static int shm_backfill(HistSet *h, const char *name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return 0;
+  struct stat st;
+  const ShmFrame *f = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ShmFrame))
+    f = mmap(NULL, sizeof(ShmFrame), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (f == MAP_FAILED) return 0;
+  int ok = 0;
+  if (f->magic == SHM_MAGIC && f->size == sizeof(ShmFrame) &&
+      (pid_alive(__atomic_load_n(&f->pid, __ATOMIC_ACQUIRE)) ||
+       wall_ms() - f->t_pub_ms <= SHM_BACKFILL_S * 1000LL)) {
+    for (int tries=0; tries<64 && !ok; tries++) {
+      unsigned long long s1 = __atomic_load_n(&f->seq, __ATOMIC_ACQUIRE);
+      if (s1 & 1) { sched_yield(); continue; }
+      memcpy(h, &f->h, sizeof(HistSet));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      ok = __atomic_load_n(&f->seq, __ATOMIC_RELAXED) == s1;
+    }
+  }
+  munmap((void*)f, sizeof(ShmFrame));
+  return ok;
+}
+
+static int shm_create(ShmPub *p, const char *name) {
+  // Refuse to replace a live collector; reclaim a segment a dead one left,
+  // carrying its history over if it is recent.
+  HistSet *old = NULL;
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd >= 0) {
+    struct stat st;
+    int pid = 0;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ShmFrame)) {
+      const ShmFrame *f = mmap(NULL, sizeof(ShmFrame), PROT_READ, MAP_SHARED, fd, 0);
+      if (f != MAP_FAILED) {
+        if (f->magic == SHM_MAGIC) pid = __atomic_load_n(&f->pid, __ATOMIC_ACQUIRE);
+        munmap((void*)f, sizeof(ShmFrame));
+      }
+    }
+    close(fd);
+    if (pid_alive(pid)) {
+      fprintf(stderr, "sparta-mon: collector already running on %s (pid %d)\n", name, pid);
+      return 0;
+    }
+    old = aligned_alloc(64, sizeof(HistSet));
+    if (old && !shm_backfill(old, name)) { free(old); old = NULL; }
+    shm_unlink(name);
+  }
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 || fchmod(fd, 0644) != 0 || ftruncate(fd, sizeof(ShmFrame)) != 0) {
+    fprintf(stderr, "sparta-mon: %s: %s\n", name, strerror(errno));
+    if (fd >= 0) { close(fd); shm_unlink(name); }
+    free(old);
+    return 0;
+  }
+  ShmFrame *f = mmap(NULL, sizeof(ShmFrame), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (f == MAP_FAILED) {
+    fprintf(stderr, "sparta-mon: %s: %s\n", name, strerror(errno));
+    close(fd);
+    shm_unlink(name);
+    free(old);
+    return 0;
+  }
+  if (old) memcpy(&f->h, old, sizeof(HistSet));
+  free(old);
+  f->magic = SHM_MAGIC;
+  f->size = sizeof(ShmFrame);
+  __atomic_store_n(&f->pid, (int)getpid(), __ATOMIC_RELEASE);
+  p->fd = fd;
+  p->f = f;
+  snprintf(p->name, sizeof(p->name), "%s", name);
+  return 1;
+}
+
+static void shm_publish(ShmPub *p, const Collector *c, const Sample *s, int delay_ms) {
+  ShmFrame *f = p->f;
+  __atomic_store_n(&f->seq, f->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  f->s = *s;
+  histset_push(&f->h, s);
+  f->n_tasks = c->pt.n;
+  f->n_top = MIN(c->pt.n, SHM_TASKS);
+  memcpy(f->top, c->pt.a, sizeof(ProcTrack) * (size_t)f->n_top);
+  f->delay_ms = delay_ms;
+  f->t_pub_ms = wall_ms();
+
+  __atomic_store_n(&f->seq, f->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void shm_destroy(ShmPub *p) {
+  if (!p->f) return;
+  __atomic_store_n(&p->f->pid, 0, __ATOMIC_RELEASE);
+  munmap(p->f, sizeof(ShmFrame));
+  close(p->fd);
+  shm_unlink(p->name);
+  p->f = NULL;
+}
+
+// Map a live collector's segment read-only. Returns 0 if there is none.
+static int shm_attach(ShmView *v, const char *name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return 0;
+  struct stat st;
+  const ShmFrame *f = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ShmFrame))
+    f = mmap(NULL, sizeof(ShmFrame), PROT_READ, MAP_SHARED, fd, 0);
+  if (f == MAP_FAILED || f->magic != SHM_MAGIC || f->size != sizeof(ShmFrame) ||
+      !pid_alive(__atomic_load_n(&f->pid, __ATOMIC_ACQUIRE))) {
+    if (f != MAP_FAILED) munmap((void*)f, sizeof(ShmFrame));
+    close(fd);
+    return 0;
+  }
+  v->fd = fd;
+  v->f = f;
+  v->seq = 0;
+  v->t_seq = now_s();
+  v->pt.a = v->top;
+  v->pt.n = 0;
+  v->pt.cap = SHM_TASKS;
+  return 1;
+}
+
+static void shm_detach(ShmView *v) {
+  if (!v->f) return;
+  munmap((void*)v->f, sizeof(ShmFrame));
+  close(v->fd);
+  v->f = NULL;
+}
+
+// Stage the values pushed to `src` after the local ring's seq, oldest first.
+// A collector restart shows up as a shared ring behind the local one.
+static void shm_stage_hist(ShmView *v, int i, const Hist *src, const Hist *dst) {
+  unsigned long long seq = src->seq;
+  int len = MIN(MAX(src->len, 0), HIST_MAX);
+  unsigned long long d = seq - dst->seq;
+  v->hreset[i] = (seq < dst->seq);
+  if (v->hreset[i] || d > (unsigned long long)len) d = (unsigned long long)len;
+  int head = src->head;
+  for (int k=0; k<(int)d; k++)
+    v->stage[i][k] = src->v[(head - (int)d + k + 2*HIST_MAX) % HIST_MAX];
+  v->hn[i] = (int)d;
+  v->hseq[i] = seq;
+}
+
+// Pull the latest frame into `s`, `h` and v->pt. Returns 1 if a new frame was
+// applied, 0 if there was none yet, -1 once the collector is gone.
+static int shm_read(ShmView *v, Sample *s, HistSet *h) {
+  const ShmFrame *f = v->f;
+  Hist *rings = (Hist*)h;
+
+  for (int tries=0; tries<64; tries++) {
+    unsigned long long s1 = __atomic_load_n(&f->seq, __ATOMIC_ACQUIRE);
+    if (s1 & 1) { sched_yield(); continue; }
+    if (s1 == v->seq) break;
+
+    v->s = f->s;
+    int n = MIN(MAX(f->n_top, 0), SHM_TASKS);
+    memcpy(v->top, f->top, sizeof(ProcTrack) * (size_t)n);
+    for (int i=0; i<HISTSET_N; i++) shm_stage_hist(v, i, &((const Hist*)&f->h)[i], &rings[i]);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&f->seq, __ATOMIC_RELAXED) != s1) continue;
+
+    *s = v->s;
+    v->pt.n = n;
+    for (int i=0; i<HISTSET_N; i++) {
+      if (v->hreset[i]) memset(&rings[i], 0, sizeof(Hist));
+      for (int k=0; k<v->hn[i]; k++) hist_push(&rings[i], v->stage[i][k]);
+      rings[i].seq = v->hseq[i];  // keep sweep mode in step with the collector
+    }
+    v->seq = s1;
+    v->t_seq = now_s();
+    return 1;
+  }
+
+  int pid = __atomic_load_n(&f->pid, __ATOMIC_ACQUIRE);
+  if (pid == 0) return -1;
+  if (now_s() - v->t_seq > SHM_STALE_S && !pid_alive(pid)) return -1;
+  return 0;
+}
+
+// ---------------------------
+// Wire protocol (--agent / --connect)
+// ---------------------------
+// An agent streams ticks to each viewer as messages framed by a varint
+// length. Every value is quantized to display precision and sent as a
+// zigzag varint delta against what that viewer already has, so a quiet tick
+// is a few dozen bytes. Both ends keep the same WireState; a frame is only
+// encoded once the previous one has left the socket, and it then carries
+// everything since, so a slow link gets fewer, larger frames rather than a
+// growing queue.
+//
+//   hello: 'H' version host delay_ms
+//   frame: 'F' mask {zigzag delta per set WF_* bit} {strings per set bit}
+//              [n per-core MHz deltas] [n sensor decidegree deltas]
+//              [n names, sensors left out]
+//              [n x per-CPU csw/s, IPC x100, miss% x10 deltas]
+//              k [seq-delta, k x HISTSET_N zigzag ring deltas]
+//              tasks rows nchanged {index mask [from] fields...}
+//
+// Viewers send single command bytes back: 'R' asks for a fresh hello and a
+// full frame, history included (the fleet view does this on drill-down).
+#define WIRE_VERSION 8
+#define WIRE_TASKS 64
+#define WIRE_MAX_MSG (1 << 20)
+
+enum {
+  WF_CPU, WF_MEM, WF_MEMT, WF_MEMA, WF_L1, WF_L5, WF_L15, WF_UP, WF_TC,
+  WF_DR, WF_DW, WF_NRX, WF_NTX, WF_RXE, WF_RXD, WF_TXE, WF_TXD,
+  WF_FS, WF_INO, WF_FSU, WF_FST, WF_THR, WF_HAVE, WF_BDISK, WF_BNIC,
+  WF_MFREE, WF_MANON, WF_MCACHE, WF_MSHM, WF_MSLAB, WF_MDIRTY, WF_MWB,
+  WF_SWT, WF_SWF, WF_HUGET, WF_HUGEF, WF_MAJF, WF_SCAN, WF_STEAL,
+  WF_SWIN, WF_SWOUT, WF_OOM, WF_FMAX, WF_PERF, WF_CSW, WF_MIG, WF_FLT,
+  WF_IPC, WF_MISSP, WF_FAST, WF_CLO, WF_CP50, WF_CP99, WF_CHI,
+  WF_CALL,                      // aggregate p50 | p99 << 8 | max << 16
+  WF_N
+};
+#define WF_IFACE  (1ULL << WF_N)
+#define WF_DISK   (1ULL << (WF_N + 1))
+#define WF_BDISKN (1ULL << (WF_N + 2))
+#define WF_BNICN  (1ULL << (WF_N + 3))
+#define WF_FREQ   (1ULL << (WF_N + 4))
+#define WF_SENS   (1ULL << (WF_N + 5))
+#define WF_SNAME  (1ULL << (WF_N + 6))
+#define WF_PCPU   (1ULL << (WF_N + 7))
+_Static_assert(WF_N + 8 <= 64, "frame mask is 64 bits");
+
+// Decimals each ring is quantized to, in HistSet order.
+static const int HIST_DEC[] = { 2, 2, 2, 3, 3, 3, 3, 1, 1, 0, 0, 0, 2, 0, 0, 0, 0 };
+_Static_assert(sizeof(HIST_DEC) / sizeof(HIST_DEC[0]) == HISTSET_N,
+               "HIST_DEC needs an entry per HistSet ring");
+
+#define WT_PID   1
+#define WT_AVG   2
+#define WT_CUR   4
+#define WT_RSS   8
+#define WT_STATE 16
+#define WT_COMM  32
+#define WT_MOVED 64   // row starts as a copy of the viewer's row `from`
+
+typedef struct {
+  int pid;
+  long long avg, cur;           // tenths of a percent
+  long long rss_kb;
+  char state;
+  char comm[64];
+} WireTask;
+
+typedef struct {
+  long long f[WF_N];
+  char iface[64], disk[64];
+  char busy_disk[32], busy_nic[32];
+  int n_freq, n_sens, sens_more;
+  long long freq[FREQ_MAX];     // MHz
+  long long sens[SENS_MAX];     // tenths of a degree
+  char sens_name[SENS_MAX][SENS_NAME];
+  int n_pcpu;
+  long long pcpu[PERF_MAX][3];  // csw/s, IPC x100, miss% x10
+  unsigned long long hseq;      // ring pushes covered so far
+  long long hq[HISTSET_N];      // last ring value sent, quantized
+  int n_tasks, n_rows;
+  WireTask rows[WIRE_TASKS];
+} WireState;
+
+typedef struct {
+  unsigned char *p;
+  int len, cap;
+} WireBuf;
+
+static void wb_reserve(WireBuf *b, int n) {
+  if (b->len + n <= b->cap) return;
+  int cap = MAX(4096, b->cap);
+  while (cap < b->len + n) cap *= 2;
+  b->p = realloc(b->p, (size_t)cap);
+  b->cap = cap;
+}
+
+static void wb_byte(WireBuf *b, unsigned char c) { wb_reserve(b, 1); b->p[b->len++] = c; }
+
+static void wb_varint(WireBuf *b, unsigned long long v) {
+  wb_reserve(b, 10);
+  while (v >= 0x80) { b->p[b->len++] = (unsigned char)(v | 0x80); v >>= 7; }
+  b->p[b->len++] = (unsigned char)v;
+}
+
+static void wb_zz(WireBuf *b, long long v) {
+  wb_varint(b, ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63));
+}
+
+static void wb_str(WireBuf *b, const char *s) {
+  int n = (int)strnlen(s, 63);
+  wb_varint(b, (unsigned long long)n);
+  wb_reserve(b, n);
+  memcpy(b->p + b->len, s, (size_t)n);
+  b->len += n;
+}
+
+// Open a message; wire_end() prefixes its length.
+static int wire_begin(WireBuf *b, char type) {
+  int at = b->len;
+  wb_reserve(b, 3);
+  b->len += 3;
+  wb_byte(b, (unsigned char)type);
+  return at;
+}
+
+static void wire_end(WireBuf *b, int at) {
+  int n = b->len - at - 3;
+  unsigned char hdr[3];
+  int h = 0;
+  unsigned int v = (unsigned int)n;
+  while (v >= 0x80) { hdr[h++] = (unsigned char)(v | 0x80); v >>= 7; }
+  hdr[h++] = (unsigned char)v;
+  memmove(b->p + at + h, b->p + at + 3, (size_t)n);
+  memcpy(b->p + at, hdr, (size_t)h);
+  b->len -= 3 - h;
+}
+
+typedef struct {
+  const unsigned char *p, *end;
+  int bad;
+} WireRd;
+
+static unsigned long long rd_varint(WireRd *r) {
+  unsigned long long v = 0;
+  for (int sh=0; sh<64; sh+=7) {
+    if (r->p >= r->end) { r->bad = 1; return 0; }
+    unsigned char c = *r->p++;
+    v |= (unsigned long long)(c & 0x7f) << sh;
+    if (!(c & 0x80)) return v;
+  }
+  r->bad = 1;
+  return 0;
+}
+
+static long long rd_zz(WireRd *r) {
+  unsigned long long v = rd_varint(r);
+  return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+static void rd_str(WireRd *r, char *out, int n) {
+  unsigned long long len = rd_varint(r);
+  if (len >= (unsigned long long)n || len > (unsigned long long)(r->end - r->p)) {
+    r->bad = 1;
+    return;
+  }
+  memcpy(out, r->p, (size_t)len);
+  out[len] = '\0';
+  r->p += len;
+}
+
+static void wire_quantize(const Sample *s, long long *f) {
+  f[WF_CPU] = fix_key(s->cpu_pct, 2);
+  f[WF_MEM] = fix_key(s->mem_pct, 2);
+  f[WF_MEMT] = (long long)(s->memT >> 10);
+  f[WF_MEMA] = (long long)(s->memA >> 10);
+  f[WF_L1] = fix_key(s->l1, 2);
+  f[WF_L5] = fix_key(s->l5, 2);
+  f[WF_L15] = fix_key(s->l15, 2);
+  f[WF_UP] = fix_key(s->up, 0);
+  f[WF_TC] = fix_key(s->tc, 2);
+  f[WF_DR] = fix_key(s->disk_r_mbs, 3);
+  f[WF_DW] = fix_key(s->disk_w_mbs, 3);
+  f[WF_NRX] = fix_key(s->net_rx_mbs, 3);
+  f[WF_NTX] = fix_key(s->net_tx_mbs, 3);
+  f[WF_RXE] = (long long)s->d_rxE;
+  f[WF_RXD] = (long long)s->d_rxD;
+  f[WF_TXE] = (long long)s->d_txE;
+  f[WF_TXD] = (long long)s->d_txD;
+  f[WF_FS] = fix_key(s->fsPct, 2);
+  f[WF_INO] = fix_key(s->inodePct, 2);
+  f[WF_FSU] = (long long)(s->fsUsedB >> 12);
+  f[WF_FST] = (long long)(s->fsTotB >> 12);
+  f[WF_THR] = (long long)s->thrFlags;
+  f[WF_HAVE] = s->have_tc | (s->have_fs << 1) | (s->have_thr << 2) |
+               (s->have_iface << 3) | (s->have_disk << 4);
+  f[WF_BDISK] = fix_key(s->busy_disk_mbs, 3);
+  f[WF_BNIC] = fix_key(s->busy_nic_mbs, 3);
+  f[WF_MFREE] = (long long)(s->memFree >> 10);
+  f[WF_MANON] = (long long)(s->memAnon >> 10);
+  f[WF_MCACHE] = (long long)(s->memCache >> 10);
+  f[WF_MSHM] = (long long)(s->memShmem >> 10);
+  f[WF_MSLAB] = (long long)(s->memSlab >> 10);
+  f[WF_MDIRTY] = (long long)(s->memDirty >> 10);
+  f[WF_MWB] = (long long)(s->memWback >> 10);
+  f[WF_SWT] = (long long)(s->swapT >> 10);
+  f[WF_SWF] = (long long)(s->swapF >> 10);
+  f[WF_HUGET] = (long long)(s->hugeT >> 10);
+  f[WF_HUGEF] = (long long)(s->hugeF >> 10);
+  f[WF_MAJF] = fix_key(s->majflt_s, 1);
+  f[WF_SCAN] = fix_key(s->pgscan_s, 1);
+  f[WF_STEAL] = fix_key(s->pgsteal_s, 1);
+  f[WF_SWIN] = fix_key(s->swpin_s, 1);
+  f[WF_SWOUT] = fix_key(s->swpout_s, 1);
+  f[WF_OOM] = (long long)s->oomKills;
+  f[WF_FMAX] = s->freq_max_mhz;
+  f[WF_PERF] = s->have_perf;
+  f[WF_CSW] = fix_key(s->csw_s, 0);
+  f[WF_MIG] = fix_key(s->mig_s, 0);
+  f[WF_FLT] = fix_key(s->flt_s, 0);
+  f[WF_IPC] = fix_key(s->ipc, 2);
+  f[WF_MISSP] = fix_key(s->miss_pct, 1);
+  f[WF_FAST] = s->fast_ms;
+  f[WF_CLO] = (long long)s->cpu_lo;
+  f[WF_CP50] = (long long)s->cpu_p50;
+  f[WF_CP99] = (long long)s->cpu_p99;
+  f[WF_CHI] = (long long)s->cpu_hi;
+  f[WF_CALL] = (long long)s->all_p50 | (long long)s->all_p99 << 8 | (long long)s->all_hi << 16;
+}
+
+static void wire_pcpu(const Sample *s, int i, long long *q) {
+  q[0] = fix_key(s->pc_csw[i], 0);
+  q[1] = fix_key(s->pc_ipc[i], 2);
+  q[2] = fix_key(s->pc_miss[i], 1);
+}
+
+static void wire_sample(const WireState *st, Sample *s) {
+  const long long *f = st->f;
+  memset(s, 0, sizeof(*s));
+  s->cpu_pct = (double)f[WF_CPU] / 100.0;
+  s->mem_pct = (double)f[WF_MEM] / 100.0;
+  s->memT = (unsigned long long)f[WF_MEMT] << 10;
+  s->memA = (unsigned long long)f[WF_MEMA] << 10;
+  s->l1 = (double)f[WF_L1] / 100.0;
+  s->l5 = (double)f[WF_L5] / 100.0;
+  s->l15 = (double)f[WF_L15] / 100.0;
+  s->up = (double)f[WF_UP];
+  s->tc = (double)f[WF_TC] / 100.0;
+  s->disk_r_mbs = (double)f[WF_DR] / 1000.0;
+  s->disk_w_mbs = (double)f[WF_DW] / 1000.0;
+  s->net_rx_mbs = (double)f[WF_NRX] / 1000.0;
+  s->net_tx_mbs = (double)f[WF_NTX] / 1000.0;
+  s->d_rxE = (unsigned long long)f[WF_RXE];
+  s->d_rxD = (unsigned long long)f[WF_RXD];
+  s->d_txE = (unsigned long long)f[WF_TXE];
+  s->d_txD = (unsigned long long)f[WF_TXD];
+  s->fsPct = (double)f[WF_FS] / 100.0;
+  s->inodePct = (double)f[WF_INO] / 100.0;
+  s->fsUsedB = (unsigned long long)f[WF_FSU] << 12;
+  s->fsTotB = (unsigned long long)f[WF_FST] << 12;
+  s->thrFlags = (unsigned int)f[WF_THR];
+  s->have_tc = (int)(f[WF_HAVE] & 1);
+  s->have_fs = (int)((f[WF_HAVE] >> 1) & 1);
+  s->have_thr = (int)((f[WF_HAVE] >> 2) & 1);
+  s->have_iface = (int)((f[WF_HAVE] >> 3) & 1);
+  s->have_disk = (int)((f[WF_HAVE] >> 4) & 1);
+  s->busy_disk_mbs = (double)f[WF_BDISK] / 1000.0;
+  s->busy_nic_mbs = (double)f[WF_BNIC] / 1000.0;
+  s->memFree = (unsigned long long)f[WF_MFREE] << 10;
+  s->memAnon = (unsigned long long)f[WF_MANON] << 10;
+  s->memCache = (unsigned long long)f[WF_MCACHE] << 10;
+  s->memShmem = (unsigned long long)f[WF_MSHM] << 10;
+  s->memSlab = (unsigned long long)f[WF_MSLAB] << 10;
+  s->memDirty = (unsigned long long)f[WF_MDIRTY] << 10;
+  s->memWback = (unsigned long long)f[WF_MWB] << 10;
+  s->swapT = (unsigned long long)f[WF_SWT] << 10;
+  s->swapF = (unsigned long long)f[WF_SWF] << 10;
+  s->hugeT = (unsigned long long)f[WF_HUGET] << 10;
+  s->hugeF = (unsigned long long)f[WF_HUGEF] << 10;
+  s->majflt_s = (double)f[WF_MAJF] / 10.0;
+  s->pgscan_s = (double)f[WF_SCAN] / 10.0;
+  s->pgsteal_s = (double)f[WF_STEAL] / 10.0;
+  s->swpin_s = (double)f[WF_SWIN] / 10.0;
+  s->swpout_s = (double)f[WF_SWOUT] / 10.0;
+  s->oomKills = (unsigned long long)f[WF_OOM];
+  s->freq_max_mhz = (unsigned short)f[WF_FMAX];
+  s->have_perf = (int)f[WF_PERF];
+  s->csw_s = (double)f[WF_CSW];
+  s->mig_s = (double)f[WF_MIG];
+  s->flt_s = (double)f[WF_FLT];
+  s->ipc = (double)f[WF_IPC] / 100.0;
+  s->miss_pct = (double)f[WF_MISSP] / 10.0;
+  s->fast_ms = (int)f[WF_FAST];
+  s->cpu_lo = (double)f[WF_CLO];
+  s->cpu_p50 = (double)f[WF_CP50];
+  s->cpu_p99 = (double)f[WF_CP99];
+  s->cpu_hi = (double)f[WF_CHI];
+  s->all_p50 = (double)(f[WF_CALL] & 0xff);
+  s->all_p99 = (double)(f[WF_CALL] >> 8 & 0xff);
+  s->all_hi = (double)(f[WF_CALL] >> 16 & 0xff);
+  s->n_pcpu = st->n_pcpu;
+  for (int i=0; i<st->n_pcpu; i++) {
+    s->pc_csw[i] = (float)st->pcpu[i][0];
+    s->pc_ipc[i] = (float)st->pcpu[i][1] / 100.0f;
+    s->pc_miss[i] = (float)st->pcpu[i][2] / 10.0f;
+  }
+  s->n_freq = st->n_freq;
+  for (int i=0; i<st->n_freq; i++) s->freq_mhz[i] = (unsigned short)st->freq[i];
+  s->n_sens = st->n_sens;
+  s->sens_more = st->sens_more;
+  s->hot = -1;
+  for (int i=0; i<st->n_sens; i++) {
+    s->sens_c[i] = (float)st->sens[i] / 10.0f;
+    memcpy(s->sens_name[i], st->sens_name[i], sizeof(s->sens_name[i]));
+    if (s->hot < 0 || s->sens_c[i] > s->sens_c[s->hot]) s->hot = i;
+  }
+  memcpy(s->iface, st->iface, sizeof(s->iface));
+  memcpy(s->disk, st->disk, sizeof(s->disk));
+  memcpy(s->busy_disk, st->busy_disk, sizeof(s->busy_disk));
+  memcpy(s->busy_nic, st->busy_nic, sizeof(s->busy_nic));
+}
+
+static void wire_hello(WireBuf *b, const char *host, int delay_ms) {
+  int at = wire_begin(b, 'H');
+  wb_varint(b, WIRE_VERSION);
+  wb_str(b, host);
+  wb_varint(b, (unsigned long long)delay_ms);
+  wire_end(b, at);
+}
+
+// Append one frame bringing `st` (what the viewer has) up to date.
+static void wire_frame(WireBuf *b, WireState *st, const Sample *s,
+                       const HistSet *h, const ProcTable *pt) {
+  int at = wire_begin(b, 'F');
+
+  long long f[WF_N];
+  wire_quantize(s, f);
+  unsigned long long mask = 0;
+  for (int i=0; i<WF_N; i++) if (f[i] != st->f[i]) mask |= 1ULL << i;
+  if (strcmp(s->iface, st->iface) != 0) mask |= WF_IFACE;
+  if (strcmp(s->disk, st->disk) != 0) mask |= WF_DISK;
+  if (strcmp(s->busy_disk, st->busy_disk) != 0) mask |= WF_BDISKN;
+  if (strcmp(s->busy_nic, st->busy_nic) != 0) mask |= WF_BNICN;
+  long long sq[SENS_MAX];
+  if (s->n_freq != st->n_freq) mask |= WF_FREQ;
+  for (int i=0; i<s->n_freq; i++) if (s->freq_mhz[i] != st->freq[i]) mask |= WF_FREQ;
+  if (s->n_sens != st->n_sens) mask |= WF_SENS | WF_SNAME;
+  if (s->sens_more != st->sens_more) mask |= WF_SNAME;
+  for (int i=0; i<s->n_sens; i++) {
+    sq[i] = fix_key(s->sens_c[i], 1);
+    if (sq[i] != st->sens[i]) mask |= WF_SENS;
+    if (strcmp(s->sens_name[i], st->sens_name[i]) != 0) mask |= WF_SNAME;
+  }
+  if (s->n_pcpu != st->n_pcpu) mask |= WF_PCPU;
+  for (int i=0; i<s->n_pcpu && !(mask & WF_PCPU); i++) {
+    long long q[3];
+    wire_pcpu(s, i, q);
+    if (memcmp(q, st->pcpu[i], sizeof(q)) != 0) mask |= WF_PCPU;
+  }
+  wb_varint(b, mask);
+  for (int i=0; i<WF_N; i++) {
+    if (mask & (1ULL << i)) { wb_zz(b, f[i] - st->f[i]); st->f[i] = f[i]; }
+  }
+  if (mask & WF_IFACE) { wb_str(b, s->iface); snprintf(st->iface, sizeof(st->iface), "%.63s", s->iface); }
+  if (mask & WF_DISK) { wb_str(b, s->disk); snprintf(st->disk, sizeof(st->disk), "%.63s", s->disk); }
+  if (mask & WF_BDISKN) {
+    wb_str(b, s->busy_disk);
+    snprintf(st->busy_disk, sizeof(st->busy_disk), "%.31s", s->busy_disk);
+  }
+  if (mask & WF_BNICN) {
+    wb_str(b, s->busy_nic);
+    snprintf(st->busy_nic, sizeof(st->busy_nic), "%.31s", s->busy_nic);
+  }
+  // Arrays are sent whole once anything in them changes; entries past a
+  // shrunk count go back to zero so both ends agree on the next delta.
+  if (mask & WF_FREQ) {
+    wb_varint(b, (unsigned long long)s->n_freq);
+    for (int i=0; i<s->n_freq; i++) { wb_zz(b, s->freq_mhz[i] - st->freq[i]); st->freq[i] = s->freq_mhz[i]; }
+    for (int i=s->n_freq; i<st->n_freq; i++) st->freq[i] = 0;
+    st->n_freq = s->n_freq;
+  }
+  if (mask & WF_SENS) {
+    wb_varint(b, (unsigned long long)s->n_sens);
+    for (int i=0; i<s->n_sens; i++) { wb_zz(b, sq[i] - st->sens[i]); st->sens[i] = sq[i]; }
+    for (int i=s->n_sens; i<st->n_sens; i++) st->sens[i] = 0;
+    st->n_sens = s->n_sens;
+  }
+  if (mask & WF_SNAME) {
+    wb_varint(b, (unsigned long long)s->n_sens);
+    for (int i=0; i<s->n_sens; i++) {
+      wb_str(b, s->sens_name[i]);
+      memcpy(st->sens_name[i], s->sens_name[i], sizeof(st->sens_name[i]));
+    }
+    wb_varint(b, (unsigned long long)s->sens_more);
+    st->sens_more = s->sens_more;
+  }
+  if (mask & WF_PCPU) {
+    wb_varint(b, (unsigned long long)s->n_pcpu);
+    for (int i=0; i<s->n_pcpu; i++) {
+      long long q[3];
+      wire_pcpu(s, i, q);
+      for (int k=0; k<3; k++) { wb_zz(b, q[k] - st->pcpu[i][k]); st->pcpu[i][k] = q[k]; }
+    }
+    for (int i=s->n_pcpu; i<st->n_pcpu; i++) memset(st->pcpu[i], 0, sizeof(st->pcpu[i]));
+    st->n_pcpu = s->n_pcpu;
+  }
+
+  // Ring pushes the viewer has not seen, at most what the rings still hold.
+  const Hist *rings = (const Hist*)h;
+  unsigned long long seq = rings[0].seq;
+  unsigned long long k = seq - st->hseq;
+  if (k > (unsigned long long)rings[0].len) k = (unsigned long long)rings[0].len;
+  wb_varint(b, k);
+  if (k > 0) {
+    wb_varint(b, seq - st->hseq);
+    for (int j=0; j<(int)k; j++) {
+      for (int i=0; i<HISTSET_N; i++) {
+        long long q = fix_key(hist_get_lastN(&rings[i], (int)k, j), HIST_DEC[i]);
+        wb_zz(b, q - st->hq[i]);
+        st->hq[i] = q;
+      }
+    }
+    st->hseq = seq;
+  }
+
+  int rows = MIN(pt->n, WIRE_TASKS);
+  wb_varint(b, (unsigned long long)pt->n);
+  wb_varint(b, (unsigned long long)rows);
+
+  // Re-sorting shifts rows around; a row whose task the viewer already has
+  // elsewhere is sent as a move plus deltas against that row.
+  WireTask prev[WIRE_TASKS];
+  int prev_n = st->n_rows;
+  memcpy(prev, st->rows, sizeof(prev));
+  st->n_tasks = pt->n;
+  st->n_rows = rows;
+
+  // Changed rows go after their count, which is only known at the end.
+  unsigned char mk[WIRE_TASKS];
+  unsigned char from[WIRE_TASKS];
+  int nchg = 0;
+  for (int r=0; r<rows; r++) {
+    const ProcTrack *p = &pt->a[r];
+    WireTask *w = &st->rows[r];
+    unsigned char m = 0;
+    if (p->pid != w->pid) {
+      for (int j=0; j<prev_n; j++) {
+        if (prev[j].pid != p->pid) continue;
+        *w = prev[j];
+        from[r] = (unsigned char)j;
+        m |= WT_MOVED;
+        break;
+      }
+    }
+    if (p->pid != w->pid) m |= WT_PID;
+    if (fix_key(p->cpu_avg, 1) != w->avg) m |= WT_AVG;
+    if (fix_key(p->cpu_cur, 1) != w->cur) m |= WT_CUR;
+    if ((long long)(p->rss_bytes >> 10) != w->rss_kb) m |= WT_RSS;
+    if (p->state != w->state) m |= WT_STATE;
+    if (strncmp(p->comm, w->comm, sizeof(w->comm)) != 0) m |= WT_COMM;
+    mk[r] = m;
+    if (m) nchg++;
+  }
+  wb_varint(b, (unsigned long long)nchg);
+  for (int r=0; r<rows; r++) {
+    if (!mk[r]) continue;
+    const ProcTrack *p = &pt->a[r];
+    WireTask *w = &st->rows[r];
+    wb_varint(b, (unsigned long long)r);
+    wb_byte(b, mk[r]);
+    if (mk[r] & WT_MOVED) wb_varint(b, from[r]);
+    if (mk[r] & WT_PID) { wb_zz(b, (long long)p->pid - w->pid); w->pid = p->pid; }
+    if (mk[r] & WT_AVG) { long long q = fix_key(p->cpu_avg, 1); wb_zz(b, q - w->avg); w->avg = q; }
+    if (mk[r] & WT_CUR) { long long q = fix_key(p->cpu_cur, 1); wb_zz(b, q - w->cur); w->cur = q; }
+    if (mk[r] & WT_RSS) {
+      long long q = (long long)(p->rss_bytes >> 10);
+      wb_zz(b, q - w->rss_kb);
+      w->rss_kb = q;
+    }
+    if (mk[r] & WT_STATE) { wb_byte(b, (unsigned char)p->state); w->state = p->state; }
+    if (mk[r] & WT_COMM) { wb_str(b, p->comm); snprintf(w->comm, sizeof(w->comm), "%.63s", p->comm); }
+  }
+
+  wire_end(b, at);
+}
+
+// Deltas from the wire wrap instead of overflowing, whatever the peer sends.
+static long long zz_add(long long a, long long d) {
+  return (long long)((unsigned long long)a + (unsigned long long)d);
+}
+
+// Apply a frame payload (after the type byte). `h` may be NULL to drop the
+// ring values. Returns 0 if the message was malformed.
+static int wire_apply_frame(WireState *st, WireRd *r, HistSet *h) {
+  unsigned long long mask = rd_varint(r);
+  for (int i=0; i<WF_N; i++) if (mask & (1ULL << i)) st->f[i] = zz_add(st->f[i], rd_zz(r));
+  if (mask & WF_IFACE) rd_str(r, st->iface, sizeof(st->iface));
+  if (mask & WF_DISK) rd_str(r, st->disk, sizeof(st->disk));
+  if (mask & WF_BDISKN) rd_str(r, st->busy_disk, sizeof(st->busy_disk));
+  if (mask & WF_BNICN) rd_str(r, st->busy_nic, sizeof(st->busy_nic));
+  if (mask & WF_FREQ) {
+    unsigned long long n = rd_varint(r);
+    if (n > FREQ_MAX) return 0;
+    for (int i=0; i<(int)n; i++) st->freq[i] = zz_add(st->freq[i], rd_zz(r));
+    for (int i=(int)n; i<st->n_freq; i++) st->freq[i] = 0;
+    st->n_freq = (int)n;
+  }
+  if (mask & WF_SENS) {
+    unsigned long long n = rd_varint(r);
+    if (n > SENS_MAX) return 0;
+    for (int i=0; i<(int)n; i++) st->sens[i] = zz_add(st->sens[i], rd_zz(r));
+    for (int i=(int)n; i<st->n_sens; i++) st->sens[i] = 0;
+    st->n_sens = (int)n;
+  }
+  if (mask & WF_SNAME) {
+    unsigned long long n = rd_varint(r);
+    if (n > SENS_MAX) return 0;
+    for (int i=0; i<(int)n; i++) rd_str(r, st->sens_name[i], sizeof(st->sens_name[i]));
+    unsigned long long more = rd_varint(r);
+    st->sens_more = (int)MIN(more, 1u << 20);
+  }
+  if (mask & WF_PCPU) {
+    unsigned long long n = rd_varint(r);
+    if (n > PERF_MAX) return 0;
+    for (int i=0; i<(int)n; i++) {
+      for (int k=0; k<3; k++) st->pcpu[i][k] = zz_add(st->pcpu[i][k], rd_zz(r));
+    }
+    for (int i=(int)n; i<st->n_pcpu; i++) memset(st->pcpu[i], 0, sizeof(st->pcpu[i]));
+    st->n_pcpu = (int)n;
+  }
+
+  unsigned long long k = rd_varint(r);
+  if (k > HIST_MAX) return 0;
+  if (k > 0) {
+    st->hseq += rd_varint(r);
+    Hist *rings = h ? (Hist*)h : NULL;
+    for (int j=0; j<(int)k && !r->bad; j++) {
+      for (int i=0; i<HISTSET_N; i++) {
+        st->hq[i] = zz_add(st->hq[i], rd_zz(r));
+        if (rings) hist_push(&rings[i], (double)st->hq[i] / (double)POW10[HIST_DEC[i]]);
+      }
+    }
+    if (rings) for (int i=0; i<HISTSET_N; i++) rings[i].seq = st->hseq;
+  }
+
+  st->n_tasks = (int)rd_varint(r);
+  unsigned long long rows = rd_varint(r);
+  unsigned long long nchg = rd_varint(r);
+  if (rows > WIRE_TASKS || nchg > rows) return 0;
+  WireTask prev[WIRE_TASKS];
+  memcpy(prev, st->rows, sizeof(prev));
+  st->n_rows = (int)rows;
+  for (int c=0; c<(int)nchg && !r->bad; c++) {
+    unsigned long long idx = rd_varint(r);
+    if (idx >= rows || r->p >= r->end) return 0;
+    unsigned char m = *r->p++;
+    WireTask *w = &st->rows[idx];
+    if (m & WT_MOVED) {
+      unsigned long long j = rd_varint(r);
+      if (j >= WIRE_TASKS) return 0;
+      *w = prev[j];
+    }
+    if (m & WT_PID) w->pid = (int)zz_add(w->pid, rd_zz(r));
+    if (m & WT_AVG) w->avg = zz_add(w->avg, rd_zz(r));
+    if (m & WT_CUR) w->cur = zz_add(w->cur, rd_zz(r));
+    if (m & WT_RSS) w->rss_kb = zz_add(w->rss_kb, rd_zz(r));
+    if (m & WT_STATE) {
+      if (r->p >= r->end) return 0;
+      w->state = (char)*r->p++;
+    }
+    if (m & WT_COMM) rd_str(r, w->comm, sizeof(w->comm));
+  }
+  return !r->bad;
+}
+
+static void wire_tasks(const WireState *st, ProcTrack *out) {
+  for (int r=0; r<st->n_rows; r++) {
+    const WireTask *w = &st->rows[r];
+    ProcTrack *p = &out[r];
+    memset(p, 0, sizeof(*p));
+    p->pid = w->pid;
+    memcpy(p->comm, w->comm, sizeof(p->comm));
+    p->state = w->state;
+    p->cpu_avg = (double)w->avg / 10.0;
+    p->cpu_cur = (double)w->cur / 10.0;
+    p->rss_bytes = (unsigned long long)w->rss_kb << 10;
+  }
+}
+
+// Viewer side of one agent connection. Connects without blocking and
+// retries every WIRE_RETRY_S after a failure or a dropped link.
+#define WIRE_RETRY_S 2.0
+
+typedef struct {
+  char spec[128];
+  int fd;
+  int connecting;
+  double t_retry;
+  unsigned char *in;
+  int in_len, in_cap;
+  int up;                       // hello received on this connection
+  char host[64];
+  int delay_ms;
+  WireState st;
+  ProcTrack rows[WIRE_TASKS];
+  ProcTable pt;                 // view of `rows` for the TASKS panel
+} WireConn;
+
+static void wire_conn_init(WireConn *c, const char *spec) {
+  memset(c, 0, sizeof(*c));
+  snprintf(c->spec, sizeof(c->spec), "%s", spec);
+  c->fd = -1;
+  c->pt.a = c->rows;
+  c->pt.cap = WIRE_TASKS;
+}
+
+static void wire_conn_close(WireConn *c) {
+  if (c->fd >= 0) close(c->fd);
+  c->fd = -1;
+  c->connecting = 0;
+  c->up = 0;
+  c->in_len = 0;
+  c->t_retry = now_s() + WIRE_RETRY_S;
+}
+
+static void wire_conn_free(WireConn *c) {
+  if (c->fd >= 0) close(c->fd);
+  c->fd = -1;
+  free(c->in);
+  c->in = NULL;
+}
+
+static void wire_conn_start(WireConn *c) {
+  char host[128];
+  const char *port = split_hostport(c->spec, host, sizeof(host));
+  struct addrinfo hints, *res = NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &res) != 0 || !res) { wire_conn_close(c); return; }
+
+  int fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol);
+  if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0 && errno != EINPROGRESS) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) { wire_conn_close(c); return; }
+  c->fd = fd;
+  c->connecting = 1;
+}
+
+// Drive the connection without blocking: connect, read what has arrived and
+// apply every complete message. Returns the number of frames applied;
+// `s`/`h` receive them (h may be NULL).
+static int wire_conn_poll(WireConn *c, Sample *s, HistSet *h) {
+  if (c->fd < 0) {
+    if (now_s() >= c->t_retry) wire_conn_start(c);
+    if (c->fd < 0) return 0;
+  }
+  if (c->connecting) {
+    struct pollfd pf = { c->fd, POLLOUT, 0 };
+    if (poll(&pf, 1, 0) <= 0) return 0;
+    int err = 0;
+    socklen_t el = sizeof(err);
+    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &el);
+    if (err) { wire_conn_close(c); return 0; }
+    c->connecting = 0;
+  }
+
+  // Start small: a fleet holds hundreds of these, and only the initial
+  // sync needs more than a few KB.
+  for (;;) {
+    if (c->in_cap - c->in_len < 8192) {
+      c->in_cap = MAX(c->in_cap * 2, 16384);
+      c->in = realloc(c->in, (size_t)c->in_cap);
+    }
+    ssize_t r = recv(c->fd, c->in + c->in_len, (size_t)(c->in_cap - c->in_len), MSG_DONTWAIT);
+    if (r > 0) {
+      c->in_len += (int)r;
+      if (c->in_len <= 2 * WIRE_MAX_MSG) continue;
+    }
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    wire_conn_close(c);  // EOF or error; keep the last data on screen
+    return 0;
+  }
+
+  int frames = 0, off = 0;
+  while (off < c->in_len) {
+    WireRd r = { c->in + off, c->in + c->in_len, 0 };
+    unsigned long long n = rd_varint(&r);
+    if (r.bad) break;  // length not complete yet
+    if (n == 0 || n > WIRE_MAX_MSG) { wire_conn_close(c); return frames; }
+    if ((unsigned long long)(r.end - r.p) < n) break;
+    WireRd m = { r.p, r.p + n, 0 };
+    off = (int)(r.p + n - c->in);
+    char type = (char)*m.p++;
+    if (type == 'H') {
+      if (rd_varint(&m) != WIRE_VERSION) { wire_conn_close(c); return frames; }
+      rd_str(&m, c->host, sizeof(c->host));
+      c->delay_ms = (int)rd_varint(&m);
+      // The agent starts this peer from scratch, history included.
+      memset(&c->st, 0, sizeof(c->st));
+      if (h) memset(h, 0, sizeof(*h));
+      c->up = !m.bad;
+    } else if (type == 'F' && c->up) {
+      if (!wire_apply_frame(&c->st, &m, h)) { wire_conn_close(c); return frames; }
+      frames++;
+    }
+  }
+  memmove(c->in, c->in + off, (size_t)(c->in_len - off));
+  c->in_len -= off;
+  if (c->in_cap > 65536 && c->in_len < 4096) {
+    c->in_cap = 16384;
+    c->in = realloc(c->in, (size_t)c->in_cap);
+  }
+
+  if (frames > 0) {
+    wire_sample(&c->st, s);
+    wire_tasks(&c->st, c->rows);
+    c->pt.n = c->st.n_rows;
+  }
+  return frames;
+}
+
+// Ask the agent for a fresh hello and full frame, history included.
+static void wire_conn_resync(WireConn *c) {
+  if (c->fd >= 0 && !c->connecting) send(c->fd, "R", 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// ---------------------------
+// Fleet (many agents, one loop)
+// ---------------------------
+// One WireConn per agent, all on a single epoll set. Only the host being
+// drilled into gets a HistSet (~280 KB); the rest decode into their Sample
+// and task rows and let the history deltas fall on the floor.
+#define FLEET_MAX 1024
+
+enum { FC_HOST, FC_CPU, FC_MEM, FC_TEMP, FC_PWR, FC_DISK, FC_NET, FC_TOP, FC_N };
+
+typedef struct {
+  WireConn c;
+  Sample s;
+  HistSet *h;
+  int fd_reg;                   // socket in the epoll set, -1 if none
+  int seen;                     // a frame has ever arrived
+  unsigned long long frames;
+} FleetHost;
+
+typedef struct {
+  FleetHost *hosts;
+  int n;
+  int ep;
+  int *order;                   // display order, see fleet_sort
+  int sort_col, sort_desc;
+} Fleet;
+
+// HOSTS is "host:port,host:port,..." or "@file" with one per line;
+// whitespace also separates and '#' starts a comment.
+static int fleet_init(Fleet *f, const char *list) {
+  memset(f, 0, sizeof(*f));
+  f->ep = -1;
+  f->sort_col = FC_CPU;
+  f->sort_desc = 1;
+
+  char *text = NULL;
+  if (list[0] == '@') {
+    FILE *fp = fopen(list + 1, "r");
+    if (!fp) { fprintf(stderr, "sparta-mon: --fleet %s: %s\n", list + 1, strerror(errno)); return 0; }
+    size_t cap = 0, len = 0;
+    for (;;) {
+      if (cap - len < 4096) { cap = MAX(cap * 2, 8192); text = realloc(text, cap); }
+      size_t r = fread(text + len, 1, cap - len - 1, fp);
+      if (r == 0) break;
+      len += r;
+    }
+    fclose(fp);
+    text[len] = '\0';
+  } else {
+    text = strdup(list);
+  }
+
+  f->hosts = calloc(FLEET_MAX, sizeof(FleetHost));
+  f->order = calloc(FLEET_MAX, sizeof(int));
+  for (char *line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+    char *save = NULL;
+    for (char *tok = strtok_r(line, ", \t\r", &save); tok; tok = strtok_r(NULL, ", \t\r", &save)) {
+      if (f->n == FLEET_MAX) { fprintf(stderr, "sparta-mon: --fleet: more than %d hosts\n", FLEET_MAX); free(text); return 0; }
+      FleetHost *h = &f->hosts[f->n];
+      wire_conn_init(&h->c, tok);
+      h->fd_reg = -1;
+      f->order[f->n] = f->n;
+      f->n++;
+    }
+  }
+  free(text);
+  if (f->n == 0) { fprintf(stderr, "sparta-mon: --fleet: no hosts\n"); return 0; }
+
+  f->ep = epoll_create1(EPOLL_CLOEXEC);
+  if (f->ep < 0) { fprintf(stderr, "sparta-mon: epoll: %s\n", strerror(errno)); return 0; }
+  return 1;
+}
+
+static void fleet_free(Fleet *f) {
+  for (int i=0; i<f->n; i++) {
+    wire_conn_free(&f->hosts[i].c);
+    free(f->hosts[i].h);
+  }
+  if (f->ep >= 0) close(f->ep);
+  free(f->hosts);
+  free(f->order);
+  f->hosts = NULL;
+  f->order = NULL;
+  f->n = 0;
+}
+
+// (Re)connect hosts that are due, then wait up to `timeout_ms` for traffic
+// and apply it. Returns the number of frames applied.
+static int fleet_poll(Fleet *f, int timeout_ms) {
+  double now = now_s();
+  for (int i=0; i<f->n; i++) {
+    FleetHost *h = &f->hosts[i];
+    WireConn *c = &h->c;
+    if (c->fd < 0) {
+      h->fd_reg = -1;           // close() already took it out of the set
+      if (now < c->t_retry) continue;
+      wire_conn_start(c);
+      if (c->fd < 0) continue;
+    }
+    if (h->fd_reg != c->fd) {
+      // Edge-triggered: wire_conn_poll reads until EAGAIN, and EPOLLOUT
+      // fires once when the connect completes.
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+      ev.data.u32 = (unsigned)i;
+      if (epoll_ctl(f->ep, EPOLL_CTL_ADD, c->fd, &ev) != 0) { wire_conn_close(c); continue; }
+      h->fd_reg = c->fd;
+    }
+  }
+
+  struct epoll_event ev[64];
+  int n = epoll_wait(f->ep, ev, 64, timeout_ms);
+  int frames = 0;
+  for (int k=0; k<n; k++) {
+    FleetHost *h = &f->hosts[ev[k].data.u32];
+    int got = wire_conn_poll(&h->c, &h->s, h->h);
+    if (got > 0) { h->seen = 1; h->frames += (unsigned long long)got; }
+    frames += got;
+  }
+  return frames;
+}
 
-  int n = MIN(count, pw);
-  n = MIN(n, MIN(a->len, b->len));
+static const char *fleet_name(const FleetHost *h) {
+  return h->c.host[0] ? h->c.host : h->c.spec;
+}
 
-  wattron(w, A_BOLD);
-  mvwprintw(w, 0, 2, " %s ", title);
-  wattroff(w, A_BOLD);
+// Sort key for the numeric columns; -1 when the host has no value.
+static double fleet_key(const FleetHost *h, int col) {
+  const Sample *s = &h->s;
+  switch (col) {
+    case FC_CPU:  return s->cpu_pct;
+    case FC_MEM:  return s->mem_pct;
+    case FC_TEMP: return s->have_tc ? s->tc : -1.0;
+    case FC_PWR:  // current conditions outrank ones since boot
+      return s->have_thr ? (double)(((s->thrFlags & 0xfu) << 4) | ((s->thrFlags >> 16) & 0xfu)) : -1.0;
+    case FC_DISK: return s->busy_disk[0] ? s->busy_disk_mbs : -1.0;
+    case FC_NET:  return s->busy_nic[0] ? s->busy_nic_mbs : -1.0;
+    case FC_TOP:  return h->c.pt.n > 0 ? h->c.rows[0].cpu_avg : -1.0;
+  }
+  return 0.0;
+}
 
-  double la = hist_get_latest(a);
-  double lb = hist_get_latest(b);
+static const Fleet *g_fleet_cmp;
+
+static int fleet_cmp(const void *a, const void *b) {
+  const Fleet *f = g_fleet_cmp;
+  const FleetHost *x = &f->hosts[*(const int*)a];
+  const FleetHost *y = &f->hosts[*(const int*)b];
+  // Hosts that never reported go last whichever way the column sorts.
+  if (x->seen != y->seen) return y->seen - x->seen;
+  int r = 0;
+  if (f->sort_col == FC_HOST) {
+    r = strcmp(fleet_name(x), fleet_name(y));
+  } else {
+    double kx = fleet_key(x, f->sort_col), ky = fleet_key(y, f->sort_col);
+    r = (kx > ky) - (kx < ky);
+  }
+  if (f->sort_desc) r = -r;
+  return r ? r : strcmp(x->c.spec, y->c.spec);
+}
 
-  char top[128];
-  snprintf(top, sizeof(top), "%s %.1f%s  %s %.1f%s",
-           labelA, la, unit?unit:"",
-           labelB, lb, unit?unit:"");
-  mvwprintw(w, 0, MAX(2, W-(int)strlen(top)-2), "%s", top);
+static void fleet_sort(Fleet *f) {
+  g_fleet_cmp = f;
+  qsort(f->order, (size_t)f->n, sizeof(int), fleet_cmp);
+}
 
-  if (extraLine && *extraLine && H >= 6) {
-    mvwprintw(w, 1, 2, "%.*s", W-4, extraLine);
-  }
+// Clicking the sorted column again flips it; a new column starts with the
+// busiest (or, for HOST, alphabetical) first.
+static void fleet_sort_by(Fleet *f, int col) {
+  if (col == f->sort_col) f->sort_desc = !f->sort_desc;
+  else { f->sort_col = col; f->sort_desc = (col != FC_HOST); }
+}
 
-  int midy = y0 + ph/2;
-  for (int x=x0; x<=x1; x++) mvwaddch(w, midy, x, ACS_HLINE);
+static const struct { const char *name; int width, right; } FLEET_COLS[FC_N] = {
+  { "HOST", 16, 0 }, { "CPU%", 6, 1 }, { "MEM%", 6, 1 }, { "TEMP", 6, 1 },
+  { "PWR", 10, 0 }, { "DISK MB/s", 17, 0 }, { "NET MB/s", 17, 0 }, { "TOP TASK", 0, 0 },
+};
 
-  double range = vmax - vmin;
-  if (range <= 0.0001) range = 1.0;
+static void fleet_cell_end(TextBuf *b, int from, int col) {
+  if (FLEET_COLS[col].right) tb_rjust(b, from, FLEET_COLS[col].width);
+  else tb_pad(b, from, FLEET_COLS[col].width);
+  if (col + 1 < FC_N) tb_str(b, "  ");
+}
 
-  int prevx=-1, prevy=-1;
-  if (colorA > 0) wattron(w, COLOR_PAIR(colorA));
-  for (int col=0; col<n; col++) {
-    double val = hist_get_lastN(a, n, col);
-    double t = (val - vmin) / range;
-    if (t < 0) t = 0;
-    if (t > 1) t = 1;
-    int y = y1 - (int)(t * (ph - 1) + 0.5);
-    int x = x0 + col;
-
-    mvwaddch(w, y, x, 'o');
-
-    if (prevx >= 0) {
-      int dy = y - prevy;
-      int steps = abs(dy);
-      if (steps > 0) {
-        int dir = (dy > 0) ? 1 : -1;
-        for (int s=1; s<=steps; s++) {
-          int yy = prevy + s*dir;
-          mvwaddch(w, yy, x, ACS_VLINE);
-        }
-      }
-    }
-    prevx=x; prevy=y;
-  }
-  if (colorA > 0) wattroff(w, COLOR_PAIR(colorA));
-
-  prevx=-1; prevy=-1;
-  if (colorB > 0) wattron(w, COLOR_PAIR(colorB));
-  for (int col=0; col<n; col++) {
-    double val = hist_get_lastN(b, n, col);
-    double t = (val - vmin) / range;
-    if (t < 0) t = 0;
-    if (t > 1) t = 1;
-    int y = y1 - (int)(t * (ph - 1) + 0.5);
-    int x = x0 + col;
-
-    chtype existing = mvwinch(w, y, x);
-    char ch = (char)(existing & A_CHARTEXT);
-    if (ch == 'o') mvwaddch(w, y, x, 'X');
-    else mvwaddch(w, y, x, '*');
-
-    if (prevx >= 0) {
-      int dy = y - prevy;
-      int steps = abs(dy);
-      if (steps > 0) {
-        int dir = (dy > 0) ? 1 : -1;
-        for (int s=1; s<=steps; s++) {
-          int yy = prevy + s*dir;
-          chtype ex2 = mvwinch(w, yy, x);
-          char ch2 = (char)(ex2 & A_CHARTEXT);
-          if (ch2 == 'o') mvwaddch(w, yy, x, 'X');
-          else if (ch2 == 0 || ch2 == ' ' || ch2 == ACS_HLINE) mvwaddch(w, yy, x, ACS_VLINE);
-        }
-      }
-    }
-    prevx=x; prevy=y;
+static void fleet_header(const Fleet *f, TextBuf *b) {
+  for (int col=0; col<FC_N; col++) {
+    int from = b->len;
+    tb_str(b, FLEET_COLS[col].name);
+    if (col == f->sort_col) tb_ch(b, f->sort_desc ? 'v' : '^');
+    fleet_cell_end(b, from, col);
   }
-  if (colorB > 0) wattroff(w, COLOR_PAIR(colorB));
 }
 
-// ---------------------------
-// Resize handling
-// ---------------------------
-static volatile sig_atomic_t g_resized = 0;
-static void on_winch(int sig) { (void)sig; g_resized = 1; }
+static void fleet_dev(TextBuf *b, const char *name, double mbs) {
+  int from = b->len;
+  tb_strn(b, name, 9);
+  tb_pad(b, from, 10);
+  tb_fix(b, mbs, 1);
+}
+
+static void fleet_row(const FleetHost *h, TextBuf *b) {
+  const Sample *s = &h->s;
+  int from = b->len;
+  tb_strn(b, fleet_name(h), FLEET_COLS[FC_HOST].width);
+  fleet_cell_end(b, from, FC_HOST);
+  if (!h->seen) { tb_str(b, h->c.connecting ? "connecting" : "down"); return; }
+
+  from = b->len; tb_fix(b, s->cpu_pct, 1); fleet_cell_end(b, from, FC_CPU);
+  from = b->len; tb_fix(b, s->mem_pct, 1); fleet_cell_end(b, from, FC_MEM);
+  from = b->len;
+  if (s->have_tc) { tb_fix(b, s->tc, 1); tb_ch(b, 'C'); } else tb_str(b, "n/a");
+  fleet_cell_end(b, from, FC_TEMP);
+
+  from = b->len;
+  if (!s->have_thr) tb_str(b, "n/a");
+  else {
+    char thr[96];
+    throttled_summary(s->thrFlags, thr, sizeof(thr));
+    tb_str(b, thr + 4);  // drop the "PWR " prefix
+  }
+  fleet_cell_end(b, from, FC_PWR);
+
+  from = b->len;
+  if (s->busy_disk[0]) fleet_dev(b, s->busy_disk, s->busy_disk_mbs); else tb_str(b, "n/a");
+  fleet_cell_end(b, from, FC_DISK);
+  from = b->len;
+  if (s->busy_nic[0]) fleet_dev(b, s->busy_nic, s->busy_nic_mbs); else tb_str(b, "n/a");
+  fleet_cell_end(b, from, FC_NET);
+
+  if (h->c.pt.n > 0) {
+    const ProcTrack *p = &h->c.rows[0];
+    tb_strn(b, p->comm, 20);
+    tb_ch(b, ' ');
+    tb_fix(b, p->cpu_avg, 1);
+    tb_ch(b, '%');
+  }
+  if (!h->c.up) tb_str(b, h->c.pt.n > 0 ? "  (lost)" : "(lost)");
+}
 
 // ---------------------------
-// Main
+// UI (header + 3x2 grid)
 // ---------------------------
-int main(void) {
-  setlocale(LC_ALL, "");
-  signal(SIGWINCH, on_winch);
+// "cpu 0.8/1.0% scan/2 650ms" for the header.
+static void gov_label(const Governor *g, const Collector *c, TextBuf *b) {
+  tb_str(b, "cpu ");
+  tb_fix(b, g->share * 100.0, 1); tb_ch(b, '/');
+  tb_fix(b, g->target * 100.0, 1); tb_ch(b, '%');
+  if (c->proc_every > 1) { tb_str(b, " scan/"); tb_i64(b, c->proc_every); }
+  tb_ch(b, ' '); tb_i64(b, g->delay_ms); tb_str(b, "ms");
+}
 
-  initscr();
+// One TASKS row: a task, or one of an expanded task's threads.
+typedef struct {
+  const ProcTrack *p;
+  int tid;                      // 0 for the task itself
+} TaskLine;
+
+typedef struct {
+  WINDOW *wHdr;
+  WINDOW *wCpu, *wMem;
+  WINDOW *wTmp, *wDisk;
+  WINDOW *wProc, *wNet;
+
+  Panel pCpu, pMem, pTmp, pDisk, pNet;
+  TextPanel tHdr, tProc, tNet;  // tNet: NET panel in socket view
+  TextPanel tDisk;              // DISK panel in mounts view
+  HeaderText hdr;
+  TaskRowKey *rowKeys;
+  Threads *thr;      // thread drill-down, NULL when /proc is another host's
+  Socks *socks;      // NET socket view, NULL likewise
+  Mounts *mnt;       // DISK mounts view, NULL likewise
+  TaskLine *rows;    // TASKS rows this frame: tasks plus expanded threads
+  int nrows, rows_cap;
+  int sel;           // selected row
+  int sel_pid, sel_tid;  // what it shows, so it follows re-sorts
+  int sel_moved;     // a key moved `sel`; re-read pid/tid from it
+  Filter filt;       // `/` filter over TASKS
+  int editing;       // keys go to the filter text
+  int nmatch;        // tasks it let through this frame
+
+  int use_color;
+  int drawn_color;   // colour mode the chrome was last drawn in
+  int delay_ms;
+  char src[96];      // where frames come from, empty when sampling ourselves
+  const char *rec;   // trigger text while an anomaly snapshot is recording
+  char gov[64];      // overhead governor state, empty when it is off
+  int mem_view;      // MEM panel plots usage (0) or faults/reclaim (1)
+  int cpu_view;      // CPU panel plots usage, csw/mig, faults or IPC
+  int net_view;      // NET panel plots traffic (0) or ranks sockets (1)
+  int disk_view;     // DISK panel plots I/O (0) or lists mounts (1)
+  int scroll;
+  int lines, cols;
+} UI;
+
+// Terminal modes and colour pairs; initscr()/newterm() must come first.
+static void ui_start(UI *u) {
   cbreak();
   noecho();
   keypad(stdscr, TRUE);
   nodelay(stdscr, TRUE);
+  set_escdelay(25);
   curs_set(0);
   leaveok(stdscr, TRUE);
 
-  int use_color = has_colors();
-  if (use_color) {
+  u->use_color = has_colors();
+  if (u->use_color) {
     start_color();
     use_default_colors();
     init_pair(1, COLOR_MAGENTA, -1); // title
@@ -706,395 +5653,1340 @@ int main(void) {
     init_pair(6, COLOR_RED, -1);     // hot
     init_pair(7, COLOR_MAGENTA, -1); // magenta
   }
+  u->drawn_color = u->use_color;
+  u->delay_ms = DEFAULT_DELAY_MS;
+}
 
-  int delay_ms = DEFAULT_DELAY_MS;
-  int running = 1;
-
-  Hist h_cpu={0}, h_mem={0}, h_temp={0};
-  Hist h_disk_r={0}, h_disk_w={0};
-  Hist h_net_rx={0}, h_net_tx={0};
+static void ui_delwins(UI *u) {
+  if (u->wHdr) delwin(u->wHdr);
+  if (u->wCpu) delwin(u->wCpu);
+  if (u->wMem) delwin(u->wMem);
+  if (u->wTmp) delwin(u->wTmp);
+  if (u->wDisk) delwin(u->wDisk);
+  if (u->wProc) delwin(u->wProc);
+  if (u->wNet) delwin(u->wNet);
+}
 
-  unsigned long long prev_tot=0, prev_idle=0;
-  read_cpu(&prev_tot, &prev_idle);
+static int ui_needs_layout(const UI *u) {
+  return LINES != u->lines || COLS != u->cols;
+}
 
-  char iface[64] = {0};
-  int have_iface = choose_iface(iface, sizeof(iface));
-  unsigned long long prev_rxB=0, prev_txB=0, prev_rxE=0, prev_rxD=0, prev_txE=0, prev_txD=0;
-  int have_prev_net = 0;
+static void ui_layout(UI *u) {
+  endwin(); refresh();
+  ui_delwins(u);
 
-  char disk[64] = {0};
-  int have_disk = choose_disk(disk, sizeof(disk));
-  unsigned long long prev_rdsec=0, prev_wrsec=0;
-  int have_prev_disk = 0;
+  u->lines = LINES;
+  u->cols  = COLS;
 
-  ProcTable pt; proctable_init(&pt);
-  int scroll = 0;
+  // Header + 3x2 grid below it
+  int header_h = 2;
+  int avail_h = MAX(6, LINES - header_h);
 
-  WINDOW *wHdr=NULL;
-  WINDOW *wCpu=NULL, *wMem=NULL;
-  WINDOW *wTmp=NULL, *wDisk=NULL;
-  WINDOW *wProc=NULL, *wNet=NULL;
+  int h1 = MAX(6, avail_h / 3);
+  int h2 = MAX(6, avail_h / 3);
+  int h3 = MAX(6, avail_h - h1 - h2);
 
-  int last_lines=0, last_cols=0;
-  double t_prev = now_s();
+  int wL = MAX(20, COLS / 2);
+  int wR = MAX(20, COLS - wL);
 
-  while (running) {
-    if (g_resized || LINES != last_lines || COLS != last_cols) {
-      g_resized = 0;
-      endwin(); refresh();
+  u->wHdr  = newwin(header_h, COLS, 0, 0);
 
-      if (wHdr) delwin(wHdr);
-      if (wCpu) delwin(wCpu);
-      if (wMem) delwin(wMem);
-      if (wTmp) delwin(wTmp);
-      if (wDisk) delwin(wDisk);
-      if (wProc) delwin(wProc);
-      if (wNet) delwin(wNet);
+  int y0 = header_h;
+  u->wCpu  = newwin(h1, wL, y0, 0);
+  u->wMem  = newwin(h1, wR, y0, wL);
 
-      last_lines = LINES;
-      last_cols  = COLS;
+  int y1 = y0 + h1;
+  u->wTmp  = newwin(h2, wL, y1, 0);
+  u->wDisk = newwin(h2, wR, y1, wL);
 
-      // Header + 3x2 grid below it
-      int header_h = 2;
-      int avail_h = MAX(6, LINES - header_h);
+  int y2 = y1 + h2;
+  u->wProc = newwin(h3, wL, y2, 0);   // bottom-left (TASKS)
+  u->wNet  = newwin(h3, wR, y2, wL);  // bottom-right (NET)
 
-      int h1 = MAX(6, avail_h / 3);
-      int h2 = MAX(6, avail_h / 3);
-      int h3 = MAX(6, avail_h - h1 - h2);
+  panel_attach(&u->pCpu, u->wCpu);
+  panel_attach(&u->pMem, u->wMem);
+  panel_attach(&u->pTmp, u->wTmp);
+  panel_attach(&u->pDisk, u->wDisk);
+  panel_attach(&u->pNet, u->wNet);
+  textpanel_attach(&u->tHdr, u->wHdr);
+  textpanel_attach(&u->tProc, u->wProc);
+  textpanel_attach(&u->tNet, u->wNet);
+  textpanel_attach(&u->tDisk, u->wDisk);
+  free(u->rowKeys);
+  u->rowKeys = calloc((size_t)u->tProc.nrows, sizeof(TaskRowKey));
 
-      int wL = MAX(20, COLS / 2);
-      int wR = MAX(20, COLS - wL);
+  u->scroll = 0;
+}
 
-      wHdr  = newwin(header_h, COLS, 0, 0);
+static void ui_free(UI *u) {
+  panel_free(&u->pCpu); panel_free(&u->pMem); panel_free(&u->pTmp);
+  panel_free(&u->pDisk); panel_free(&u->pNet);
+  textpanel_free(&u->tHdr); textpanel_free(&u->tProc); textpanel_free(&u->tNet);
+  textpanel_free(&u->tDisk);
+  free(u->rowKeys);
+  u->rowKeys = NULL;
+  free(u->rows);
+  u->rows = NULL;
+  u->rows_cap = 0;
+  filter_free(&u->filt);
+  ui_delwins(u);
+}
 
-      int y0 = header_h;
-      wCpu  = newwin(h1, wL, y0, 0);
-      wMem  = newwin(h1, wR, y0, wL);
+static void ui_draw_header(UI *u, const Sample *s) {
+  TextPanel *t = &u->tHdr;
+  if (!t->chrome) {
+    werase(u->wHdr);
+    textpanel_clear_rows(t);
+    if (u->use_color) wattron(u->wHdr, COLOR_PAIR(1) | A_BOLD);
+    mvwprintw(u->wHdr, 0, 2, "SPARTA//MON");
+    if (u->use_color) wattroff(u->wHdr, COLOR_PAIR(1) | A_BOLD);
+    t->chrome = 1;
+  }
 
-      int y1 = y0 + h1;
-      wTmp  = newwin(h2, wL, y1, 0);
-      wDisk = newwin(h2, wR, y1, wL);
+  int hdrAttr = u->use_color ? COLOR_PAIR(5) : 0;
+  char line1[256];
+  TextBuf hb;
+  tb_init(&hb, line1, sizeof(line1));
+  tb_str(&hb, "q quit | +/- speed | arrows select | c color | w ");
+  tb_str(&hb, g_sweep ? "scroll" : "sweep");
+  tb_str(&hb, " | m mem | p perf | n socks | f mounts | enter threads | / filter | ");
+  tb_i64(&hb, u->delay_ms);
+  tb_str(&hb, "ms");
+  if (u->src[0]) { tb_str(&hb, " | "); tb_str(&hb, u->src); }
+  if (u->gov[0]) { tb_str(&hb, " | "); tb_str(&hb, u->gov); }
+  if (u->rec) { tb_str(&hb, " | REC "); tb_str(&hb, u->rec); }
+  int recAttr = (int)(u->use_color ? (COLOR_PAIR(6) | A_BOLD) : A_BOLD);
+  textpanel_row(t, 0, 16, COLS-18, line1, u->rec ? recAttr : hdrAttr);
+
+  header_format(&u->hdr, s);
+  textpanel_row(t, 1, 2, COLS-4, u->hdr.line, hdrAttr);
+
+  wnoutrefresh(u->wHdr);
+}
 
-      int y2 = y1 + h2;
-      wProc = newwin(h3, wL, y2, 0);   // bottom-left (TASKS)
-      wNet  = newwin(h3, wR, y2, wL);  // bottom-right (NET)
+// CPU: with perf counters, row 1 sums them over all CPUs and the bottom
+// border breaks them down per CPU (IPC when there is a hardware PMU, context
+// switches otherwise); 'p' swaps the plot between usage and the counters.
+static void ui_draw_cpu(UI *u, const Sample *s, const HistSet *h, int samples) {
+  int use_color = u->use_color;
+  Panel *p = &u->pCpu;
+  int view = u->cpu_view;
+  if (!s->have_perf || (view == 3 && s->have_perf < 2)) view = 0;
+  static const char *const TITLES[] = {
+    "CPU % (time)", "SCHED /s (time)", "FAULTS /s (time)", "IPC (time)",
+  };
+
+  char label[96];
+  TextBuf t;
+  tb_init(&t, label, sizeof(label));
+  switch (view) {
+    case 0:
+      tb_fix(&t, hist_get_latest(&h->cpu), 1); tb_ch(&t, '%');
+      if (s->fast_ms) {
+        tb_str(&t, "  "); tb_i64(&t, s->fast_ms); tb_str(&t, "ms all p99 ");
+        tb_fix(&t, s->all_p99, 0); tb_str(&t, " max "); tb_fix(&t, s->all_hi, 0);
+        tb_str(&t, "  core p50 ");
+        tb_fix(&t, s->cpu_p50, 0); tb_str(&t, " p99 "); tb_fix(&t, s->cpu_p99, 0);
+        tb_str(&t, " max "); tb_fix(&t, s->cpu_hi, 0);
+        if (s->fast_cpu > 0) { tb_str(&t, " (sampler "); tb_fix(&t, s->fast_cpu, 2); tb_str(&t, "%)"); }
+      }
+      break;
+    case 1:
+      tb_str(&t, "CSW "); tb_count(&t, hist_get_latest(&h->csw));
+      tb_str(&t, "  MIG "); tb_count(&t, hist_get_latest(&h->mig));
+      break;
+    case 2: tb_str(&t, "FLT "); tb_count(&t, hist_get_latest(&h->flt)); break;
+    default: tb_str(&t, "IPC "); tb_fix(&t, hist_get_latest(&h->ipc), 2); break;
+  }
 
-      scroll = 0;
+  char extra[160];
+  tb_init(&t, extra, sizeof(extra));
+  if (s->have_perf) {
+    tb_str(&t, "csw "); tb_count(&t, s->csw_s);
+    tb_str(&t, "/s mig "); tb_count(&t, s->mig_s);
+    tb_str(&t, "/s flt "); tb_count(&t, s->flt_s); tb_str(&t, "/s");
+    if (s->have_perf >= 2) { tb_str(&t, " IPC "); tb_fix(&t, s->ipc, 2); }
+    if (s->have_perf >= 3) { tb_str(&t, " miss "); tb_fix(&t, s->miss_pct, 1); tb_ch(&t, '%'); }
+  }
+  if (!graph_frame(p, TITLES[view], label, extra)) return;
+
+  char foot[160];
+  tb_init(&t, foot, sizeof(foot));
+  if (s->have_perf >= 2) {
+    tb_str(&t, "IPC");
+    for (int i=0; i<s->n_pcpu; i++) { tb_ch(&t, ' '); tb_fix(&t, s->pc_ipc[i], 2); }
+    if (s->have_perf >= 3) {
+      tb_str(&t, " miss%");
+      for (int i=0; i<s->n_pcpu; i++) { tb_ch(&t, ' '); tb_fix(&t, s->pc_miss[i], 0); }
     }
+  } else if (s->have_perf) {
+    tb_str(&t, "csw/s");
+    for (int i=0; i<s->n_pcpu; i++) { tb_ch(&t, ' '); tb_count(&t, s->pc_csw[i]); }
+  }
+  graph_footer(p, foot);
+
+  if (view == 1) {
+    double vmax = graph_scale(&h->csw, &h->mig, samples, 10.0);
+    graph_plot(p, &h->csw, &h->mig, samples, 0.0, vmax, use_color?2:0, use_color?7:0);
+  } else if (view == 2) {
+    double vmax = graph_scale(&h->flt, NULL, samples, 10.0);
+    graph_plot(p, &h->flt, NULL, samples, 0.0, vmax, use_color?4:0, 0);
+  } else if (view == 3) {
+    graph_plot(p, &h->ipc, NULL, samples, 0.0, graph_scale(&h->ipc, NULL, samples, 2.0),
+               use_color?3:0, 0);
+  } else if (s->fast_ms) {
+    graph_bands(p, &h->cpu_lo, &h->cpu_p50, &h->cpu_p99, &h->cpu_hi, samples,
+                0.0, 100.0, use_color?2:0, use_color?6:0);
+  } else {
+    graph_plot(p, &h->cpu, NULL, samples, 0.0, 100.0, use_color?2:0, 0);
+  }
+}
 
-    int ch = getch();
-    if (ch != ERR) {
-      if (ch == 'q' || ch == 'Q') running = 0;
-      else if (ch == '+' || ch == '=') delay_ms = MAX(MIN_DELAY_MS, delay_ms - 50);
-      else if (ch == '-' || ch == '_') delay_ms = MIN(MAX_DELAY_MS, delay_ms + 50);
-      else if (ch == 'c' || ch == 'C') use_color = !use_color;
-      else if (ch == KEY_UP) scroll = MAX(0, scroll - 1);
-      else if (ch == KEY_DOWN) scroll = scroll + 1;
-      else if (ch == KEY_PPAGE) scroll = MAX(0, scroll - 10);
-      else if (ch == KEY_NPAGE) scroll = scroll + 10;
-      else if (ch == KEY_HOME) scroll = 0;
+// MEM: stacked breakdown on row 1, pressure counters on the bottom border,
+// and either usage or major faults/page scans per second over time.
+static void ui_draw_mem(UI *u, const Sample *s, const HistSet *h, int samples) {
+  int use_color = u->use_color;
+  Panel *p = &u->pMem;
+  char top[128];
+  TextBuf t;
+  tb_init(&t, top, sizeof(top));
+  if (u->mem_view) {
+    tb_str(&t, "MAJ "); tb_fix(&t, hist_get_latest(&h->majflt), 1);
+    tb_str(&t, "  SCAN "); tb_fix(&t, hist_get_latest(&h->pgscan), 1); tb_str(&t, "/s");
+  } else {
+    tb_fix(&t, hist_get_latest(&h->mem), 1); tb_ch(&t, '%');
+  }
+  if (!graph_frame(p, u->mem_view ? "MEM faults/scan (time)" : "MEM % (time)", top, NULL)) return;
+
+  unsigned long long used = s->memFree + s->memAnon + s->memCache + s->memShmem + s->memSlab;
+  BarSeg seg[] = {
+    { "anon",  s->memAnon,  use_color ? 4 : 1 },
+    { "cache", s->memCache, use_color ? 2 : 1 },
+    { "shm",   s->memShmem, use_color ? 7 : 1 },
+    { "slab",  s->memSlab,  use_color ? 6 : 1 },
+    { "other", s->memT > used ? s->memT - used : 0, use_color ? 5 : 1 },
+    { "free",  s->memFree,  0 },
+  };
+  graph_bar(p, seg, (int)(sizeof(seg) / sizeof(seg[0])), s->memT, use_color);
+
+  char foot[160];
+  TextBuf fb;
+  tb_init(&fb, foot, sizeof(foot));
+  tb_str(&fb, "dirty "); tb_bytes(&fb, s->memDirty);
+  tb_str(&fb, " wb "); tb_bytes(&fb, s->memWback);
+  if (s->swapT) {
+    tb_str(&fb, " swap "); tb_bytes(&fb, s->swapT > s->swapF ? s->swapT - s->swapF : 0);
+    tb_ch(&fb, '/'); tb_bytes(&fb, s->swapT);
+    tb_str(&fb, " si/so "); tb_fix(&fb, s->swpin_s, 0);
+    tb_ch(&fb, '/'); tb_fix(&fb, s->swpout_s, 0);
+  }
+  if (s->hugeT) {
+    tb_str(&fb, " huge "); tb_bytes(&fb, s->hugeT - MIN(s->hugeF, s->hugeT));
+    tb_ch(&fb, '/'); tb_bytes(&fb, s->hugeT);
+  }
+  tb_str(&fb, " oom "); tb_u64(&fb, s->oomKills);
+  graph_footer(p, foot);
+
+  if (u->mem_view) {
+    double vmax = graph_scale(&h->majflt, &h->pgscan, samples, 10.0);
+    graph_plot(p, &h->majflt, &h->pgscan, samples, 0.0, vmax, use_color?4:0, use_color?6:0);
+  } else {
+    graph_plot(p, &h->mem, NULL, samples, 0.0, 100.0, use_color?3:0, 0);
+  }
+}
+
+// TEMP: the hottest sensor in the title, each core's clock on row 1 so
+// throttling lines up with the curve, and every sensor on the bottom border,
+// hottest first.
+static void ui_draw_temp(UI *u, const Sample *s, const HistSet *h, int samples,
+                         double tmin, double tmax, int tColor) {
+  Panel *p = &u->pTmp;
+  int H, W;
+  getmaxyx(p->w, H, W);
+  (void)H;
+
+  char label[64];
+  TextBuf t;
+  tb_init(&t, label, sizeof(label));
+  if (s->have_tc) {
+    tb_fix(&t, s->tc, 1); tb_ch(&t, 'C');
+    if (s->hot >= 0) { tb_ch(&t, ' '); tb_str(&t, s->sens_name[s->hot]); }
+  } else {
+    tb_str(&t, "n/a");
+  }
+
+  char extra[160];
+  tb_init(&t, extra, sizeof(extra));
+  if (s->n_freq > 0) {
+    int lo = -1, hi = 0, on = 0;
+    unsigned long long sum = 0;
+    tb_str(&t, "MHz");
+    for (int i=0; i<s->n_freq; i++) {
+      int f = s->freq_mhz[i];
+      tb_ch(&t, ' ');
+      if (f) tb_i64(&t, f); else tb_ch(&t, '-');
+      if (!f) continue;
+      if (lo < 0 || f < lo) lo = f;
+      hi = MAX(hi, f);
+      sum += (unsigned long long)f;
+      on++;
     }
+    if (s->freq_max_mhz) { tb_str(&t, " /"); tb_i64(&t, s->freq_max_mhz); }
+    // Too many cores for one row: summarise instead.
+    if (t.len > W - 4) {
+      tb_init(&t, extra, sizeof(extra));
+      tb_str(&t, "MHz min "); tb_i64(&t, MAX(lo, 0));
+      tb_str(&t, " avg "); tb_i64(&t, on ? (long long)(sum / (unsigned long long)on) : 0);
+      tb_str(&t, " max "); tb_i64(&t, hi);
+      if (s->freq_max_mhz) { tb_str(&t, " /"); tb_i64(&t, s->freq_max_mhz); }
+      tb_str(&t, " ("); tb_i64(&t, s->n_freq); tb_str(&t, " cpus)");
+    }
+  }
+  if (!graph_frame(p, "TEMP C (time)", label, extra)) return;
+
+  char foot[160];
+  int order[SENS_MAX];
+  int n = 0;
+  for (int i=0; i<s->n_sens; i++) {
+    int j = n++;
+    while (j > 0 && s->sens_c[order[j-1]] < s->sens_c[i]) { order[j] = order[j-1]; j--; }
+    order[j] = i;
+  }
+  // Hottest first, as many as fit; the rest are counted.
+  int fH, fW;
+  getmaxyx(p->w, fH, fW);
+  (void)fH;
+  int room = MIN((int)sizeof(foot) - 1, fW - 6) - 10;
+  tb_init(&t, foot, sizeof(foot));
+  int k = 0;
+  for (; k<n; k++) {
+    int i = order[k], at = t.len;
+    if (k) tb_ch(&t, ' ');
+    if (i == s->hot) tb_ch(&t, '[');
+    tb_str(&t, s->sens_name[i]); tb_ch(&t, ' '); tb_fix(&t, s->sens_c[i], 1);
+    if (i == s->hot) tb_ch(&t, ']');
+    if (t.len > room && k > 0) { t.len = at; foot[at] = '\0'; break; }
+  }
+  int more = n - k + s->sens_more;
+  if (more > 0) { tb_str(&t, " +"); tb_i64(&t, more); tb_str(&t, " more"); }
+  graph_footer(p, foot);
+  graph_plot(p, &h->temp, NULL, samples, tmin, tmax, tColor, 0);
+}
 
-    double t_cur = now_s();
-    double dt = t_cur - t_prev;
-    if (dt <= 0) dt = 0.001;
+// addr:port, [addr]:port for IPv6 (IPv4-mapped ones print as IPv4), "*"
+// for an unconnected socket's peer.
+static void tb_sockaddr(TextBuf *b, int family, const unsigned char *a, unsigned short port) {
+  static const unsigned char v4map[12] = { 0,0,0,0,0,0,0,0,0,0,0xff,0xff };
+  static const unsigned char any[16];
+  if (port == 0 && memcmp(a, any, 16) == 0) { tb_ch(b, '*'); return; }
+  if (family == AF_INET6 && memcmp(a, v4map, 12) == 0) { family = AF_INET; a += 12; }
+  char ip[INET6_ADDRSTRLEN];
+  if (!inet_ntop(family, a, ip, sizeof(ip))) ip[0] = '\0';
+  if (family == AF_INET6) tb_ch(b, '[');
+  tb_str(b, ip);
+  if (family == AF_INET6) tb_ch(b, ']');
+  tb_ch(b, ':'); tb_i64(b, port);
+}
 
-    // CPU %
-    unsigned long long tot=0, idle=0;
-    double cpu_pct = 0.0;
-    if (read_cpu(&tot, &idle)) {
-      unsigned long long d_tot = tot - prev_tot;
-      unsigned long long d_idle = idle - prev_idle;
-      if (d_tot > 0) cpu_pct = (1.0 - (double)d_idle / (double)d_tot) * 100.0;
-      prev_tot = tot;
-      prev_idle = idle;
-    }
-
-    // Load
-    double l1=0,l5=0,l15=0; read_load(&l1,&l5,&l15);
-
-    // Mem %
-    unsigned long long memT=0, memA=0;
-    read_mem(&memT, &memA);
-    double mem_used = (memT > memA) ? (double)(memT - memA) : 0.0;
-    double mem_pct  = (memT > 0) ? (mem_used / (double)memT) * 100.0 : 0.0;
-
-    // Uptime + Temp
-    double up=0; read_uptime(&up);
-    double tc=0; int have_tc = read_temp(&tc);
-
-    // Disk rates (MB/s)
-    double disk_r_mbs = 0.0, disk_w_mbs = 0.0;
-    if (have_disk) {
-      unsigned long long rd=0, wr=0;
-      if (read_diskstats(disk, &rd, &wr)) {
-        if (have_prev_disk) {
-          unsigned long long d_rd = (rd >= prev_rdsec) ? (rd - prev_rdsec) : 0;
-          unsigned long long d_wr = (wr >= prev_wrsec) ? (wr - prev_wrsec) : 0;
-          double rBps = (double)d_rd * 512.0 / dt;
-          double wBps = (double)d_wr * 512.0 / dt;
-          disk_r_mbs = rBps / (1024.0*1024.0);
-          disk_w_mbs = wBps / (1024.0*1024.0);
-        }
-        prev_rdsec = rd;
-        prev_wrsec = wr;
-        have_prev_disk = 1;
+static void ui_draw_net(UI *u, const Sample *s, const HistSet *h, int samples) {
+  int use_color = u->use_color;
+  double netMax = graph_scale(&h->net_rx, &h->net_tx, samples, 1.0);
+  char netExtra[160];
+  TextBuf xb;
+  tb_init(&xb, netExtra, sizeof(netExtra));
+  tb_str(&xb, "errs/drops Δ rx ");
+  tb_u64(&xb, s->d_rxE); tb_ch(&xb, '/'); tb_u64(&xb, s->d_rxD);
+  tb_str(&xb, " tx ");
+  tb_u64(&xb, s->d_txE); tb_ch(&xb, '/'); tb_u64(&xb, s->d_txD);
+  tb_str(&xb, " (if: ");
+  tb_str(&xb, s->have_iface ? s->iface : "n/a");
+  tb_ch(&xb, ')');
+  draw_dual_graph(&u->pNet, "NET I/O (time)", &h->net_rx, &h->net_tx, samples,
+                  0.0, netMax, use_color?2:0, use_color?7:0,
+                  "RX", "TX", "MB/s", netExtra);
+}
+
+// Sockets ranked by traffic since the last scan, one per row.
+static void ui_draw_socks(UI *u) {
+  static const char *const ST[] = {
+    "?", "ESTAB", "SYN-S", "SYN-R", "FIN-1", "FIN-2", "TIMEW", "UNCON",
+    "CLS-W", "LASTA", "LISTN", "CLSNG",
+  };
+  TextPanel *t = &u->tNet;
+  WINDOW *w = u->wNet;
+  int H, W;
+  getmaxyx(w, H, W);
+  int attr = u->use_color ? COLOR_PAIR(5) : 0;
+  if (!t->chrome) {
+    werase(w);
+    textpanel_clear_rows(t);
+    box(w, 0, 0);
+    wattron(w, A_BOLD);
+    mvwprintw(w, 0, 2, " NET SOCKETS (B/s) ");
+    wattroff(w, A_BOLD);
+    if (u->use_color) wattron(w, COLOR_PAIR(5) | A_BOLD);
+    mvwprintw(w, 1, 2, "%.*s", MAX(0, W - 3), "PROTO LPORT REMOTE                 STATE    RX/s    TX/s RTX/s PID    CMD");
+    if (u->use_color) wattroff(w, COLOR_PAIR(5) | A_BOLD);
+    t->chrome = 1;
+  }
+  int rowW = W - 3, nrows = MAX(0, H - 4);
+  const Socks *S = u->socks;
+  for (int r=0; r<nrows; r++) {
+    char row[256];
+    TextBuf b;
+    tb_init(&b, row, sizeof(row));
+    if (!S) {
+      if (r == 0) tb_str(&b, "not available for a remote host");
+    } else if (r < MIN(S->n, SOCK_ROWS)) {
+      const Sock *k = &S->a[r];
+      int tcp = k->proto == IPPROTO_TCP, f = b.len;
+      tb_str(&b, tcp ? "tcp" : "udp");
+      if (k->family == AF_INET6) tb_ch(&b, '6');
+      tb_pad(&b, f, 5); tb_ch(&b, ' ');
+      f = b.len; tb_i64(&b, k->sport); tb_pad(&b, f, 5); tb_ch(&b, ' ');
+      f = b.len; tb_sockaddr(&b, k->family, k->dst, k->dport); tb_pad(&b, f, 22); tb_ch(&b, ' ');
+      f = b.len; tb_str(&b, k->state < 12 ? ST[k->state] : "?"); tb_pad(&b, f, 5);
+      if (tcp) {
+        f = b.len; tb_bytes(&b, (unsigned long long)k->rx_s); tb_rjust(&b, f, 8);
+        f = b.len; tb_bytes(&b, (unsigned long long)k->tx_s); tb_rjust(&b, f, 8);
+        f = b.len; tb_count(&b, k->retr_s); tb_rjust(&b, f, 6);
+      } else {
+        // No byte counters for UDP: what sits in its queues instead.
+        f = b.len; tb_str(&b, "q "); tb_bytes(&b, k->rq); tb_rjust(&b, f, 8);
+        f = b.len; tb_str(&b, "q "); tb_bytes(&b, k->wq); tb_rjust(&b, f, 8);
+        f = b.len; tb_ch(&b, '-'); tb_rjust(&b, f, 6);
       }
+      tb_ch(&b, ' ');
+      f = b.len;
+      if (k->pid) tb_i64(&b, k->pid); else tb_ch(&b, '-');
+      tb_pad(&b, f, 6); tb_ch(&b, ' ');
+      tb_str(&b, k->comm);
     }
+    textpanel_row(t, 2 + r, 2, rowW, row, r < MIN(S ? S->n : 1, SOCK_ROWS) ? attr : 0);
+  }
+
+  char foot[128];
+  TextBuf fb;
+  tb_init(&fb, foot, sizeof(foot));
+  if (S) {
+    tb_str(&fb, "tcp:"); tb_i64(&fb, S->n_tcp);
+    tb_str(&fb, " udp:"); tb_i64(&fb, S->n_udp);
+    tb_str(&fb, " unowned:"); tb_i64(&fb, S->unowned);
+  }
+  textpanel_row(t, H - 2, 2, rowW, foot, u->use_color ? (COLOR_PAIR(5) | A_DIM) : 0);
+}
+
+static void ui_draw_disk(UI *u, const Sample *s, const HistSet *h, int samples) {
+  int use_color = u->use_color;
+  double diskMax = graph_scale(&h->disk_r, &h->disk_w, samples, 1.0);
+  char diskExtra[128];
+  TextBuf xb;
+  tb_init(&xb, diskExtra, sizeof(diskExtra));
+  tb_str(&xb, "R/W MB/s (dev: ");
+  tb_str(&xb, s->have_disk ? s->disk : "n/a");
+  tb_ch(&xb, ')');
+  draw_dual_graph(&u->pDisk, "DISK I/O (time)", &h->disk_r, &h->disk_w, samples,
+                  0.0, diskMax, use_color?2:0, use_color?7:0,
+                  "RD", "WR", "MB/s", diskExtra);
+}
+
+// 45s, 12m, 7h, 30d: how long until a filesystem fills at its current rate.
+static void tb_eta(TextBuf *b, double secs) {
+  static const struct { double div; char unit; } U[] = {
+    { 1, 's' }, { 60, 'm' }, { 3600, 'h' }, { 86400, 'd' },
+  };
+  int i = 0;
+  while (i < 3 && secs / U[i].div >= (i < 2 ? 100 : 48)) i++;
+  if (secs / U[i].div >= 1000) { tb_str(b, ">999d"); return; }
+  tb_i64(b, (long long)(secs / U[i].div)); tb_ch(b, U[i].unit);
+}
 
-    // Net rates (MB/s) + errs/drops deltas
-    double net_rx_mbs = 0.0, net_tx_mbs = 0.0;
-    unsigned long long rxE=0, rxD=0, txE=0, txD=0;
-    unsigned long long d_rxE=0, d_rxD=0, d_txE=0, d_txD=0;
-    if (have_iface) {
-      unsigned long long rxB=0, txB=0;
-      if (read_net_dev(iface, &rxB, &txB, &rxE, &rxD, &txE, &txD)) {
-        if (have_prev_net) {
-          unsigned long long d_rx = (rxB >= prev_rxB) ? (rxB - prev_rxB) : 0;
-          unsigned long long d_tx = (txB >= prev_txB) ? (txB - prev_txB) : 0;
-          net_rx_mbs = ((double)d_rx / dt) / (1024.0*1024.0);
-          net_tx_mbs = ((double)d_tx / dt) / (1024.0*1024.0);
-
-          d_rxE = (rxE >= prev_rxE) ? (rxE - prev_rxE) : 0;
-          d_rxD = (rxD >= prev_rxD) ? (rxD - prev_rxD) : 0;
-          d_txE = (txE >= prev_txE) ? (txE - prev_txE) : 0;
-          d_txD = (txD >= prev_txD) ? (txD - prev_txD) : 0;
+// Every real filesystem, stuck ones first, then by the fuller of space and
+// inodes.
+static void ui_draw_mounts(UI *u) {
+  TextPanel *t = &u->tDisk;
+  WINDOW *w = u->wDisk;
+  int H, W;
+  getmaxyx(w, H, W);
+  int attr = u->use_color ? COLOR_PAIR(5) : 0;
+  int hot = u->use_color ? (COLOR_PAIR(6) | A_BOLD) : A_BOLD;
+  int rowW = W - 3, nrows = MAX(0, H - 4);
+  int dirW = MAX(12, MIN(rowW - 48, 128));
+  if (!t->chrome) {
+    werase(w);
+    textpanel_clear_rows(t);
+    box(w, 0, 0);
+    wattron(w, A_BOLD);
+    mvwprintw(w, 0, 2, " DISK MOUNTS ");
+    wattroff(w, A_BOLD);
+    if (u->use_color) wattron(w, COLOR_PAIR(5) | A_BOLD);
+    mvwprintw(w, 1, 2, "%-*s %.*s", dirW, "MOUNT", MAX(0, rowW - dirW - 1),
+              "TYPE        SIZE  USE%  INO%   FILL/s  FULL IN");
+    if (u->use_color) wattroff(w, COLOR_PAIR(5) | A_BOLD);
+    t->chrome = 1;
+  }
+  const Mounts *M = u->mnt;
+  for (int r=0; r<nrows; r++) {
+    char row[256];
+    TextBuf b;
+    tb_init(&b, row, sizeof(row));
+    int a = 0;
+    if (!M) {
+      if (r == 0) tb_str(&b, "not available for a remote host");
+    } else if (r < M->n) {
+      const MountRow *m = &M->rows[r];
+      // Rows are byte-width: anything outside printable ASCII shows as '?'.
+      // A long path keeps its end, which tells mounts apart.
+      int f = b.len, len = (int)strlen(m->dir);
+      const char *c = m->dir;
+      if (len > dirW) { tb_str(&b, ".."); c += len - (dirW - 2); }
+      for (; *c; c++) tb_ch(&b, (*c >= 0x20 && *c < 0x7f) ? *c : '?');
+      tb_pad(&b, f, dirW); tb_ch(&b, ' ');
+      f = b.len; tb_strn(&b, m->type, 8); tb_pad(&b, f, 8);
+      if (m->have) {
+        f = b.len; tb_bytes(&b, m->tot); tb_rjust(&b, f, 8);
+        f = b.len; tb_fix(&b, m->pct, 0); tb_ch(&b, '%'); tb_rjust(&b, f, 6);
+        f = b.len; tb_fix(&b, m->ipct, 0); tb_ch(&b, '%'); tb_rjust(&b, f, 6);
+      }
+      if (m->stuck) {
+        tb_str(&b, "  STUCK (statvfs not returning)");
+        a = hot;
+      } else {
+        f = b.len;
+        if (m->have_fill) {
+          double v = m->fill;
+          tb_ch(&b, v < 0 ? '-' : '+');
+          tb_bytes(&b, (unsigned long long)(v < 0 ? -v : v));
+        } else {
+          tb_ch(&b, '-');
         }
-        prev_rxB=rxB; prev_txB=txB;
-        prev_rxE=rxE; prev_rxD=rxD;
-        prev_txE=txE; prev_txD=txD;
-        have_prev_net = 1;
+        tb_rjust(&b, f, 9);
+        f = b.len;
+        if (m->have_fill && m->fill > 0) tb_eta(&b, (double)m->avail / m->fill);
+        else tb_ch(&b, '-');
+        tb_rjust(&b, f, 9);
+        a = MAX(m->pct, m->ipct) >= 90.0 ? hot : attr;
       }
     }
+    textpanel_row(t, 2 + r, 2, rowW, row, a);
+  }
+
+  char foot[128];
+  TextBuf fb;
+  tb_init(&fb, foot, sizeof(foot));
+  if (M) {
+    tb_str(&fb, "mounts:"); tb_i64(&fb, M->n);
+    tb_str(&fb, " stuck:"); tb_i64(&fb, M->nstuck);
+    if (M->n > nrows) { tb_str(&fb, " (+"); tb_i64(&fb, M->n - nrows); tb_str(&fb, " more)"); }
+  }
+  textpanel_row(t, H - 2, 2, rowW, foot, u->use_color ? (COLOR_PAIR(5) | A_DIM) : 0);
+}
+
+static void ui_draw_graphs(UI *u, const Sample *s, const HistSet *h) {
+  int use_color = u->use_color;
+  int gH, gW;
+  getmaxyx(u->wCpu, gH, gW);
+  (void)gH;
+  int samples = MIN(HIST_MAX, gW - 2);
+
+  ui_draw_cpu(u, s, h, samples);
+  ui_draw_mem(u, s, h, samples);
+
+  // temp scale
+  double tmin=20.0, tmax=90.0;
+  float tlo, thi;
+  if (s->have_tc && hist_range(&h->temp, samples, &tlo, &thi)) {
+    tmin = MIN(tmin, tlo - 10.0);
+    tmax = MAX(tmax, thi + 10.0);
+    tmin = MAX(0.0, tmin);
+  }
+  int tColor = (use_color ? ((s->have_tc && s->tc >= 80.0) ? 6 : 4) : 0);
+  ui_draw_temp(u, s, h, samples, tmin, tmax, tColor);
+
+  if (u->disk_view) ui_draw_mounts(u);
+  else ui_draw_disk(u, s, h, samples);
+
+  if (u->net_view) ui_draw_socks(u);
+  else ui_draw_net(u, s, h, samples);
+
+  wnoutrefresh(u->wCpu);
+  wnoutrefresh(u->wMem);
+  wnoutrefresh(u->wTmp);
+  wnoutrefresh(u->wDisk);
+  wnoutrefresh(u->wNet);
+}
+
+// Tasks in table order that pass the filter, each expanded one followed
+// by its threads.
+static void ui_task_lines(UI *u, const ProcTable *pt) {
+  int need = pt->n;
+  if (u->thr) for (int i=0; i<u->thr->n; i++) need += u->thr->e[i].th.n;
+  if (need > u->rows_cap) {
+    u->rows_cap = MAX(need, u->rows_cap * 2);
+    u->rows = realloc(u->rows, sizeof(TaskLine) * (size_t)u->rows_cap);
+  }
+  int n = 0, on = filter_on(&u->filt);
+  if (on) filter_begin(&u->filt);
+  u->nmatch = 0;
+  for (int i=0; i<pt->n; i++) {
+    if (on && !filter_match(&u->filt, &pt->a[i])) continue;
+    u->nmatch++;
+    u->rows[n++] = (TaskLine){ &pt->a[i], 0 };
+    Expanded *e = u->thr ? threads_find(u->thr, pt->a[i].pid) : NULL;
+    if (!e) continue;
+    for (int j=0; j<e->th.n; j++) u->rows[n++] = (TaskLine){ &e->th.a[j], pt->a[i].pid };
+  }
+  u->nrows = n;
+}
+
+static void ui_draw_tasks(UI *u, const ProcTable *pt) {
+  TextPanel *t = &u->tProc;
+  WINDOW *wProc = u->wProc;
+  int use_color = u->use_color;
+
+  ui_task_lines(u, pt);
+
+  // The selection stays on the same task or thread as rows re-sort, unless
+  // a key just moved it.
+  if (!u->sel_moved) {
+    for (int i=0; i<u->nrows; i++) {
+      const TaskLine *l = &u->rows[i];
+      int pid = l->tid ? l->tid : l->p->pid, tid = l->tid ? l->p->pid : 0;
+      if (pid == u->sel_pid && tid == u->sel_tid) { u->sel = i; break; }
+    }
+  }
+  u->sel = MAX(0, MIN(u->sel, u->nrows - 1));
+  u->sel_moved = 0;
+  if (u->nrows > 0) {
+    const TaskLine *l = &u->rows[u->sel];
+    u->sel_pid = l->tid ? l->tid : l->p->pid;
+    u->sel_tid = l->tid ? l->p->pid : 0;
+  }
 
-    // FS /
-    double fsPct=0.0, inodePct=0.0;
-    unsigned long long fsUsedB=0, fsTotB=0;
-    int have_fs = read_fs_usage("/", &fsPct, &fsUsedB, &fsTotB, &inodePct);
-
-    // Pi throttled
-    unsigned int thrFlags=0;
-    int have_thr = read_throttled(&thrFlags);
-    char thrStr[128] = "PWR n/a";
-    if (have_thr) throttled_summary(thrFlags, thrStr, sizeof(thrStr));
-
-    // push histories
-    hist_push(&h_cpu, cpu_pct);
-    hist_push(&h_mem, mem_pct);
-    hist_push(&h_temp, have_tc ? tc : 0.0);
-    hist_push(&h_disk_r, disk_r_mbs);
-    hist_push(&h_disk_w, disk_w_mbs);
-    hist_push(&h_net_rx, net_rx_mbs);
-    hist_push(&h_net_tx, net_tx_mbs);
-
-    // Processes
-    long hz = sysconf(_SC_CLK_TCK);
-    if (hz <= 0) hz = 100;
-
-    for (int i=0;i<pt.n;i++) pt.a[i].seen = 0;
-
-    DIR *d = opendir("/proc");
-    if (d) {
-      struct dirent *de;
-      while ((de = readdir(d))) {
-        if (!is_pid_dir(de->d_name)) continue;
-        int pid = atoi(de->d_name);
-
-        char comm[64]; char state='?'; unsigned long long jiff=0;
-        if (!read_proc_stat(pid, comm, sizeof(comm), &state, &jiff)) continue;
-
-        ProcTrack *p = proctable_upsert(&pt, pid);
-        p->seen = 1;
-        p->state = state;
-        strncpy(p->comm, comm, sizeof(p->comm)-1);
-        p->comm[sizeof(p->comm)-1] = '\0';
-
-        p->rss_bytes = read_proc_rss_bytes(pid);
-
-        unsigned long long dj = 0;
-        if (p->last_jiff > 0 && jiff >= p->last_jiff) dj = (jiff - p->last_jiff);
-        p->last_jiff = jiff;
-
-        double curpct = 0.0;
-        if (dj > 0) curpct = (double)dj / ((double)hz * dt) * 100.0;
-        p->cpu_cur = curpct;
-
-        if (p->cpu_avg <= 0.0001) p->cpu_avg = curpct;
-        else p->cpu_avg = (1.0 - EWMA_ALPHA)*p->cpu_avg + EWMA_ALPHA*curpct;
-      }
-      closedir(d);
-    }
-
-    proctable_prune_unseen(&pt);
-    qsort(pt.a, pt.n, sizeof(ProcTrack), cmp_proc_avg);
-
-    // Clamp scroll based on TASKS window
-    int procH, procW;
-    getmaxyx(wProc, procH, procW);
-    int proc_rows_visible = MAX(0, procH - 3);
-    int maxScroll = MAX(0, pt.n - proc_rows_visible);
-    scroll = MIN(scroll, maxScroll);
-
-    // ---------------------------
-    // Header (2 lines)
-    // ---------------------------
-    werase(wHdr);
-
-    if (use_color) wattron(wHdr, COLOR_PAIR(1) | A_BOLD);
-    mvwprintw(wHdr, 0, 2, "SPARTA//MON");
-    if (use_color) wattroff(wHdr, COLOR_PAIR(1) | A_BOLD);
-
-    if (use_color) wattron(wHdr, COLOR_PAIR(5));
-    mvwprintw(wHdr, 0, 16, "q quit | +/- speed | arrows scroll | c color | %dms", delay_ms);
-
-    char upbuf[64]; fmt_uptime(up, upbuf, sizeof(upbuf));
-    char fsLine[128] = "FS / n/a";
-    if (have_fs) {
-      char uB[32], tB[32];
-      fmt_bytes(fsUsedB, uB, sizeof(uB));
-      fmt_bytes(fsTotB, tB, sizeof(tB));
-      snprintf(fsLine, sizeof(fsLine), "FS / %.1f%% (%s/%s) INO %.1f%%",
-               fsPct, uB, tB, inodePct);
-    }
-
-    char line2[512];
-    snprintf(line2, sizeof(line2),
-      "CPU %.1f%% MEM %.1f%% LOAD %.2f %.2f %.2f TEMP %s  %s  %s  IF %s DK %s",
-      cpu_pct, mem_pct, l1,l5,l15,
-      have_tc ? "" : "n/a",
-      fsLine,
-      thrStr,
-      have_iface ? iface : "n/a",
-      have_disk ? disk : "n/a"
-    );
-
-    // put temp number where TEMP %s was left empty
-    if (have_tc) {
-      char tbuf[16];
-      snprintf(tbuf, sizeof(tbuf), "%.1fC", tc);
-      // replace "TEMP " + "" effectively by printing at end of prefix area
-      // easiest: just build a clean line
-      snprintf(line2, sizeof(line2),
-        "CPU %.1f%% MEM %.1f%% LOAD %.2f %.2f %.2f TEMP %.1fC  %s  %s  IF %s DK %s",
-        cpu_pct, mem_pct, l1,l5,l15, tc,
-        fsLine, thrStr,
-        have_iface ? iface : "n/a",
-        have_disk ? disk : "n/a"
-      );
-    }
-
-    mvwprintw(wHdr, 1, 2, "%.*s", COLS-4, line2);
-    if (use_color) wattroff(wHdr, COLOR_PAIR(5));
-
-    wnoutrefresh(wHdr);
-
-    // ---------------------------
-    // Graphs in 3x2 grid
-    // ---------------------------
-    werase(wCpu);  werase(wMem);
-    werase(wTmp);  werase(wDisk);
-    werase(wNet);
-
-    int gH, gW;
-    getmaxyx(wCpu, gH, gW);
-    int samples = MIN(HIST_MAX, gW - 2);
-
-    draw_single_graph(wCpu, "CPU % (time)", &h_cpu, samples, 0.0, 100.0, use_color?2:0, "%");
-    draw_single_graph(wMem, "MEM % (time)", &h_mem, samples, 0.0, 100.0, use_color?3:0, "%");
-
-    // temp scale
-    double tmin=20.0, tmax=90.0;
-    if (have_tc) {
-      double latest = hist_get_latest(&h_temp);
-      tmin = MIN(tmin, latest - 10.0);
-      tmax = MAX(tmax, latest + 10.0);
-      tmin = MAX(0.0, tmin);
-    }
-    int tColor = (use_color ? ((have_tc && tc >= 80.0) ? 6 : 4) : 0);
-    draw_single_graph(wTmp, "TEMP C (time)", &h_temp, samples, tmin, tmax, tColor, "C");
-
-    double diskMax = MAX(1.0, MAX(hist_get_latest(&h_disk_r), hist_get_latest(&h_disk_w)) * 1.5);
-    char diskExtra[128];
-    snprintf(diskExtra, sizeof(diskExtra), "R/W MB/s (dev: %s)", have_disk?disk:"n/a");
-    draw_dual_graph(wDisk, "DISK I/O (time)", &h_disk_r, &h_disk_w, samples,
-                    0.0, diskMax, use_color?2:0, use_color?7:0,
-                    "RD", "WR", "MB/s", diskExtra);
-
-    double netMax  = MAX(1.0, MAX(hist_get_latest(&h_net_rx),  hist_get_latest(&h_net_tx))  * 1.5);
-    char netExtra[160];
-    snprintf(netExtra, sizeof(netExtra),
-             "errs/drops Δ rx %llu/%llu tx %llu/%llu (if: %s)",
-             d_rxE, d_rxD, d_txE, d_txD, have_iface?iface:"n/a");
-    draw_dual_graph(wNet, "NET I/O (time)", &h_net_rx, &h_net_tx, samples,
-                    0.0, netMax, use_color?2:0, use_color?7:0,
-                    "RX", "TX", "MB/s", netExtra);
-
-    wnoutrefresh(wCpu);
-    wnoutrefresh(wMem);
-    wnoutrefresh(wTmp);
-    wnoutrefresh(wDisk);
-    wnoutrefresh(wNet);
-
-    // ---------------------------
-    // TASKS bottom-left
-    // ---------------------------
+  // Scroll just enough to keep the selection in view.
+  int procH, procW;
+  getmaxyx(wProc, procH, procW);
+  int proc_rows_visible = MAX(0, procH - 4);
+  int maxScroll = MAX(0, u->nrows - proc_rows_visible);
+  if (u->sel < u->scroll) u->scroll = u->sel;
+  if (u->sel >= u->scroll + proc_rows_visible) u->scroll = u->sel - proc_rows_visible + 1;
+  u->scroll = MAX(0, MIN(u->scroll, maxScroll));
+
+  if (!t->chrome) {
     werase(wProc);
+    textpanel_clear_rows(t);
     box(wProc, 0, 0);
     wattron(wProc, A_BOLD);
     mvwprintw(wProc, 0, 2, " TASKS (avg CPU) ");
     wattroff(wProc, A_BOLD);
 
-    int y = 1;
     if (use_color) wattron(wProc, COLOR_PAIR(5) | A_BOLD);
-    mvwprintw(wProc, y, 2, "PID    AVG  CUR   RSS     S CMD");
+    mvwprintw(wProc, 1, 2, "%.*s", MAX(0, procW - 3), "PID    AVG  CUR   RSS     S CMD");
     if (use_color) wattroff(wProc, COLOR_PAIR(5) | A_BOLD);
-    y++;
+    memset(u->rowKeys, 0, sizeof(TaskRowKey) * (size_t)procH);
+    t->chrome = 1;
+  }
+
+  int rowW = procW - 3;
+  int start = u->scroll;
+  int end = MIN(u->nrows, start + proc_rows_visible);
+
+  for (int r=0; r<proc_rows_visible; r++) {
+    int i = start + r;
+    char row[256];
+    TextBuf rb;
+    tb_init(&rb, row, sizeof(row));
+
+    if (i >= end) {
+      if (!u->rowKeys[r].valid) continue;
+      u->rowKeys[r].valid = 0;
+      textpanel_row(t, 2 + r, 2, rowW, "", 0);
+      continue;
+    }
+
+    const ProcTrack *p = u->rows[i].p;
+    int attr = 0;
+    int hot = (p->cpu_cur >= 80.0);
+    if (use_color && hot) attr = COLOR_PAIR(6) | A_BOLD;
+    else if (use_color) attr = COLOR_PAIR(5);
+    if (i == u->sel) attr |= A_REVERSE;
+
+    if (task_row_update(&u->rowKeys[r], p, attr, MAX(0, procW - 30), u->rows[i].tid != 0, &rb))
+      textpanel_row(t, 2 + r, 2, rowW, row, attr);
+  }
+
+  char footer[128];
+  TextBuf fb;
+  tb_init(&fb, footer, sizeof(footer));
+  if (u->editing || filter_on(&u->filt)) {
+    tb_ch(&fb, '/'); tb_str(&fb, u->filt.text);
+    tb_str(&fb, u->editing ? "_ " : "/ ");
+    if (filter_on(&u->filt) && !u->filt.have_re) tb_str(&fb, "(substring) ");
+    tb_str(&fb, "match:"); tb_i64(&fb, u->nmatch); tb_ch(&fb, '/');
+  } else {
+    tb_str(&fb, "tasks:");
+  }
+  tb_i64(&fb, pt->n);
+  if (u->nrows > u->nmatch) { tb_str(&fb, " threads:"); tb_i64(&fb, u->nrows - u->nmatch); }
+  tb_str(&fb, " row:");    tb_i64(&fb, u->nrows ? u->sel + 1 : 0);
+  tb_ch(&fb, '/');         tb_i64(&fb, u->nrows);
+  tb_str(&fb, "  (100%=1 core)");
+  textpanel_row(t, procH-2, 2, rowW, footer,
+                use_color ? (COLOR_PAIR(5) | A_DIM) : 0);
+
+  wnoutrefresh(wProc);
+}
+
+static void ui_draw(UI *u, const Sample *s, const HistSet *h, const ProcTable *pt) {
+  // Colour toggles repaint everything from scratch.
+  if (u->use_color != u->drawn_color) {
+    u->drawn_color = u->use_color;
+    u->pCpu.chrome = u->pMem.chrome = u->pTmp.chrome = 0;
+    u->pDisk.chrome = u->pNet.chrome = 0;
+    u->tHdr.chrome = u->tProc.chrome = u->tNet.chrome = u->tDisk.chrome = 0;
+  }
 
-    int start = scroll;
-    int end = MIN(pt.n, start + proc_rows_visible);
+  ui_draw_header(u, s);
+  ui_draw_graphs(u, s, h);
+  ui_draw_tasks(u, pt);
 
-    for (int i=start; i<end; i++) {
-      ProcTrack *p = &pt.a[i];
+  // Commit all at once
+  doupdate();
+}
+
+// Filter text entry: Enter keeps the filter, Esc drops it.
+static void ui_key_filter(UI *u, int ch) {
+  Filter *f = &u->filt;
+  if (ch == '\n' || ch == '\r' || ch == KEY_ENTER) { u->editing = 0; return; }
+  if (ch == 27) { u->editing = 0; f->len = 0; }
+  else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) { if (f->len > 0) f->len--; }
+  else if (ch >= 32 && ch < 127 && f->len < (int)sizeof(f->text) - 1) f->text[f->len++] = (char)ch;
+  else return;
+  f->text[f->len] = '\0';
+  filter_set(f);
+}
+
+// Returns 0 when the user asked to quit.
+static int ui_key(UI *u, int ch) {
+  if (u->editing && ch != KEY_UP && ch != KEY_DOWN && ch != KEY_PPAGE && ch != KEY_NPAGE) {
+    ui_key_filter(u, ch);
+    return 1;
+  }
+  if (ch == 'q' || ch == 'Q') return 0;
+  else if (ch == '/') u->editing = 1;
+  else if (ch == 27 && u->filt.len > 0) ui_key_filter(u, ch);
+  else if (ch == '+' || ch == '=') u->delay_ms = MAX(MIN_DELAY_MS, u->delay_ms - 50);
+  else if (ch == '-' || ch == '_') u->delay_ms = MIN(MAX_DELAY_MS, u->delay_ms + 50);
+  else if (ch == 'c' || ch == 'C') u->use_color = !u->use_color;
+  else if (ch == 'w' || ch == 'W') g_sweep = !g_sweep;
+  else if (ch == 'm' || ch == 'M') { u->mem_view = !u->mem_view; u->pMem.chrome = 0; }
+  else if (ch == 'p' || ch == 'P') { u->cpu_view = (u->cpu_view + 1) % 4; u->pCpu.chrome = 0; }
+  else if (ch == 'n' || ch == 'N') {
+    u->net_view = !u->net_view;
+    if (u->socks) u->socks->on = u->net_view;
+    u->pNet.chrome = u->tNet.chrome = 0;
+  }
+  else if (ch == 'f' || ch == 'F') { u->disk_view = !u->disk_view; u->pDisk.chrome = u->tDisk.chrome = 0; }
+  else if (ch == KEY_UP) { u->sel = MAX(0, u->sel - 1); u->sel_moved = 1; }
+  else if (ch == KEY_DOWN) { u->sel = u->sel + 1; u->sel_moved = 1; }
+  else if (ch == KEY_PPAGE) { u->sel = MAX(0, u->sel - 10); u->sel_moved = 1; }
+  else if (ch == KEY_NPAGE) { u->sel = u->sel + 10; u->sel_moved = 1; }
+  else if (ch == KEY_HOME) { u->sel = 0; u->sel_moved = 1; }
+  else if ((ch == '\n' || ch == '\r' || ch == KEY_ENTER) && u->thr && u->sel_pid > 0) {
+    // On a thread row this collapses its process.
+    threads_toggle(u->thr, u->sel_tid ? u->sel_tid : u->sel_pid);
+    if (u->sel_tid) { u->sel_pid = u->sel_tid; u->sel_tid = 0; }
+  }
+  return 1;
+}
+
+// Fleet grid: one row per host, the selected one in reverse video. Enter
+// drills into that host with the normal panels.
+typedef struct {
+  WINDOW *w;
+  TextPanel t;
+  int sel;                      // host index under the cursor
+  int top;                      // first host row on screen
+  int lines, cols;
+} FleetView;
+
+static void fleetview_layout(FleetView *v) {
+  if (v->w) delwin(v->w);
+  v->lines = LINES;
+  v->cols = COLS;
+  v->w = newwin(LINES, COLS, 0, 0);
+  textpanel_attach(&v->t, v->w);
+}
+
+static void fleetview_free(FleetView *v) {
+  textpanel_free(&v->t);
+  if (v->w) delwin(v->w);
+  v->w = NULL;
+}
+
+static int fleetview_pos(const FleetView *v, const Fleet *f) {
+  for (int i=0; i<f->n; i++) if (f->order[i] == v->sel) return i;
+  return 0;
+}
+
+static void fleetview_move(FleetView *v, const Fleet *f, int by) {
+  int pos = MAX(0, MIN(f->n - 1, fleetview_pos(v, f) + by));
+  v->sel = f->order[pos];
+}
+
+static int fleet_hot(const Sample *s) {
+  return s->cpu_pct >= 90.0 || (s->have_tc && s->tc >= 80.0) ||
+         (s->have_thr && (s->thrFlags & 0xfu));
+}
+
+static void fleetview_draw(FleetView *v, Fleet *f, int use_color) {
+  TextPanel *t = &v->t;
+  WINDOW *w = v->w;
+  int W = COLS - 4;
+  if (!t->chrome) {
+    werase(w);
+    textpanel_clear_rows(t);
+    if (use_color) wattron(w, COLOR_PAIR(1) | A_BOLD);
+    mvwprintw(w, 0, 2, "SPARTA//MON");
+    if (use_color) wattroff(w, COLOR_PAIR(1) | A_BOLD);
+    t->chrome = 1;
+  }
+  int text = use_color ? COLOR_PAIR(5) : 0;
+  textpanel_row(t, 0, 16, COLS - 18,
+                "q quit | arrows select | enter drill down | 1-8 sort column | c color",
+                text);
+
+  fleet_sort(f);
+  char line[512];
+  TextBuf b;
+  tb_init(&b, line, sizeof(line));
+  fleet_header(f, &b);
+  textpanel_row(t, 1, 2, W, line, use_color ? (COLOR_PAIR(5) | A_BOLD) : A_BOLD);
+
+  // Keep the cursor on screen.
+  int rows = MAX(1, v->lines - 3);
+  int pos = fleetview_pos(v, f);
+  if (pos < v->top) v->top = pos;
+  if (pos >= v->top + rows) v->top = pos - rows + 1;
+  v->top = MAX(0, MIN(v->top, f->n - rows));
+
+  int up = 0;
+  for (int i=0; i<f->n; i++) up += f->hosts[i].c.up;
+
+  for (int r=0; r<rows; r++) {
+    int i = v->top + r;
+    if (i >= f->n) { textpanel_row(t, 2 + r, 2, W, "", 0); continue; }
+    const FleetHost *h = &f->hosts[f->order[i]];
+    tb_init(&b, line, sizeof(line));
+    fleet_row(h, &b);
+    int attr = text;
+    if (!h->c.up) attr = use_color ? (COLOR_PAIR(5) | A_DIM) : A_DIM;
+    else if (fleet_hot(&h->s)) attr = use_color ? (COLOR_PAIR(6) | A_BOLD) : A_BOLD;
+    if (f->order[i] == v->sel) attr |= A_REVERSE;
+    textpanel_row(t, 2 + r, 2, W, line, attr);
+  }
+
+  tb_init(&b, line, sizeof(line));
+  tb_str(&b, "hosts:"); tb_i64(&b, f->n);
+  tb_str(&b, " up:");   tb_i64(&b, up);
+  tb_str(&b, " down:"); tb_i64(&b, f->n - up);
+  textpanel_row(t, v->lines - 1, 2, W, line, use_color ? (COLOR_PAIR(5) | A_DIM) : 0);
+
+  wnoutrefresh(w);
+  doupdate();
+}
+
+// ---------------------------
+// Signals
+// ---------------------------
+static volatile sig_atomic_t g_resized = 0;
+static void on_winch(int sig) { (void)sig; g_resized = 1; }
+
+static volatile sig_atomic_t g_quit = 0;
+static void on_quit(int sig) { (void)sig; g_quit = 1; }
+
+// ---------------------------
+// Main
+// ---------------------------
+// bench/ includes this file directly and provides its own main().
+#ifndef SPARTA_MON_NO_MAIN
+static void usage(FILE *out) {
+  fprintf(out,
+    "usage: sparta-mon [--collector | --local | --agent [HOST]:PORT |\n"
+    "                   --connect HOST:PORT | --fleet HOSTS] [--interval MS]\n"
+    "                  [--budget PCT] [--fast MS]\n"
+    "  (default)          view a running collector if there is one, else sample\n"
+    "  --collector        sample headless and publish to shared memory\n"
+    "  --local            always sample in this process\n"
+    "  --agent ADDR       sample headless and stream to --connect viewers;\n"
+    "                     a bare PORT listens on loopback, :PORT on all addresses\n"
+    "  --connect ADDR     view an agent\n"
+    "  --fleet HOSTS      one row per agent; HOSTS is ADDR,ADDR,... or @FILE\n"
+    "                     with one ADDR per line\n"
+    "  --interval MS      sampling period (%d-%d, default %d)\n"
+    "  --budget PCT       keep sparta-mon's own CPU under PCT of one core by\n"
+    "                     rescanning tasks less often, then sampling slower\n"
+    "  --fast MS          also read per-core CPU every MS (%d-%d) and plot its\n"
+    "                     spread within each tick (min/p50/p99/max)\n"
+    "env: SPARTA_SHM, METRICS, METRICS_TOP, IFACE, DISK, PROC_ROOT, SYS_ROOT,\n"
+    "     TRIGGERS (e.g. cpu>90,disk_w:z4), SNAP_DIR, SNAP_SECS, PERF=0\n",
+    MIN_DELAY_MS, MAX_DELAY_MS, DEFAULT_DELAY_MS, FAST_MIN_MS, FAST_MAX_MS);
+}
+
+static int run_collector(int delay_ms, double budget, int fast_ms) {
+  static ShmPub pub;
+  if (!shm_create(&pub, shm_name())) return 1;
+  static Exporter mx;
+  if (!metrics_start(&mx, getenv("METRICS"))) { shm_destroy(&pub); return 1; }
+  static Watch wt;
+  if (!watch_init(&wt)) { metrics_stop(&mx); shm_destroy(&pub); return 1; }
+  static Governor gv;
+  gov_init(&gv, budget);
+
+  signal(SIGINT, on_quit);
+  signal(SIGTERM, on_quit);
+  signal(SIGHUP, on_quit);
+
+  static Collector col;
+  Boot boot;
+  boot_start(&boot, &col, fast_ms);
+  double t_prev = boot_finish(&boot);
+  if (!boot.fast_ok) fprintf(stderr, "sparta-mon: --fast: %s\n", strerror(boot.fast_err));
+
+  while (!g_quit) {
+    double t_cur = now_s();
+    double dt = t_cur - t_prev;
+    if (dt <= 0) dt = 0.001;
+
+    Sample smp = {0};
+    collector_tick(&col, &smp, dt);
+    shm_publish(&pub, &col, &smp, delay_ms);
+    metrics_publish(&mx, &col, &smp);
+    int rec = watch_tick(&wt, &smp, &pub.f->h, &col.pt);
+    int period = gov_tick(&gv, &col, delay_ms, rec);
+
+    t_prev = t_cur;
+    usleep((useconds_t)(rec ? MIN_DELAY_MS : period) * 1000);
+  }
+
+  watch_free(&wt);
+  metrics_stop(&mx);
+  shm_destroy(&pub);
+  collector_free(&col);
+  return 0;
+}
+
+// One --connect viewer as the agent sees it.
+#define AGENT_PEERS 32
+
+typedef struct {
+  int fd;
+  WireBuf out;
+  int off;                      // out.p[off..len) not yet sent
+  WireState st;                 // what this viewer has been sent
+} AgentPeer;
+
+// Returns 0 once the peer has to be dropped.
+static int agent_flush(AgentPeer *p) {
+  while (p->off < p->out.len) {
+    ssize_t w = send(p->fd, p->out.p + p->off, (size_t)(p->out.len - p->off),
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w > 0) { p->off += (int)w; continue; }
+    if (w < 0 && errno == EINTR) continue;
+    return (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+  }
+  p->off = p->out.len = 0;
+  return 1;
+}
+
+static void agent_drop(AgentPeer *peers, int *np, int i) {
+  close(peers[i].fd);
+  free(peers[i].out.p);
+  peers[i] = peers[--*np];
+}
+
+static int run_agent(const char *spec, int delay_ms, double budget, int fast_ms) {
+  int lfd = tcp_listen(spec);
+  if (lfd < 0 || listen(lfd, 16) != 0 || fcntl(lfd, F_SETFL, O_NONBLOCK) != 0) {
+    fprintf(stderr, "sparta-mon: --agent %s: %s\n", spec, strerror(errno));
+    if (lfd >= 0) close(lfd);
+    return 1;
+  }
+  static Exporter mx;
+  if (!metrics_start(&mx, getenv("METRICS"))) { close(lfd); return 1; }
+  static Watch wt;
+  if (!watch_init(&wt)) { metrics_stop(&mx); close(lfd); return 1; }
+  static Governor gv;
+  gov_init(&gv, budget);
+
+  signal(SIGINT, on_quit);
+  signal(SIGTERM, on_quit);
+  signal(SIGHUP, on_quit);
+
+  char host[64] = "?";
+  gethostname(host, sizeof(host) - 1);
+
+  static Collector col;
+  Boot boot;
+  boot_start(&boot, &col, fast_ms);
+  // Viewers that connect get a collector's history on this host, if any.
+  static HistSet hist;
+  shm_backfill(&hist, shm_name());
+  static AgentPeer peers[AGENT_PEERS];
+  int np = 0;
+  double t_prev = boot_finish(&boot);
+  if (!boot.fast_ok) fprintf(stderr, "sparta-mon: --fast: %s\n", strerror(boot.fast_err));
+
+  while (!g_quit) {
+    double t_cur = now_s();
+    double dt = t_cur - t_prev;
+    if (dt <= 0) dt = 0.001;
+    t_prev = t_cur;
+
+    Sample smp = {0};
+    collector_tick(&col, &smp, dt);
+    histset_push(&hist, &smp);
+    metrics_publish(&mx, &col, &smp);
+    int rec = watch_tick(&wt, &smp, &hist, &col.pt);
+    int tick_ms = gov_tick(&gv, &col, delay_ms, rec);
+    if (rec) tick_ms = MIN_DELAY_MS;
+
+    // Peers still sending an older frame skip this one; their next frame
+    // covers both ticks.
+    for (int i=0; i<np; i++) {
+      AgentPeer *p = &peers[i];
+      if (p->off == p->out.len) wire_frame(&p->out, &p->st, &smp, &hist, &col.pt);
+      if (!agent_flush(p)) agent_drop(peers, &np, i--);
+    }
+
+    // Until the next tick: accept viewers, notice hangups, drain backlogs.
+    for (;;) {
+      int left = (int)((t_cur + tick_ms / 1000.0 - now_s()) * 1000.0);
+      if (left <= 0 || g_quit) break;
+      struct pollfd pf[AGENT_PEERS + 1];
+      pf[0].fd = lfd; pf[0].events = POLLIN;
+      for (int i=0; i<np; i++) {
+        pf[i+1].fd = peers[i].fd;
+        pf[i+1].events = POLLIN | (peers[i].off < peers[i].out.len ? POLLOUT : 0);
+      }
+      if (poll(pf, (nfds_t)np + 1, left) <= 0) continue;
+
+      for (int i=np-1; i>=0; i--) {
+        short re = pf[i+1].revents;
+        int ok = 1;
+        if (re & POLLIN) {
+          char cmd[256];
+          ssize_t r = recv(peers[i].fd, cmd, sizeof(cmd), MSG_DONTWAIT);
+          if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) ok = 0;
+          if (r > 0 && memchr(cmd, 'R', (size_t)r)) {
+            // Queued frames still apply to the old state; the new hello
+            // resets the viewer right where the full frame starts.
+            AgentPeer *p = &peers[i];
+            memset(&p->st, 0, sizeof(p->st));
+            wire_hello(&p->out, host, delay_ms);
+            wire_frame(&p->out, &p->st, &smp, &hist, &col.pt);
+          }
+        }
+        if (re & (POLLERR | POLLNVAL)) ok = 0;
+        if (ok && (re & POLLOUT)) ok = agent_flush(&peers[i]);
+        if (!ok) agent_drop(peers, &np, i);
+      }
+
+      if (pf[0].revents & POLLIN) {
+        int fd;
+        while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          if (np == AGENT_PEERS) { close(fd); continue; }
+          AgentPeer *p = &peers[np++];
+          memset(p, 0, sizeof(*p));
+          p->fd = fd;
+          int one = 1;
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          wire_hello(&p->out, host, delay_ms);
+          wire_frame(&p->out, &p->st, &smp, &hist, &col.pt);
+          if (!agent_flush(p)) agent_drop(peers, &np, np - 1);
+        }
+      }
+    }
+  }
+
+  while (np > 0) agent_drop(peers, &np, np - 1);
+  close(lfd);
+  watch_free(&wt);
+  metrics_stop(&mx);
+  collector_free(&col);
+  return 0;
+}
+
+static void fleet_drill(Fleet *f, UI *u, int i) {
+  FleetHost *h = &f->hosts[i];
+  h->h = aligned_alloc(64, sizeof(HistSet));  // Hist rings are cache-line aligned
+  memset(h->h, 0, sizeof(HistSet));
+  wire_conn_resync(&h->c);
+  u->delay_ms = h->c.delay_ms ? h->c.delay_ms : DEFAULT_DELAY_MS;
+  ui_layout(u);
+}
+
+static int run_fleet(const char *list) {
+  static Fleet fl;
+  if (!fleet_init(&fl, list)) return 1;
+
+  signal(SIGWINCH, on_winch);
+  signal(SIGINT, on_quit);
+  signal(SIGTERM, on_quit);
+
+  static UI ui;
+  static FleetView fv;
+  initscr();
+  ui_start(&ui);
+  set_escdelay(25);
+  fleetview_layout(&fv);
+
+  int drill = -1;               // host shown in the 3x2 layout, -1 for the grid
+  unsigned long long drawn = 0; // that host's frame count when last drawn
+  double t_draw = 0;
+  int running = 1, dirty = 1;
+
+  while (running && !g_quit) {
+    if (g_resized || (drill < 0 ? (LINES != fv.lines || COLS != fv.cols) : ui_needs_layout(&ui))) {
+      g_resized = 0;
+      if (drill < 0) { endwin(); refresh(); fleetview_layout(&fv); }
+      else ui_layout(&ui);
+      dirty = 1;
+    }
+
+    int ch;
+    while (running && (ch = getch()) != ERR) {
+      dirty = 1;
+      if (drill >= 0) {
+        if (ch == 'q' || ch == 'Q' || ch == 27 || ch == KEY_BACKSPACE || ch == 127 || ch == KEY_LEFT) {
+          free(fl.hosts[drill].h);
+          fl.hosts[drill].h = NULL;
+          drill = -1;
+          fleetview_layout(&fv);
+        } else {
+          ui_key(&ui, ch);
+        }
+        continue;
+      }
+      if (ch == 'q' || ch == 'Q') running = 0;
+      else if (ch == 'c' || ch == 'C') { ui.use_color = !ui.use_color; fv.t.chrome = 0; }
+      else if (ch >= '1' && ch < '1' + FC_N) fleet_sort_by(&fl, ch - '1');
+      else if (ch == KEY_UP) fleetview_move(&fv, &fl, -1);
+      else if (ch == KEY_DOWN) fleetview_move(&fv, &fl, 1);
+      else if (ch == KEY_PPAGE) fleetview_move(&fv, &fl, -(fv.lines - 3));
+      else if (ch == KEY_NPAGE) fleetview_move(&fv, &fl, fv.lines - 3);
+      else if (ch == KEY_HOME) fleetview_move(&fv, &fl, -fl.n);
+      else if (ch == KEY_END) fleetview_move(&fv, &fl, fl.n);
+      else if (ch == '\n' || ch == '\r' || ch == KEY_ENTER || ch == KEY_RIGHT) {
+        drill = fv.sel;
+        drawn = 0;
+        fleet_drill(&fl, &ui, drill);
+      }
+    }
+
+    // The wait for traffic doubles as the loop's sleep.
+    fleet_poll(&fl, 20);
+
+    if (drill >= 0) {
+      FleetHost *h = &fl.hosts[drill];
+      char src[96];
+      if (h->c.up) snprintf(src, sizeof(src), "%.30s (%.60s)", h->c.host, h->c.spec);
+      else snprintf(src, sizeof(src), "%.60s %s", h->c.spec, h->seen ? "lost" : "connecting");
+      if (strcmp(src, ui.src) != 0) { memcpy(ui.src, src, sizeof(src)); dirty = 1; }
+      if (h->frames != drawn) { drawn = h->frames; dirty = 1; }
+      if (dirty) ui_draw(&ui, &h->s, h->h, &h->c.pt);
+      dirty = 0;
+      continue;
+    }
+
+    // With hundreds of hosts some frame lands every few ms; cap the grid
+    // at four redraws a second unless a key needs an answer.
+    double now = now_s();
+    if (dirty || now - t_draw >= 0.25) {
+      fleetview_draw(&fv, &fl, ui.use_color);
+      t_draw = now;
+      dirty = 0;
+    }
+  }
+
+  fleetview_free(&fv);
+  ui_free(&ui);
+  endwin();
+  fleet_free(&fl);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int collector = 0, local = 0, delay_ms = DEFAULT_DELAY_MS, fast_ms = 0;
+  double budget = 0.0;
+  const char *agent = NULL, *connect_to = NULL, *fleet = NULL;
+  for (int i=1; i<argc; i++) {
+    if (strcmp(argv[i], "--collector") == 0) collector = 1;
+    else if (strcmp(argv[i], "--local") == 0) local = 1;
+    else if (strcmp(argv[i], "--agent") == 0 && i+1 < argc) agent = argv[++i];
+    else if (strcmp(argv[i], "--connect") == 0 && i+1 < argc) connect_to = argv[++i];
+    else if (strcmp(argv[i], "--fleet") == 0 && i+1 < argc) fleet = argv[++i];
+    else if (strcmp(argv[i], "--budget") == 0 && i+1 < argc) budget = atof(argv[++i]);
+    else if (strcmp(argv[i], "--fast") == 0 && i+1 < argc) {
+      fast_ms = atoi(argv[++i]);
+      fast_ms = MAX(FAST_MIN_MS, MIN(FAST_MAX_MS, fast_ms));
+    }
+    else if (strcmp(argv[i], "--interval") == 0 && i+1 < argc) {
+      delay_ms = atoi(argv[++i]);
+      delay_ms = MAX(MIN_DELAY_MS, MIN(MAX_DELAY_MS, delay_ms));
+    }
+    else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) { usage(stdout); return 0; }
+    else { usage(stderr); return 2; }
+  }
+
+  setlocale(LC_ALL, "");
+  paths_init();
+  if (collector) return run_collector(delay_ms, budget, fast_ms);
+  if (agent) return run_agent(agent, delay_ms, budget, fast_ms);
+  if (fleet) return run_fleet(fleet);
 
-      char rssStr[32];
-      fmt_bytes(p->rss_bytes, rssStr, sizeof(rssStr));
+  signal(SIGWINCH, on_winch);
 
-      int hot = (p->cpu_cur >= 80.0);
-      if (use_color && hot) wattron(wProc, COLOR_PAIR(6) | A_BOLD);
-      else if (use_color) wattron(wProc, COLOR_PAIR(5));
+  // A viewer serves no metrics of its own, so METRICS implies --local.
+  static ShmView view;
+  int attached = !local && !connect_to && !getenv("METRICS") && shm_attach(&view, shm_name());
+  static WireConn conn;
+  if (connect_to) wire_conn_init(&conn, connect_to);
+
+  static Exporter mx;
+  if (!metrics_start(&mx, getenv("METRICS"))) return 1;
+  static Watch wt;
+  if (!watch_init(&wt)) { metrics_stop(&mx); return 1; }
+  static Governor gv;
+  gov_init(&gv, budget);
+
+  // The baseline tick runs while the terminal and panels come up.
+  static Collector col;
+  static Boot boot;
+  int sampling = !attached && !connect_to;
+  if (sampling) boot_start(&boot, &col, fast_ms);
+  static UI ui;
+  initscr();
+  ui_start(&ui);
+  ui.delay_ms = delay_ms;
+  ui_layout(&ui);
+  // A collector on this host (--local beside it, or one that just crashed)
+  // already has the history this one would start without.
+  static HistSet hist;
+  if (sampling) shm_backfill(&hist, shm_name());
+  double t_prev = sampling ? boot_finish(&boot) : now_s();
+
+  // Sorting only the tasks that match is safe while nothing else reads the
+  // table's order; the exporter's top tasks do.
+  ui.filt.local = !connect_to;
+  if (mx.fd < 0) col.filter = &ui.filt;
+  // A viewer on this host walks expanded threads and dumps sockets itself;
+  // the collector only publishes tasks.
+  static Threads vthr;
+  static Socks vsock;
+  static Mounts vmnt;
+  socks_init(&vsock);
+  mounts_init(&vmnt);
+  double t_thr = now_s();
+  if (attached) { ui.thr = &vthr; ui.socks = &vsock; ui.mnt = &vmnt; }
+  else if (!connect_to) { ui.thr = &col.thr; ui.socks = &col.socks; ui.mnt = &col.mnt; }
+  static Sample smp;
+  int have_frame = 0;
 
-      mvwprintw(wProc, y, 2, "%-6d %4.1f %4.1f %-7s %c %.*s",
-               p->pid, p->cpu_avg, p->cpu_cur, rssStr, p->state,
-               MAX(0, procW - 30), p->comm);
+  int running = 1;
 
-      if (use_color && hot) wattroff(wProc, COLOR_PAIR(6) | A_BOLD);
-      else if (use_color) wattroff(wProc, COLOR_PAIR(5));
+  while (running) {
+    int dirty = 0;
+    if (g_resized || ui_needs_layout(&ui)) {
+      g_resized = 0;
+      ui_layout(&ui);
+      dirty = 1;
+    }
 
-      y++;
+    int ch = getch();
+    if (ch != ERR) { running = ui_key(&ui, ch); dirty = 1; }
+
+    // Viewers poll their source often so frames follow the sampler's ticks,
+    // and only redraw when one arrives or a key needs an answer.
+    if (attached) {
+      int st = shm_read(&view, &smp, &hist);
+      if (st < 0) {
+        shm_detach(&view);
+        attached = 0;
+        ui.src[0] = '\0';
+        threads_free(&vthr);
+        socks_free(&vsock);
+        mounts_free(&vmnt);
+        boot_start(&boot, &col, fast_ms);
+        t_prev = boot_finish(&boot);
+        if (mx.fd < 0) col.filter = &ui.filt;
+        col.socks.on = ui.net_view;
+        ui.thr = &col.thr;
+        ui.socks = &col.socks;
+        ui.mnt = &col.mnt;
+        continue;
+      }
+      if (st > 0) {
+        snprintf(ui.src, sizeof(ui.src), "shm:%d", view.f->pid);
+        ui.delay_ms = view.f->delay_ms;
+        double t = now_s();
+        threads_scan(&vthr, t - t_thr);
+        if (vsock.on) socks_scan(&vsock, NULL);
+        if (ui.disk_view) mounts_tick(&vmnt);
+        t_thr = t;
+        have_frame = dirty = 1;
+      }
+      if (dirty && have_frame) ui_draw(&ui, &smp, &hist, &view.pt);
+      usleep((useconds_t)MIN(ui.delay_ms / 4, 50) * 1000);
+      continue;
     }
 
-    if (use_color) wattron(wProc, COLOR_PAIR(5) | A_DIM);
-    mvwprintw(wProc, procH-2, 2, "tasks:%d scroll:%d/%d  (100%%=1 core)",
-              pt.n, scroll, maxScroll);
-    if (use_color) wattroff(wProc, COLOR_PAIR(5) | A_DIM);
+    if (connect_to) {
+      if (wire_conn_poll(&conn, &smp, &hist) > 0) {
+        ui.delay_ms = conn.delay_ms;
+        have_frame = dirty = 1;
+      }
+      char src[96];
+      if (conn.up) snprintf(src, sizeof(src), "%.30s (%.60s)", conn.host, conn.spec);
+      else snprintf(src, sizeof(src), "%.60s %s", conn.spec, have_frame ? "lost" : "connecting");
+      if (strcmp(src, ui.src) != 0) { memcpy(ui.src, src, sizeof(src)); dirty = 1; }
+      if (dirty) ui_draw(&ui, &smp, &hist, &conn.pt);
+      usleep(20 * 1000);
+      continue;
+    }
 
-    wnoutrefresh(wProc);
+    double t_cur = now_s();
+    double dt = t_cur - t_prev;
+    if (dt <= 0) dt = 0.001;
 
-    // Commit all at once
-    doupdate();
+    memset(&smp, 0, sizeof(smp));
+    collector_tick(&col, &smp, dt);
+    histset_push(&hist, &smp);
+    metrics_publish(&mx, &col, &smp);
+    int rec = watch_tick(&wt, &smp, &hist, &col.pt);
+    int period = gov_tick(&gv, &col, ui.delay_ms, rec);
+    ui.rec = rec ? wt.fired : NULL;
+    if (gv.target > 0.0) {
+      TextBuf gb;
+      tb_init(&gb, ui.gov, sizeof(ui.gov));
+      gov_label(&gv, &col, &gb);
+    }
+    ui_draw(&ui, &smp, &hist, &col.pt);
 
     t_prev = t_cur;
-    usleep((useconds_t)delay_ms * 1000);
+    usleep((useconds_t)(rec ? MIN_DELAY_MS : period) * 1000);
   }
 
-  proctable_free(&pt);
-  if (wHdr) delwin(wHdr);
-  if (wCpu) delwin(wCpu);
-  if (wMem) delwin(wMem);
-  if (wTmp) delwin(wTmp);
-  if (wDisk) delwin(wDisk);
-  if (wProc) delwin(wProc);
-  if (wNet) delwin(wNet);
+  if (attached) shm_detach(&view);
+  threads_free(&vthr);
+  socks_free(&vsock);
+  mounts_free(&vmnt);
+  if (connect_to) wire_conn_free(&conn);
+  watch_free(&wt);
+  metrics_stop(&mx);
+  collector_free(&col);
+  ui_free(&ui);
   endwin();
   return 0;
 }
+#endif // SPARTA_MON_NO_MAIN